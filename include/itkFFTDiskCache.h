@@ -0,0 +1,102 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFFTDiskCache_h
+#define itkFFTDiskCache_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <string>
+
+namespace itk
+{
+/** \class FFTDiskCache
+ * \brief Persistent, content-addressed storage of FFT images.
+ *
+ * Each FFT is stored in its own file inside Directory. The file name is derived
+ * from a hash of the key, and the full key is stored in the file too, so hash
+ * collisions are detected. The key should describe everything the FFT depends on.
+ *
+ * Cached FFTs are memory-mapped when read, so reading is fast
+ * and the pixel data is only paged in when it is actually used.
+ *
+ * The cache is meant to be shared by the threads of a single process.
+ * Entries are written to a temporary file first and then renamed,
+ * so partially written entries are never observed.
+ *
+ * \ingroup Montage
+ */
+template <typename TComplexImage>
+class ITK_TEMPLATE_EXPORT FFTDiskCache : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(FFTDiskCache);
+
+  /** Standard class type aliases. */
+  using Self = FFTDiskCache;
+  using Superclass = Object;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(FFTDiskCache, Object);
+
+  using ImageType = TComplexImage;
+  using ImagePointer = typename ImageType::Pointer;
+  using PixelType = typename ImageType::PixelType;
+  static constexpr unsigned int ImageDimension = ImageType::ImageDimension;
+
+  /** Set/Get the directory where cache files are stored.
+   * It is created if it does not exist. */
+  itkSetStringMacro(Directory);
+  itkGetStringMacro(Directory);
+
+  /** Returns the FFT stored under the given key,
+   * or nullptr if there is no valid entry for it. */
+  ImagePointer
+  Read(const std::string & key) const;
+
+  /** Stores the FFT under the given key. A failure to write
+   * is not an error, the entry is simply not cached. */
+  void
+  Write(const std::string & key, const ImageType * fft) const;
+
+  /** Name of the file holding entry for the given key. */
+  std::string
+  GetFileName(const std::string & key) const;
+
+protected:
+  FFTDiskCache() = default;
+  ~FFTDiskCache() override = default;
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+private:
+  std::string m_Directory;
+};
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#  include "itkFFTDiskCache.hxx"
+#endif
+
+#endif // itkFFTDiskCache_h
@@ -0,0 +1,234 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkFFTDiskCache_hxx
+#define itkFFTDiskCache_hxx
+
+#include "itkMemoryMappedImportImageContainer.h"
+#include "itksys/SystemTools.hxx"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace itk
+{
+namespace detail
+{
+constexpr char          FFTDiskCacheMagic[8] = { 'I', 'T', 'K', 'M', 'F', 'F', 'T', '1' };
+constexpr std::uint32_t FFTDiskCacheByteOrderMark = 0x01020304;
+constexpr std::size_t   FFTDiskCacheAlignment = 64; // pixel data starts at a multiple of this
+
+// 64-bit FNV-1a, stable across platforms and runs, unlike std::hash
+inline std::uint64_t
+FFTDiskCacheHash(const std::string & key)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : key)
+  {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+} // namespace detail
+
+template <typename TComplexImage>
+std::string
+FFTDiskCache<TComplexImage>::GetFileName(const std::string & key) const
+{
+  std::ostringstream name;
+  name << m_Directory << '/' << std::hex << std::setw(16) << std::setfill('0') << detail::FFTDiskCacheHash(key)
+       << ".fft";
+  return name.str();
+}
+
+template <typename TComplexImage>
+auto
+FFTDiskCache<TComplexImage>::Read(const std::string & key) const -> ImagePointer
+{
+  MemoryMappedFile::Pointer file = MemoryMappedFile::New();
+  if (m_Directory.empty() || !file->Open(this->GetFileName(key)))
+  {
+    return nullptr;
+  }
+
+  const char * data = static_cast<const char *>(file->GetData());
+  std::size_t  pos = 0;
+  auto         read = [&](void * value, std::size_t size) {
+    if (pos + size > file->GetSize())
+    {
+      return false;
+    }
+    std::memcpy(value, data + pos, size);
+    pos += size;
+    return true;
+  };
+
+  char          magic[sizeof(detail::FFTDiskCacheMagic)];
+  std::uint32_t byteOrderMark, dimension, pixelSize;
+  std::uint64_t keyLength, dataOffset;
+  if (!read(magic, sizeof(magic)) || std::memcmp(magic, detail::FFTDiskCacheMagic, sizeof(magic)) != 0 ||
+      !read(&byteOrderMark, sizeof(byteOrderMark)) || byteOrderMark != detail::FFTDiskCacheByteOrderMark ||
+      !read(&dimension, sizeof(dimension)) || dimension != ImageDimension || !read(&pixelSize, sizeof(pixelSize)) ||
+      pixelSize != sizeof(PixelType) || !read(&keyLength, sizeof(keyLength)) || !read(&dataOffset, sizeof(dataOffset)))
+  {
+    return nullptr;
+  }
+
+  typename ImageType::RegionType    region;
+  typename ImageType::PointType     origin;
+  typename ImageType::SpacingType   spacing;
+  typename ImageType::DirectionType direction;
+  for (unsigned d = 0; d < ImageDimension; ++d)
+  {
+    std::int64_t  index;
+    std::uint64_t size;
+    double        o, s;
+    if (!read(&index, sizeof(index)) || !read(&size, sizeof(size)) || !read(&o, sizeof(o)) || !read(&s, sizeof(s)))
+    {
+      return nullptr;
+    }
+    region.SetIndex(d, index);
+    region.SetSize(d, size);
+    origin[d] = o;
+    spacing[d] = s;
+  }
+  for (unsigned r = 0; r < ImageDimension; ++r)
+  {
+    for (unsigned c = 0; c < ImageDimension; ++c)
+    {
+      double value;
+      if (!read(&value, sizeof(value)))
+      {
+        return nullptr;
+      }
+      direction(r, c) = value;
+    }
+  }
+
+  // the full key guards against hash collisions
+  if (pos + keyLength > file->GetSize() || key.compare(0, std::string::npos, data + pos, keyLength) != 0)
+  {
+    return nullptr;
+  }
+  const SizeValueType numberOfPixels = region.GetNumberOfPixels();
+  if (dataOffset + numberOfPixels * sizeof(PixelType) > file->GetSize())
+  {
+    return nullptr;
+  }
+
+  using ContainerType = MemoryMappedImportImageContainer<SizeValueType, PixelType>;
+  typename ContainerType::Pointer container = ContainerType::New();
+  container->SetMappedFile(file, dataOffset, numberOfPixels);
+
+  ImagePointer image = ImageType::New();
+  image->SetRegions(region);
+  image->SetOrigin(origin);
+  image->SetSpacing(spacing);
+  image->SetDirection(direction);
+  image->SetPixelContainer(container);
+  return image;
+}
+
+template <typename TComplexImage>
+void
+FFTDiskCache<TComplexImage>::Write(const std::string & key, const ImageType * fft) const
+{
+  if (m_Directory.empty() || fft == nullptr)
+  {
+    return;
+  }
+  const typename ImageType::RegionType region = fft->GetBufferedRegion();
+  if (region != fft->GetLargestPossibleRegion() || region.GetNumberOfPixels() == 0)
+  {
+    return; // only complete FFTs are cached
+  }
+  itksys::SystemTools::MakeDirectory(m_Directory);
+
+  // unique name of the temporary file, in case multiple threads write the same entry
+  std::ostringstream tempName;
+  tempName << this->GetFileName(key) << '.' << std::this_thread::get_id() << ".tmp";
+  std::ofstream out(tempName.str(), std::ios::binary);
+  if (!out)
+  {
+    return;
+  }
+
+  const std::uint32_t dimension = ImageDimension;
+  const std::uint32_t pixelSize = sizeof(PixelType);
+  const std::uint64_t keyLength = key.size();
+  const std::size_t   headerSize = sizeof(detail::FFTDiskCacheMagic) + 3 * sizeof(std::uint32_t) +
+                                 2 * sizeof(std::uint64_t) +
+                                 ImageDimension * (2 * sizeof(std::uint64_t) + 2 * sizeof(double)) +
+                                 ImageDimension * ImageDimension * sizeof(double) + key.size();
+  constexpr std::uint64_t alignment = detail::FFTDiskCacheAlignment;
+  const std::uint64_t     dataOffset = (headerSize + alignment - 1) / alignment * alignment;
+
+  auto write = [&out](const void * value, std::size_t size) { out.write(static_cast<const char *>(value), size); };
+  write(detail::FFTDiskCacheMagic, sizeof(detail::FFTDiskCacheMagic));
+  write(&detail::FFTDiskCacheByteOrderMark, sizeof(detail::FFTDiskCacheByteOrderMark));
+  write(&dimension, sizeof(dimension));
+  write(&pixelSize, sizeof(pixelSize));
+  write(&keyLength, sizeof(keyLength));
+  write(&dataOffset, sizeof(dataOffset));
+  for (unsigned d = 0; d < ImageDimension; ++d)
+  {
+    const std::int64_t  index = region.GetIndex(d);
+    const std::uint64_t size = region.GetSize(d);
+    const double        origin = fft->GetOrigin()[d];
+    const double        spacing = fft->GetSpacing()[d];
+    write(&index, sizeof(index));
+    write(&size, sizeof(size));
+    write(&origin, sizeof(origin));
+    write(&spacing, sizeof(spacing));
+  }
+  for (unsigned r = 0; r < ImageDimension; ++r)
+  {
+    for (unsigned c = 0; c < ImageDimension; ++c)
+    {
+      const double value = fft->GetDirection()(r, c);
+      write(&value, sizeof(value));
+    }
+  }
+  write(key.data(), key.size());
+  const std::string padding(dataOffset - headerSize, '\0');
+  write(padding.data(), padding.size());
+  write(fft->GetBufferPointer(), region.GetNumberOfPixels() * sizeof(PixelType));
+  out.close();
+
+  if (!out || std::rename(tempName.str().c_str(), this->GetFileName(key).c_str()) != 0)
+  {
+    std::remove(tempName.str().c_str()); // another thread might have created the entry in the meantime
+  }
+}
+
+template <typename TComplexImage>
+void
+FFTDiskCache<TComplexImage>::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Directory: " << m_Directory << std::endl;
+}
+} // namespace itk
+
+#endif // itkFFTDiskCache_hxx
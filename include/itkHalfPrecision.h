@@ -0,0 +1,105 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkHalfPrecision_h
+#define itkHalfPrecision_h
+
+#include <cstdint>
+#include <cstring>
+
+namespace itk
+{
+/** Converts a float to IEEE 754 binary16, rounding to the nearest (ties to even).
+ * Values too large for half precision become infinity, NaN stays NaN.
+ * \ingroup Montage */
+inline std::uint16_t
+FloatToHalf(float value)
+{
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto          sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+  const std::uint32_t absBits = bits & 0x7FFFFFFFu;
+
+  if (absBits >= 0x7F800000u) // infinity or NaN
+  {
+    return sign | 0x7C00u | (absBits > 0x7F800000u ? 0x0200u : 0u);
+  }
+  if (absBits >= 0x477FF000u) // 65520 and above round to infinity
+  {
+    return sign | 0x7C00u;
+  }
+  if (absBits < 0x38800000u) // below the smallest normal half, 2^-14
+  {
+    if (absBits < 0x33000000u) // at most half of the smallest subnormal half, 2^-24
+    {
+      return sign;
+    }
+    const std::uint32_t exponent = absBits >> 23;
+    const std::uint32_t mantissa = (absBits & 0x7FFFFFu) | 0x800000u;
+    const std::uint32_t shift = 126 - exponent; // from 14 to 24
+    const std::uint32_t half = mantissa >> shift;
+    const std::uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const std::uint32_t halfway = 1u << (shift - 1);
+    // rounding up the largest subnormal carries into the smallest normal
+    return static_cast<std::uint16_t>(sign | (half + (remainder > halfway || (remainder == halfway && (half & 1u)))));
+  }
+
+  // rebias the exponent from 127 to 15, and round the mantissa from 23 to 10 bits
+  const std::uint32_t half = (absBits - 0x38000000u) >> 13;
+  const std::uint32_t remainder = absBits & 0x1FFFu;
+  return static_cast<std::uint16_t>(sign | (half + (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))));
+}
+
+/** Converts IEEE 754 binary16 to float. The conversion is exact.
+ * \ingroup Montage */
+inline float
+HalfToFloat(std::uint16_t half)
+{
+  const std::uint32_t sign = std::uint32_t(half & 0x8000u) << 16;
+  const std::uint32_t exponent = (half >> 10) & 0x1Fu;
+  std::uint32_t       mantissa = half & 0x3FFu;
+  std::uint32_t       bits;
+  if (exponent == 0x1Fu) // infinity or NaN
+  {
+    bits = sign | 0x7F800000u | (mantissa << 13);
+  }
+  else if (exponent != 0)
+  {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  else if (mantissa == 0)
+  {
+    bits = sign;
+  }
+  else // subnormal half, normal float
+  {
+    std::uint32_t floatExponent = 113;
+    while ((mantissa & 0x400u) == 0)
+    {
+      mantissa <<= 1;
+      --floatExponent;
+    }
+    bits = sign | (floatExponent << 23) | ((mantissa & 0x3FFu) << 13);
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+} // namespace itk
+
+#endif // itkHalfPrecision_h
@@ -0,0 +1,96 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkMemoryMappedFile_h
+#define itkMemoryMappedFile_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "MontageExport.h"
+
+#include <string>
+
+namespace itk
+{
+/** \class MemoryMappedFile
+ * \brief Maps a whole file into memory for reading.
+ *
+ * The mapping is private (copy-on-write), so the mapped memory can be
+ * handed to code which expects a writable buffer without ever
+ * modifying the file. The file stays mapped until Close() is called
+ * or the object is destroyed.
+ *
+ * \ingroup Montage
+ */
+class Montage_EXPORT MemoryMappedFile : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(MemoryMappedFile);
+
+  /** Standard class type aliases. */
+  using Self = MemoryMappedFile;
+  using Superclass = Object;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(MemoryMappedFile, Object);
+
+  /** Maps the given file. Returns false if the file does not exist,
+   * is empty or cannot be mapped. Any previous mapping is closed. */
+  bool
+  Open(const std::string & fileName);
+
+  /** Unmaps the file. Does nothing if no file is mapped. */
+  void
+  Close();
+
+  /** Start of the mapped memory, or nullptr if no file is mapped. */
+  void *
+  GetData() const
+  {
+    return m_Data;
+  }
+
+  /** Size of the mapped file in bytes. */
+  std::size_t
+  GetSize() const
+  {
+    return m_Size;
+  }
+
+protected:
+  MemoryMappedFile() = default;
+  ~MemoryMappedFile() override;
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+private:
+  void *      m_Data = nullptr;
+  std::size_t m_Size = 0;
+#if defined(_WIN32)
+  void * m_FileHandle = nullptr;
+  void * m_MappingHandle = nullptr;
+#endif
+};
+} // namespace itk
+
+#endif // itkMemoryMappedFile_h
@@ -0,0 +1,81 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkMemoryMappedImportImageContainer_h
+#define itkMemoryMappedImportImageContainer_h
+
+#include "itkImportImageContainer.h"
+#include "itkMemoryMappedFile.h"
+
+namespace itk
+{
+/** \class MemoryMappedImportImageContainer
+ * \brief Pixel container which points into a memory-mapped file.
+ *
+ * The container does not own its memory, but it keeps the file mapped
+ * for as long as the container exists. This allows an image to be
+ * backed directly by a file on disk, with pages loaded on demand.
+ *
+ * \ingroup Montage
+ */
+template <typename TElementIdentifier, typename TElement>
+class ITK_TEMPLATE_EXPORT MemoryMappedImportImageContainer : public ImportImageContainer<TElementIdentifier, TElement>
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(MemoryMappedImportImageContainer);
+
+  /** Standard class type aliases. */
+  using Self = MemoryMappedImportImageContainer;
+  using Superclass = ImportImageContainer<TElementIdentifier, TElement>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(MemoryMappedImportImageContainer, ImportImageContainer);
+
+  using ElementIdentifier = TElementIdentifier;
+  using Element = TElement;
+
+  /** Makes the container refer to numberOfElements elements
+   * located offset bytes from the start of the mapped file. */
+  void
+  SetMappedFile(MemoryMappedFile * file, std::size_t offset, ElementIdentifier numberOfElements)
+  {
+    itkAssertOrThrowMacro(offset + numberOfElements * sizeof(Element) <= file->GetSize(),
+                          "Mapped file is too small for " << numberOfElements << " elements at offset " << offset);
+    m_MappedFile = file;
+    this->SetImportPointer(
+      reinterpret_cast<Element *>(static_cast<char *>(file->GetData()) + offset), numberOfElements, false);
+  }
+
+  /** Get the mapped file backing this container. */
+  itkGetConstObjectMacro(MappedFile, MemoryMappedFile);
+
+protected:
+  MemoryMappedImportImageContainer() = default;
+  ~MemoryMappedImportImageContainer() override = default;
+
+private:
+  MemoryMappedFile::ConstPointer m_MappedFile;
+};
+} // namespace itk
+
+#endif // itkMemoryMappedImportImageContainer_h
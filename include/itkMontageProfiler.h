@@ -0,0 +1,197 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkMontageProfiler_h
+#define itkMontageProfiler_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "MontageExport.h"
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace itk
+{
+/** \class MontageProfiler
+ * \brief Records wall times of the stages of montaging, and related counters.
+ *
+ * A profiler can be given to TileMontage, TileMergeImageFilter and
+ * PhaseCorrelationImageRegistrationMethod. They then record an event for
+ * each stage they execute (reading a tile, padding, FFT, registration of
+ * a pair, global optimization, merging of a region etc.), and accumulate
+ * counters such as bytes read and FFT cache hits. Without a profiler,
+ * nothing is recorded and the only cost is a null pointer check per stage.
+ *
+ * After Update(), the totals can be queried, or all the events exported
+ * in Chrome's trace event format (chrome://tracing or ui.perfetto.dev).
+ * Events can be recorded concurrently from multiple threads.
+ *
+ * \ingroup Montage
+ */
+class Montage_EXPORT MontageProfiler : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(MontageProfiler);
+
+  /** Standard class type aliases. */
+  using Self = MontageProfiler;
+  using Superclass = Object;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(MontageProfiler, Object);
+
+  using ClockType = std::chrono::steady_clock;
+  using TimePoint = ClockType::time_point;
+
+  /** A completed stage. Times are in microseconds since the profiler's creation or Clear(). */
+  struct Event
+  {
+    std::string Name;
+    std::string Category;
+    std::string Details; // free-form text, e.g. tile indices or FFT size
+    double      Start;
+    double      Duration;
+    unsigned    Thread; // small integer identifying the thread
+  };
+  using EventsType = std::vector<Event>;
+
+  /** Records a completed stage. */
+  void
+  AddEvent(const std::string & name,
+           const std::string & category,
+           TimePoint           start,
+           TimePoint           end,
+           const std::string & details = std::string());
+
+  /** Adds the value to the named counter. */
+  void
+  AddToCounter(const std::string & name, double value);
+
+  /** Returns the value of the named counter, or zero if it was never added to. */
+  double
+  GetCounter(const std::string & name) const;
+
+  /** Returns the total wall time of all the events with this name, in seconds.
+   * Events executed concurrently by different threads are summed. */
+  double
+  GetTotalTime(const std::string & name) const;
+
+  /** Returns the number of events with this name. */
+  SizeValueType
+  GetEventCount(const std::string & name) const;
+
+  /** Returns a copy of all the recorded events. */
+  EventsType
+  GetEvents() const;
+
+  /** Writes all the events and counters in Chrome's trace event format (JSON). */
+  void
+  WriteChromeTrace(const std::string & fileName) const;
+
+  /** Forgets all the events and counters, and restarts the clock. */
+  void
+  Clear();
+
+  /** Measures the lifetime of a scope as an event. Does nothing if the profiler is null.
+   * Details which need to be formatted can be given as a callable returning them,
+   * which is only called if there is a profiler. */
+  class Scope
+  {
+  public:
+    Scope(MontageProfiler * profiler, const char * name, const char * category)
+      : m_Profiler(profiler)
+    {
+      this->Start(name, category);
+    }
+    Scope(MontageProfiler * profiler, const char * name, const char * category, const std::string & details)
+      : m_Profiler(profiler)
+    {
+      if (m_Profiler)
+      {
+        m_Details = details;
+      }
+      this->Start(name, category);
+    }
+    template <typename TFormatDetails, typename = std::enable_if_t<std::is_invocable_v<TFormatDetails &>>>
+    Scope(MontageProfiler * profiler, const char * name, const char * category, TFormatDetails && formatDetails)
+      : m_Profiler(profiler)
+    {
+      if (m_Profiler)
+      {
+        m_Details = formatDetails();
+      }
+      this->Start(name, category);
+    }
+    ~Scope()
+    {
+      if (m_Profiler)
+      {
+        m_Profiler->AddEvent(m_Name, m_Category, m_Start, ClockType::now(), m_Details);
+      }
+    }
+    Scope(const Scope &) = delete;
+    Scope &
+    operator=(const Scope &) = delete;
+
+  private:
+    void
+    Start(const char * name, const char * category)
+    {
+      if (m_Profiler)
+      {
+        m_Name = name;
+        m_Category = category;
+        m_Start = ClockType::now();
+      }
+    }
+
+    MontageProfiler * m_Profiler;
+    const char *      m_Name = nullptr;
+    const char *      m_Category = nullptr;
+    std::string       m_Details;
+    TimePoint         m_Start;
+  };
+
+protected:
+  MontageProfiler();
+  ~MontageProfiler() override = default;
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+private:
+  mutable std::mutex                  m_Mutex;
+  TimePoint                           m_Epoch;
+  EventsType                          m_Events;
+  std::map<std::string, double>       m_Counters;
+  std::map<std::thread::id, unsigned> m_Threads;
+};
+} // namespace itk
+
+#endif // itkMontageProfiler_h
@@ -21,7 +21,7 @@
 #include "itkMacro.h"
 #include "itkObject.h"
 #include "itkObjectFactory.h"
-#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace itk
@@ -33,6 +33,12 @@ namespace itk
  * Minima are needed, just call ComputeMaxima() or ComputeMinima().
  * Compute() will compute both.
  *
+ * The region is split into chunks, processed in parallel. Each chunk is
+ * visited line by line, comparing each pixel only to the worst of the N
+ * values kept in the chunk's bounded heap. Chunk results are then merged
+ * pairwise, without locking. Equal values are ordered by their position
+ * in the buffer, so the result does not depend on the number of threads.
+ *
  * \ingroup Operators
  * \ingroup ITKCommon
  * \ingroup Montage
@@ -125,13 +131,11 @@ protected:
   void
   PrintSelf(std::ostream & os, Indent indent) const override;
 
-  template <typename TComparator = std::less<PixelType>>
+  /** Finds the N extreme values, those for which comp(value, other) is true
+   * relative to all the other pixels. The result is padded by the sentinel. */
+  template <typename TComparator>
   void
-  SortedInsert(ValueVector &     vals,
-               IndexVector &     indices,
-               const PixelType & val,
-               const IndexType & ind,
-               TComparator       comp = TComparator());
+  ComputeExtremes(ValueVector & values, IndexVector & indices, PixelType sentinel, TComparator comp) const;
   void
   InternalCompute();
 
@@ -147,7 +151,6 @@ private:
   bool       m_RegionSetByUser{ false };
   bool       m_ComputeMaxima{ true };
   bool       m_ComputeMinima{ true };
-  std::mutex m_Mutex;
 };
 } // end namespace itk
 
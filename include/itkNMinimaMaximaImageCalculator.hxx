@@ -19,10 +19,12 @@
 #define itkNMinimaMaximaImageCalculator_hxx
 
 
-#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionSplitterSlowDimension.h"
+#include "itkImageScanlineConstIterator.h"
 #include "itkMultiThreaderBase.h"
 #include "itkNumericTraits.h"
 #include <algorithm>
+#include <functional>
 
 namespace itk
 {
@@ -35,22 +37,93 @@ NMinimaMaximaImageCalculator<TInputImage>::NMinimaMaximaImageCalculator()
 
 template <typename TInputImage>
 template <typename TComparator>
-inline void
-NMinimaMaximaImageCalculator<TInputImage>::SortedInsert(ValueVector &     vals,
-                                                        IndexVector &     indices,
-                                                        const PixelType & val,
-                                                        const IndexType & ind,
-                                                        TComparator       comp)
+void
+NMinimaMaximaImageCalculator<TInputImage>::ComputeExtremes(ValueVector & values,
+                                                           IndexVector & indices,
+                                                           PixelType     sentinel,
+                                                           TComparator   comp) const
 {
-  auto ub = std::upper_bound(vals.begin(), vals.end(), val, comp);
-  if (ub != vals.end())
+  values.clear();
+  indices.clear();
+  if (m_N > 0 && m_Region.GetNumberOfPixels() > 0)
   {
-    unsigned i = ub - vals.begin();
-    vals.insert(ub, val);
-    vals.pop_back();
-    indices.insert(indices.begin() + i, ind);
-    indices.pop_back();
+    // value and offset in the buffer, the offset orders equal values
+    using CandidateType = std::pair<PixelType, OffsetValueType>;
+    const auto better = [comp](const CandidateType & a, const CandidateType & b) {
+      return comp(a.first, b.first) || (!comp(b.first, a.first) && a.second < b.second);
+    };
+
+    MultiThreaderBase::Pointer                mt = MultiThreaderBase::New();
+    ImageRegionSplitterSlowDimension::Pointer splitter = ImageRegionSplitterSlowDimension::New();
+
+    const unsigned chunkCount = splitter->GetNumberOfSplits(m_Region, mt->GetNumberOfWorkUnits());
+
+    std::vector<std::vector<CandidateType>> chunkExtremes(chunkCount);
+
+    const ImageType * image = m_Image;
+    mt->ParallelizeArray(
+      0,
+      chunkCount,
+      [&](SizeValueType c) {
+        RegionType chunk = m_Region;
+        splitter->GetSplit(c, chunkCount, chunk);
+        const SizeValueType          xSize = chunk.GetSize(0);
+        const PixelType *            buffer = image->GetBufferPointer();
+        std::vector<CandidateType> & heap = chunkExtremes[c]; // the worst of the kept values is at the front
+        heap.reserve(m_N);
+
+        ImageScanlineConstIterator<ImageType> it(image, chunk);
+        while (!it.IsAtEnd())
+        {
+          const OffsetValueType lineOffset = image->ComputeOffset(it.GetIndex());
+          const PixelType *     line = buffer + lineOffset;
+          SizeValueType         x = 0;
+          for (; x < xSize && heap.size() < m_N; x++) // fill the heap
+          {
+            heap.emplace_back(line[x], lineOffset + x);
+            std::push_heap(heap.begin(), heap.end(), better);
+          }
+          for (; x < xSize; x++)
+          {
+            if (comp(line[x], heap.front().first)) // equal values come later, so they are worse
+            {
+              std::pop_heap(heap.begin(), heap.end(), better);
+              heap.back() = CandidateType(line[x], lineOffset + x);
+              std::push_heap(heap.begin(), heap.end(), better);
+            }
+          }
+          it.NextLine();
+        }
+      },
+      nullptr);
+
+    // pairwise tree reduction, each chunk result is read and written by one merge only
+    for (unsigned step = 1; step < chunkCount; step *= 2)
+    {
+      for (unsigned c = 0; c + step < chunkCount; c += 2 * step)
+      {
+        std::vector<CandidateType> & merged = chunkExtremes[c];
+        merged.insert(merged.end(), chunkExtremes[c + step].begin(), chunkExtremes[c + step].end());
+        const SizeValueType kept = std::min<SizeValueType>(m_N, merged.size());
+        std::partial_sort(merged.begin(), merged.begin() + kept, merged.end(), better);
+        merged.resize(kept);
+        chunkExtremes[c + step].clear();
+      }
+    }
+
+    std::vector<CandidateType> & extremes = chunkExtremes[0];
+    std::sort(extremes.begin(), extremes.end(), better);
+    values.reserve(m_N);
+    indices.reserve(m_N);
+    for (const CandidateType & candidate : extremes)
+    {
+      values.push_back(candidate.first);
+      indices.push_back(image->ComputeIndex(candidate.second)); // index is needed only for the kept values
+    }
   }
+
+  values.resize(m_N, sentinel);
+  indices.resize(m_N, IndexType{});
 }
 
 template <typename TInputImage>
@@ -62,77 +135,14 @@ NMinimaMaximaImageCalculator<TInputImage>::InternalCompute()
     m_Region = m_Image->GetRequestedRegion();
   }
 
-  m_Minima.clear();
-  m_Minima.reserve(m_N + 1); // for overflow during insertion
-  m_Minima.resize(m_N, NumericTraits<PixelType>::max());
-  m_Maxima.clear();
-  m_Maxima.reserve(m_N + 1); // for overflow during insertion
-  m_Maxima.resize(m_N, NumericTraits<PixelType>::NonpositiveMin());
-
-  m_IndicesOfMinima.reserve(m_N + 1); // for overflow during insertion
-  m_IndicesOfMinima.resize(m_N);
-  m_IndicesOfMaxima.reserve(m_N + 1); // for overflow during insertion
-  m_IndicesOfMaxima.resize(m_N);
-
-  typename MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
-  mt->template ParallelizeImageRegion<ImageDimension>(
-    m_Region,
-    [this](const RegionType & region) {
-      thread_local ValueVector mins;
-      thread_local ValueVector maxs;
-      thread_local IndexVector minInd;
-      thread_local IndexVector maxInd;
-      if (m_ComputeMinima)
-      {
-        mins.clear();
-        mins.reserve(m_N + 1); // for overflow during insertion
-        mins.resize(m_N, NumericTraits<PixelType>::max());
-        minInd.reserve(m_N + 1); // for overflow during insertion
-        minInd.resize(m_N);
-      }
-      if (m_ComputeMaxima)
-      {
-        maxs.clear();
-        maxs.reserve(m_N + 1); // for overflow during insertion
-        maxs.resize(m_N, NumericTraits<PixelType>::NonpositiveMin());
-        maxInd.reserve(m_N + 1); // for overflow during insertion
-        maxInd.resize(m_N);
-      }
-
-      std::greater<PixelType>                      compGreater;
-      ImageRegionConstIteratorWithIndex<ImageType> iIt(this->m_Image, region);
-      for (; !iIt.IsAtEnd(); ++iIt)
-      {
-        const IndexType & ind = iIt.GetIndex();
-        const PixelType & val = iIt.Get();
-        if (m_ComputeMinima)
-        {
-          SortedInsert(mins, minInd, val, ind);
-        }
-        if (m_ComputeMaxima)
-        {
-          SortedInsert(maxs, maxInd, val, ind, compGreater);
-        }
-      }
-
-      // merge
-      std::lock_guard<std::mutex> mutexHolder(m_Mutex);
-      if (m_ComputeMinima)
-      {
-        for (unsigned i = 0; i < m_N; i++)
-        {
-          SortedInsert(m_Minima, m_IndicesOfMinima, mins[i], minInd[i]);
-        }
-      }
-      if (m_ComputeMaxima)
-      {
-        for (unsigned i = 0; i < m_N; i++)
-        {
-          SortedInsert(m_Maxima, m_IndicesOfMaxima, maxs[i], maxInd[i], compGreater);
-        }
-      }
-    },
-    nullptr);
+  if (m_ComputeMinima)
+  {
+    ComputeExtremes(m_Minima, m_IndicesOfMinima, NumericTraits<PixelType>::max(), std::less<PixelType>());
+  }
+  if (m_ComputeMaxima)
+  {
+    ComputeExtremes(m_Maxima, m_IndicesOfMaxima, NumericTraits<PixelType>::NonpositiveMin(), std::greater<PixelType>());
+  }
 }
 
 template <typename TInputImage>
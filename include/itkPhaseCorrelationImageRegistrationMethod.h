@@ -32,6 +32,7 @@
 #include <cmath>
 #include <complex>
 
+#include "itkMontageProfiler.h"
 #include "itkPhaseCorrelationOperator.h"
 #include "itkPhaseCorrelationOptimizer.h"
 
@@ -96,6 +97,7 @@ extern Montage_EXPORT std::ostream &
  *
  *  Step 3. is there to ease registration in case of significant
  *  low and/or high frequency artifcats, such as uneven lighting or high noise.
+ *  It is carried out by the operator, in the same pass as step 2.
  *
  *  Step 4. is carried by this class only when necessary.
  *  The IFFT filter is created using
@@ -117,6 +119,15 @@ extern Montage_EXPORT std::ostream &
  *  This class allows caching of image FFTs, because image montaging usually
  *  requires a single tile to participate in multiple image registrations.
  *
+ *  Steps 0 to 5 are run by StartOptimization(). A derived class can run them
+ *  by other means, for example keeping the images on a GPU from the upload of
+ *  the two tiles to the peak search, by overriding StartOptimization(),
+ *  GetOffsets() and GetConfidences(). TileMontage creates this class through
+ *  the object factory, so registering an override of it there is enough
+ *  for TileMontage to use such a class. The derived class does not need to
+ *  provide the forward FFTs (GetFixedImageFFT(), GetMovingImageFFT()), these are
+ *  then not cached. It should use them if they are set, though.
+ *
  *  TInternalPixelTypePixel will be used by internal filters. It should be
  *  float for integral and float inputs, and double for double inputs.
  *
@@ -231,6 +242,42 @@ public:
    *  Available after Update() has been called. */
   itkGetConstObjectMacro(MovingImageFFT, ComplexImageType);
 
+  /** Set images whose pixel buffers are re-used as outputs of the forward FFTs,
+   *  in case the FFTs are not cached and need to be computed. Either can be null.
+   *  This avoids allocations when the same instance registers many image pairs.
+   *  The buffers are used by the next Update() only, and only if
+   *  ReleaseDataBeforeUpdateFlag is off. */
+  void
+  SetFFTBuffers(ComplexImageType * fixedBuffer, ComplexImageType * movingBuffer)
+  {
+    m_FixedFFTBuffer = fixedBuffer;
+    m_MovingFFTBuffer = movingBuffer;
+  }
+
+  /** Disconnects this instance and its internal filters from the input images
+   *  and the FFTs. Buffers of the internal filters are kept. This allows
+   *  keeping the instance for re-use without also keeping the images alive. */
+  void
+  ReleaseInputs();
+
+  /** Region types of the input images. */
+  using FixedImageRegionType = typename FixedImageType::RegionType;
+  using MovingImageRegionType = typename MovingImageType::RegionType;
+
+  /** Get the region of the fixed image which is used for computing its FFT.
+   *  This is the expanded overlap if CropToOverlap is on, otherwise the whole image.
+   *  Available after UpdateOutputInformation() has been called. */
+  itkGetConstReferenceMacro(FixedImageRegion, FixedImageRegionType);
+
+  /** Get the region of the moving image which is used for computing its FFT.
+   *  This is the expanded overlap if CropToOverlap is on, otherwise the whole image.
+   *  Available after UpdateOutputInformation() has been called. */
+  itkGetConstReferenceMacro(MovingImageRegion, MovingImageRegionType);
+
+  /** Get the size to which the image regions are padded, i.e. the real size of the FFTs.
+   *  Available after UpdateOutputInformation() has been called. */
+  itkGetConstReferenceMacro(PaddedSize, SizeType);
+
   /** Passes ReleaseDataFlag to internal filters. */
   void
   SetReleaseDataFlag(bool flag) override;
@@ -239,6 +286,11 @@ public:
   void
   SetReleaseDataBeforeUpdateFlag(const bool flag) override;
 
+  /** Passes NumberOfWorkUnits to internal filters. Small FFTs are faster
+   * single-threaded, while registering several pairs in parallel. */
+  void
+  SetNumberOfWorkUnits(ThreadIdType workUnits) override;
+
   /** Set/Get the Operator. */
   itkSetObjectMacro(Operator, OperatorType);
   itkGetConstObjectMacro(Operator, OperatorType);
@@ -246,7 +298,13 @@ public:
   /** Set/Get the Optimizer. */
   virtual void
   SetOptimizer(OptimizerType *);
-  itkGetConstObjectMacro(Optimizer, OptimizerType);
+  itkGetModifiableObjectMacro(Optimizer, OptimizerType);
+
+  /** Set/Get the profiler. If set, the stages of the registration
+   * (padding, forward FFTs, operator, inverse FFT and peak search)
+   * are updated one by one, and their times recorded. Default: nullptr. */
+  itkSetObjectMacro(Profiler, MontageProfiler);
+  itkGetModifiableObjectMacro(Profiler, MontageProfiler);
 
   /** Given an image size, returns the smallest size
    *  which factorizes using FFT's prime factors. */
@@ -418,8 +476,9 @@ protected:
   void
   DeterminePadding();
 
-  /** Method that initiates the optimization process. */
-  void
+  /** Runs the registration, from padding the images to the peak search.
+   * The padded size and the regions are already determined. */
+  virtual void
   StartOptimization();
 
   /** Method invoked by the pipeline in order to trigger the computation of
@@ -435,9 +494,14 @@ protected:
   itkSetMacro(TransformParameters, ParametersType);
 
 
+  /** Makes the view share the pixels of the image, exposing only the given region
+   * (starting at index zero, and with the corresponding origin). This way the
+   * padder reads the overlap directly from the image, without copying it first. */
+  template <typename TImage>
+  static void
+  ConfigureView(TImage * view, const TImage * image, const typename TImage::RegionType & region);
+
   /** Types for internal componets. */
-  using FixedRoIType = RegionOfInterestImageFilter<FixedImageType, FixedImageType>;
-  using MovingRoIType = RegionOfInterestImageFilter<MovingImageType, MovingImageType>;
   using FixedPadderImageFilter = PadImageFilter<FixedImageType, RealImageType>;
   using MovingPadderImageFilter = PadImageFilter<MovingImageType, RealImageType>;
   using FixedConstantPadderType = ConstantPadImageFilter<FixedImageType, RealImageType>;
@@ -459,19 +523,26 @@ private:
   OperatorPointer  m_Operator = nullptr;
   OptimizerPointer m_Optimizer = nullptr;
 
+  MontageProfiler::Pointer m_Profiler = nullptr;
+
   MovingImageConstPointer m_MovingImage = nullptr;
   FixedImageConstPointer  m_FixedImage = nullptr;
 
   typename ComplexImageType::Pointer m_FixedImageFFT = nullptr;
   typename ComplexImageType::Pointer m_MovingImageFFT = nullptr;
-
-  ParametersType    m_TransformParameters;
-  SizeType          m_PadToSize;
-  SizeType          m_ObligatoryPadding;
-  PaddingMethodEnum m_PaddingMethod = PaddingMethodEnum::MirrorWithExponentialDecay;
-
-  typename FixedRoIType::Pointer             m_FixedRoI = FixedRoIType::New();
-  typename MovingRoIType::Pointer            m_MovingRoI = MovingRoIType::New();
+  typename ComplexImageType::Pointer m_FixedFFTBuffer = nullptr;
+  typename ComplexImageType::Pointer m_MovingFFTBuffer = nullptr;
+
+  ParametersType        m_TransformParameters;
+  FixedImageRegionType  m_FixedImageRegion;
+  MovingImageRegionType m_MovingImageRegion;
+  SizeType              m_PaddedSize;
+  SizeType              m_PadToSize;
+  SizeType              m_ObligatoryPadding;
+  PaddingMethodEnum     m_PaddingMethod = PaddingMethodEnum::MirrorWithExponentialDecay;
+
+  typename FixedImageType::Pointer           m_FixedView = FixedImageType::New();  // overlap of the fixed image
+  typename MovingImageType::Pointer          m_MovingView = MovingImageType::New(); // overlap of the moving image
   typename FixedPadderImageFilter::Pointer   m_FixedPadder = FixedPadderImageFilter::New();
   typename MovingPadderImageFilter::Pointer  m_MovingPadder = MovingPadderImageFilter::New();
   typename FixedConstantPadderType::Pointer  m_FixedConstantPadder = FixedConstantPadderType::New();
@@ -24,6 +24,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <sstream>
 
 namespace itk
 {
@@ -56,6 +57,7 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   };
 
   m_PadToSize.Fill(0);
+  m_PaddedSize.Fill(0);
   m_ObligatoryPadding.Fill(8);
   m_PaddingMethod = PaddingMethodEnum::Zero;                       // make sure the next call does modifications
   SetPaddingMethod(PaddingMethodEnum::MirrorWithExponentialDecay); // this initializes a few things
@@ -139,12 +141,10 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   }
 
   // set up the pipeline
-  m_FixedRoI->SetInput(m_FixedImage);
-  m_MovingRoI->SetInput(m_MovingImage);
   if (m_CropToOverlap)
   {
-    m_FixedPadder->SetInput(m_FixedRoI->GetOutput());
-    m_MovingPadder->SetInput(m_MovingRoI->GetOutput());
+    m_FixedPadder->SetInput(m_FixedView);
+    m_MovingPadder->SetInput(m_MovingView);
   }
   else
   {
@@ -167,36 +167,37 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   {
     m_Operator->SetMovingImage(m_MovingImageFFT);
   }
-  m_BandPassFilter->SetInput(m_Operator->GetOutput());
 
-  using ImageFilter = ImageToImageFilter<ComplexImageType, ComplexImageType>;
-  ImageFilter * finalOperatorFilter = m_BandPassFilter;
+  // the operator applies the band-pass in the same pass as computing the spectrum ratio
+  m_Operator->SetButterworthOrder(m_ButterworthOrder);
+  m_Operator->SetLowFrequency2(m_LowFrequency2);
+  m_Operator->SetHighFrequency2(m_HighFrequency2);
 
+  // the band-pass filter is only used to write filtered inputs when debugging
   if (m_LowFrequency2 > 0.0 && m_HighFrequency2 > 0.0)
   {
     m_BandPassFilter->SetFunctor(m_BandPassFunctor);
   }
-  else if (m_HighFrequency2 > 0.0)
+  else if (m_LowFrequency2 > 0.0)
   {
     m_BandPassFilter->SetFunctor(m_HighPassFunctor);
   }
-  else if (m_LowFrequency2 > 0.0)
+  else if (m_HighFrequency2 > 0.0)
   {
     m_BandPassFilter->SetFunctor(m_LowPassFunctor);
   }
   else // neither high nor low filtering is set
   {
     m_BandPassFilter->SetFunctor(m_IdentityFunctor);
-    finalOperatorFilter = m_Operator; // we skip the band-pass entirely
   }
 
-  m_Optimizer->SetComplexInput(finalOperatorFilter->GetOutput());
-  m_IFFT->SetInput(finalOperatorFilter->GetOutput());
+  m_Optimizer->SetComplexInput(m_Operator->GetOutput());
+  m_IFFT->SetInput(m_Operator->GetOutput());
   m_Optimizer->SetRealInput(m_IFFT->GetOutput());
   if (m_CropToOverlap)
   {
-    m_Optimizer->SetFixedImage(m_FixedRoI->GetOutput());
-    m_Optimizer->SetMovingImage(m_MovingRoI->GetOutput());
+    m_Optimizer->SetFixedImage(m_FixedView);
+    m_Optimizer->SetMovingImage(m_MovingView);
   }
   else
   {
@@ -233,6 +234,36 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   return size;
 }
 
+template <typename TFixedImage, typename TMovingImage, typename TInternalPixelType>
+template <typename TImage>
+void
+PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixelType>::ConfigureView(
+  TImage *                            view,
+  const TImage *                      image,
+  const typename TImage::RegionType & region)
+{
+  typename TImage::PointType origin;
+  image->TransformIndexToPhysicalPoint(region.GetIndex(), origin);
+
+  // shifting the buffered region keeps the pixels at the same memory locations
+  typename TImage::RegionType buffered = image->GetBufferedRegion();
+  typename TImage::IndexType  bufferedIndex = buffered.GetIndex();
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    bufferedIndex[d] -= region.GetIndex(d);
+  }
+  buffered.SetIndex(bufferedIndex);
+  const typename TImage::RegionType largest(region.GetSize());
+
+  view->SetPixelContainer(const_cast<typename TImage::PixelContainer *>(image->GetPixelContainer()));
+  view->SetSpacing(image->GetSpacing());
+  view->SetDirection(image->GetDirection());
+  view->SetOrigin(origin);
+  view->SetLargestPossibleRegion(largest);
+  view->SetBufferedRegion(buffered);
+  view->SetRequestedRegion(largest);
+}
+
 template <typename TFixedImage, typename TMovingImage, typename TInternalPixelType>
 void
 PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixelType>::DeterminePadding()
@@ -300,8 +331,10 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
     fRegion.SetSize(iSize);
     mRegion.SetIndex(mIndex);
     mRegion.SetSize(iSize);
-    m_FixedRoI->SetRegionOfInterest(fRegion);
-    m_MovingRoI->SetRegionOfInterest(mRegion);
+    ConfigureView(m_FixedView.GetPointer(), m_FixedImage.GetPointer(), fRegion);
+    ConfigureView(m_MovingView.GetPointer(), m_MovingImage.GetPointer(), mRegion);
+    m_FixedImageRegion = fRegion;
+    m_MovingImageRegion = mRegion;
 
     for (unsigned int d = 0; d < ImageDimension; ++d)
     {
@@ -316,6 +349,8 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   }
   else // do not crop to overlap
   {
+    m_FixedImageRegion = m_FixedImage->GetLargestPossibleRegion();
+    m_MovingImageRegion = m_MovingImage->GetLargestPossibleRegion();
     if (m_PadToSize == size0)
     {
       // set up padding to resize the images to the same size
@@ -378,6 +413,7 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
     }
   }
 
+  m_PaddedSize = fftSize;
   m_FixedPadder->SetPadLowerBound(m_ObligatoryPadding);
   m_MovingPadder->SetPadLowerBound(m_ObligatoryPadding);
   m_FixedPadder->SetPadUpperBound(fixedPad);
@@ -397,6 +433,12 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   OffsetType offset;
   try
   {
+    if (m_CropToOverlap) // the pixels might not have been available during GenerateOutputInformation
+    {
+      ConfigureView(m_FixedView.GetPointer(), m_FixedImage.GetPointer(), m_FixedImageRegion);
+      ConfigureView(m_MovingView.GetPointer(), m_MovingImage.GetPointer(), m_MovingImageRegion);
+    }
+
     if (this->GetDebug())
     {
       WriteDebug(m_FixedImage.GetPointer(), "m_FixedImage.nrrd");
@@ -407,22 +449,69 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
       WriteDebug(m_MovingFFT->GetOutput(), "m_MovingFFT.nrrd");
       if (m_CropToOverlap)
       {
-        WriteDebug(m_FixedRoI->GetOutput(), "m_FixedRoI.nrrd");
-        WriteDebug(m_MovingRoI->GetOutput(), "m_MovingRoI.nrrd");
+        WriteDebug(m_FixedView.GetPointer(), "m_FixedView.nrrd");
+        WriteDebug(m_MovingView.GetPointer(), "m_MovingView.nrrd");
       }
     }
 
     m_FixedPadder->UpdateOutputInformation(); // to make sure xSize is valid
     unsigned xSize = m_FixedPadder->GetOutput()->GetLargestPossibleRegion().GetSize(0);
     m_IFFT->SetActualXDimensionIsOdd(xSize % 2 != 0);
+    // FFTs which need to be computed can write into the provided buffers
+    if (m_FixedImageFFT.IsNull() && m_FixedFFTBuffer.IsNotNull())
+    {
+      m_FixedFFT->GraftOutput(m_FixedFFTBuffer);
+    }
+    if (m_MovingImageFFT.IsNull() && m_MovingFFTBuffer.IsNotNull())
+    {
+      m_MovingFFT->GraftOutput(m_MovingFFTBuffer);
+    }
+    m_FixedFFTBuffer = nullptr;
+    m_MovingFFTBuffer = nullptr;
+
     auto * phaseCorrelation = static_cast<RealImageType *>(this->ProcessObject::GetOutput(1));
     phaseCorrelation->Allocate();
     m_IFFT->GraftOutput(phaseCorrelation);
-    m_IFFT->Update();
+    if (m_Profiler) // update the stages one by one, to measure them separately
+    {
+      std::ostringstream fftSize;
+      fftSize << m_FixedPadder->GetOutput()->GetLargestPossibleRegion().GetSize();
+      if (m_FixedImageFFT.IsNull())
+      {
+        {
+          MontageProfiler::Scope scope(m_Profiler, "Pad", "registration", fftSize.str());
+          m_FixedPadder->Update();
+        }
+        MontageProfiler::Scope scope(m_Profiler, "ForwardFFT", "registration", fftSize.str());
+        m_FixedFFT->Update();
+      }
+      if (m_MovingImageFFT.IsNull())
+      {
+        {
+          MontageProfiler::Scope scope(m_Profiler, "Pad", "registration", fftSize.str());
+          m_MovingPadder->Update();
+        }
+        MontageProfiler::Scope scope(m_Profiler, "ForwardFFT", "registration", fftSize.str());
+        m_MovingFFT->Update();
+      }
+      {
+        MontageProfiler::Scope scope(m_Profiler, "Operator", "registration", fftSize.str());
+        m_Operator->Update();
+      }
+      MontageProfiler::Scope scope(m_Profiler, "InverseFFT", "registration", fftSize.str());
+      m_IFFT->Update();
+    }
+    else
+    {
+      m_IFFT->Update();
+    }
 
     const unsigned offsetCount = ImageDimension;
     m_Optimizer->SetOffsetCount(offsetCount); // update can reduce this, so we have to set it each time
-    m_Optimizer->Update();
+    {
+      MontageProfiler::Scope scope(m_Profiler, "PeakSearch", "registration");
+      m_Optimizer->Update();
+    }
     offset = m_Optimizer->GetOffsets()[0];
     phaseCorrelation->Graft(m_IFFT->GetOutput());
 
@@ -440,7 +529,6 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
     if (this->GetDebug())
     {
       WriteDebug(m_IFFT->GetOutput(), "m_IFFT.nrrd");
-      WriteDebug(m_BandPassFilter->GetOutput(), "m_BandPassFilter.nrrd");
       WriteDebug(m_Operator->GetOutput(), "m_Operator.nrrd");
 
       // now do banpass of input images and inverse FFT
@@ -666,13 +754,41 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
 }
 
 
+template <typename TFixedImage, typename TMovingImage, typename TInternalPixelType>
+void
+PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixelType>::ReleaseInputs()
+{
+  this->SetFixedImage(nullptr);  // also clears the FFT
+  this->SetMovingImage(nullptr); // also clears the FFT
+  m_FixedFFTBuffer = nullptr;
+  m_MovingFFTBuffer = nullptr;
+
+  m_FixedView->Initialize(); // releases the reference to the pixels
+  m_MovingView->Initialize();
+  m_FixedConstantPadder->SetInput(nullptr);
+  m_MovingConstantPadder->SetInput(nullptr);
+  m_FixedMirrorPadder->SetInput(nullptr);
+  m_MovingMirrorPadder->SetInput(nullptr);
+  m_FixedMirrorWEDPadder->SetInput(nullptr);
+  m_MovingMirrorWEDPadder->SetInput(nullptr);
+  if (m_Operator)
+  {
+    m_Operator->SetFixedImage(nullptr);
+    m_Operator->SetMovingImage(nullptr);
+  }
+  if (m_Optimizer)
+  {
+    m_Optimizer->SetFixedImage(nullptr);
+    m_Optimizer->SetMovingImage(nullptr);
+  }
+}
+
+
 template <typename TFixedImage, typename TMovingImage, typename TInternalPixelType>
 void
 PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixelType>::SetReleaseDataFlag(bool a_flag)
 {
   Superclass::SetReleaseDataFlag(a_flag);
-  m_FixedRoI->SetReleaseDataFlag(a_flag);
-  m_MovingRoI->SetReleaseDataFlag(a_flag);
   m_FixedConstantPadder->SetReleaseDataFlag(a_flag);
   m_MovingConstantPadder->SetReleaseDataFlag(a_flag);
   m_FixedMirrorPadder->SetReleaseDataFlag(a_flag);
@@ -681,7 +797,12 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   m_MovingMirrorWEDPadder->SetReleaseDataFlag(a_flag);
   m_FixedFFT->SetReleaseDataFlag(a_flag);
   m_MovingFFT->SetReleaseDataFlag(a_flag);
+  m_BandPassFilter->SetReleaseDataFlag(a_flag);
   m_IFFT->SetReleaseDataFlag(a_flag);
+  if (m_Operator)
+  {
+    m_Operator->SetReleaseDataFlag(a_flag);
+  }
 }
 
 
@@ -691,8 +812,6 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   bool a_flag)
 {
   Superclass::SetReleaseDataBeforeUpdateFlag(a_flag);
-  m_FixedRoI->SetReleaseDataBeforeUpdateFlag(a_flag);
-  m_MovingRoI->SetReleaseDataBeforeUpdateFlag(a_flag);
   m_FixedConstantPadder->SetReleaseDataBeforeUpdateFlag(a_flag);
   m_MovingConstantPadder->SetReleaseDataBeforeUpdateFlag(a_flag);
   m_FixedMirrorPadder->SetReleaseDataBeforeUpdateFlag(a_flag);
@@ -701,7 +820,40 @@ PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixe
   m_MovingMirrorWEDPadder->SetReleaseDataBeforeUpdateFlag(a_flag);
   m_FixedFFT->SetReleaseDataBeforeUpdateFlag(a_flag);
   m_MovingFFT->SetReleaseDataBeforeUpdateFlag(a_flag);
+  m_BandPassFilter->SetReleaseDataBeforeUpdateFlag(a_flag);
   m_IFFT->SetReleaseDataBeforeUpdateFlag(a_flag);
+  if (m_Operator)
+  {
+    m_Operator->SetReleaseDataBeforeUpdateFlag(a_flag);
+  }
+}
+
+
+template <typename TFixedImage, typename TMovingImage, typename TInternalPixelType>
+void
+PhaseCorrelationImageRegistrationMethod<TFixedImage, TMovingImage, TInternalPixelType>::SetNumberOfWorkUnits(
+  ThreadIdType workUnits)
+{
+  Superclass::SetNumberOfWorkUnits(workUnits);
+  workUnits = this->GetNumberOfWorkUnits(); // clamped
+  m_FixedConstantPadder->SetNumberOfWorkUnits(workUnits);
+  m_MovingConstantPadder->SetNumberOfWorkUnits(workUnits);
+  m_FixedMirrorPadder->SetNumberOfWorkUnits(workUnits);
+  m_MovingMirrorPadder->SetNumberOfWorkUnits(workUnits);
+  m_FixedMirrorWEDPadder->SetNumberOfWorkUnits(workUnits);
+  m_MovingMirrorWEDPadder->SetNumberOfWorkUnits(workUnits);
+  m_FixedFFT->SetNumberOfWorkUnits(workUnits);
+  m_MovingFFT->SetNumberOfWorkUnits(workUnits);
+  m_BandPassFilter->SetNumberOfWorkUnits(workUnits);
+  m_IFFT->SetNumberOfWorkUnits(workUnits);
+  if (m_Operator)
+  {
+    m_Operator->SetNumberOfWorkUnits(workUnits);
+  }
+  if (m_Optimizer)
+  {
+    m_Optimizer->SetNumberOfWorkUnits(workUnits);
+  }
 }
 
 
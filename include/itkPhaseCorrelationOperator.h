@@ -18,8 +18,11 @@
 #ifndef itkPhaseCorrelationOperator_h
 #define itkPhaseCorrelationOperator_h
 
+#include "itkFrequencyHalfHermitianFFTLayoutImageRegionIteratorWithIndex.h"
 #include "itkImageToImageFilter.h"
+#include <array>
 #include <complex>
+#include <vector>
 
 namespace itk
 {
@@ -32,6 +35,11 @@ namespace itk
  *  This frequency ratio is computed at every index of output correlation
  *  surface.
  *
+ *  Optionally, a Butterworth band-pass filter is applied to the ratio in
+ *  the same pass. Squares of frequencies along each axis are tabulated once
+ *  per spectrum size, so the filter weight of each frequency is obtained
+ *  from a few additions and multiplications.
+ *
  * \author Jakub Bican, jakub.bican@matfyz.cz, Department of Image Processing,
  *         Institute of Information Theory and Automation,
  *         Academy of Sciences of the Czech Republic.
@@ -78,6 +86,20 @@ public:
   void
   SetMovingImage(ImageType * movingImage);
 
+  /** Set/Get the order of the Butterworth band-pass filter. Default is 3. */
+  itkSetMacro(ButterworthOrder, unsigned);
+  itkGetConstMacro(ButterworthOrder, unsigned);
+
+  /** Set/Get the square of the low frequency threshold of the band-pass filter.
+   * Frequencies below it are attenuated. Zero (default) disables this cut-off. */
+  itkSetMacro(LowFrequency2, double);
+  itkGetConstMacro(LowFrequency2, double);
+
+  /** Set/Get the square of the high frequency threshold of the band-pass filter.
+   * Frequencies above it are attenuated. Zero (default) disables this cut-off. */
+  itkSetMacro(HighFrequency2, double);
+  itkGetConstMacro(HighFrequency2, double);
+
 protected:
   PhaseCorrelationOperator();
   ~PhaseCorrelationOperator() override = default;
@@ -97,10 +119,39 @@ protected:
   void
   EnlargeOutputRequestedRegion(DataObject * output) override;
 
+  /** Tabulates the squares of frequencies, unless they are cached for this spectrum size. */
+  void
+  BeforeThreadedGenerateData() override;
+
   /** PhaseCorrelationOperator can be implemented as a multithreaded filter.
    *  This method performs the computation. */
   void
   DynamicThreadedGenerateData(const OutputImageRegionType & outputRegionForThread) override;
+
+  /** Computes base^exponent by repeated multiplication. */
+  static double
+  IntegerPower(double base, unsigned exponent)
+  {
+    double result = 1.0;
+    for (unsigned i = 0; i < exponent; i++)
+    {
+      result *= base;
+    }
+    return result;
+  }
+
+private:
+  using FrequencyIteratorType = FrequencyHalfHermitianFFTLayoutImageRegionIteratorWithIndex<ImageType>;
+
+  unsigned m_ButterworthOrder = 3;
+  double   m_LowFrequency2 = 0.0;
+  double   m_HighFrequency2 = 0.0;
+
+  // squares of frequencies along each axis, they sum up to the square of frequency's modulus
+  std::array<std::vector<double>, ImageDimension> m_FrequencySquares;
+  typename ImageType::RegionType                  m_FrequencyRegion; // for which the table was computed
+  typename ImageType::SpacingType                 m_FrequencySpacing;
+  typename ImageType::PointType                   m_FrequencyOrigin;
 };
 
 } // end namespace itk
@@ -44,6 +44,9 @@ void
 PhaseCorrelationOperator<TRealPixel, VImageDimension>::PrintSelf(std::ostream & os, Indent indent) const
 {
   Superclass::PrintSelf(os, indent);
+  os << indent << "ButterworthOrder: " << m_ButterworthOrder << std::endl;
+  os << indent << "LowFrequency2: " << m_LowFrequency2 << std::endl;
+  os << indent << "HighFrequency2: " << m_HighFrequency2 << std::endl;
 }
 
 
@@ -63,6 +66,43 @@ PhaseCorrelationOperator<TRealPixel, VImageDimension>::SetMovingImage(ImageType
 }
 
 
+template <typename TRealPixel, unsigned int VImageDimension>
+void
+PhaseCorrelationOperator<TRealPixel, VImageDimension>::BeforeThreadedGenerateData()
+{
+  if (m_LowFrequency2 <= 0.0 && m_HighFrequency2 <= 0.0)
+  {
+    return; // no band-pass
+  }
+
+  ImageType *                          output = this->GetOutput();
+  const typename ImageType::RegionType region = output->GetLargestPossibleRegion();
+  if (region == m_FrequencyRegion && output->GetSpacing() == m_FrequencySpacing &&
+      output->GetOrigin() == m_FrequencyOrigin)
+  {
+    return; // the table is valid
+  }
+
+  // the frequency along an axis depends only on the index along that axis
+  FrequencyIteratorType freqIt(output, region);
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    m_FrequencySquares[d].resize(region.GetSize(d));
+    typename ImageType::IndexType index = region.GetIndex();
+    for (SizeValueType i = 0; i < region.GetSize(d); i++)
+    {
+      index[d] = region.GetIndex(d) + i;
+      freqIt.SetIndex(index);
+      const double f = freqIt.GetFrequency()[d];
+      m_FrequencySquares[d][i] = f * f;
+    }
+  }
+  m_FrequencyRegion = region;
+  m_FrequencySpacing = output->GetSpacing();
+  m_FrequencyOrigin = output->GetOrigin();
+}
+
+
 template <typename TRealPixel, unsigned int VImageDimension>
 void
 PhaseCorrelationOperator<TRealPixel, VImageDimension>::DynamicThreadedGenerateData(
@@ -73,40 +113,57 @@ PhaseCorrelationOperator<TRealPixel, VImageDimension>::DynamicThreadedGenerateDa
   ImageConstPointer moving = this->GetInput(1);
   ImagePointer      output = this->GetOutput();
 
-  // Define an iterator that will walk the output region for this thread.
-  using InputIterator = ImageScanlineConstIterator<ImageType>;
-  using OutputIterator = ImageScanlineIterator<ImageType>;
-  InputIterator  fixedIt(fixed, outputRegionForThread);
-  InputIterator  movingIt(moving, outputRegionForThread);
-  OutputIterator outIt(output, outputRegionForThread);
+  const bool          lowCut = m_LowFrequency2 > 0.0;
+  const bool          highCut = m_HighFrequency2 > 0.0;
+  const double        lowScale = lowCut ? 1.0 / m_LowFrequency2 : 0.0;
+  const double        highScale = highCut ? 1.0 / m_HighFrequency2 : 0.0;
+  const SizeValueType xSize = outputRegionForThread.GetSize(0);
 
-  // walk the output region, and sample the input image
+  // band-pass weights of the current line, all ones without band-pass
+  std::vector<PixelType> weights(xSize, 1);
+
+  ImageScanlineIterator<ImageType> outIt(output, outputRegionForThread);
   while (!outIt.IsAtEnd())
   {
-    while (!outIt.IsAtEndOfLine())
+    const typename ImageType::IndexType lineIndex = outIt.GetIndex();
+    if (lowCut || highCut)
     {
-      // compute the phase correlation
-      const PixelType real =
-        fixedIt.Value().real() * movingIt.Value().real() + fixedIt.Value().imag() * movingIt.Value().imag();
-      const PixelType imag =
-        fixedIt.Value().imag() * movingIt.Value().real() - fixedIt.Value().real() * movingIt.Value().imag();
-      const PixelType magn = std::sqrt(real * real + imag * imag);
-
-      if (magn != 0)
+      double lineF2 = 0.0; // contribution of all axes except the first one
+      for (unsigned d = 1; d < ImageDimension; d++)
       {
-        outIt.Set(ComplexType(real / magn, imag / magn));
+        lineF2 += m_FrequencySquares[d][lineIndex[d] - m_FrequencyRegion.GetIndex(d)];
       }
-      else
+      const double * xF2 = m_FrequencySquares[0].data() + (lineIndex[0] - m_FrequencyRegion.GetIndex(0));
+      for (SizeValueType x = 0; x < xSize; x++)
       {
-        outIt.Set(ComplexType(0, 0));
+        const double f2 = lineF2 + xF2[x]; // square of frequency's modulus
+        double       weight = 1.0;
+        if (lowCut)
+        {
+          const double p = IntegerPower(f2 * lowScale, m_ButterworthOrder);
+          weight *= p / (1.0 + p); // equal to 1 - 1 / (1 + p)
+        }
+        if (highCut)
+        {
+          weight /= 1.0 + IntegerPower(f2 * highScale, m_ButterworthOrder);
+        }
+        weights[x] = weight;
       }
+    }
 
-      ++fixedIt;
-      ++movingIt;
-      ++outIt;
+    const ComplexType * fixedLine = fixed->GetBufferPointer() + fixed->ComputeOffset(lineIndex);
+    const ComplexType * movingLine = moving->GetBufferPointer() + moving->ComputeOffset(lineIndex);
+    ComplexType *       outLine = output->GetBufferPointer() + output->ComputeOffset(lineIndex);
+    for (SizeValueType x = 0; x < xSize; x++)
+    {
+      // compute the phase correlation
+      const PixelType real = fixedLine[x].real() * movingLine[x].real() + fixedLine[x].imag() * movingLine[x].imag();
+      const PixelType imag = fixedLine[x].imag() * movingLine[x].real() - fixedLine[x].real() * movingLine[x].imag();
+      const PixelType magn = std::sqrt(real * real + imag * imag);
+      const PixelType scale = (magn != 0) ? weights[x] / magn : PixelType(0);
+      outLine[x] = ComplexType(real * scale, imag * scale);
     }
-    fixedIt.NextLine();
-    movingIt.NextLine();
+
     outIt.NextLine();
   }
 }
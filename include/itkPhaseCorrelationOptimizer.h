@@ -25,7 +25,6 @@
 #include <vector>
 #include "MontageExport.h"
 #include "itkNMinimaMaximaImageCalculator.h"
-#include "itkCyclicShiftImageFilter.h"
 #include "itkRealToHalfHermitianForwardFFTImageFilter.h"
 #include "itkFFTPadImageFilter.h"
 
@@ -97,6 +96,9 @@ extern Montage_EXPORT std::ostream &
  *  For PeakInterpolationMethod::WeightedMeanPhase, for efficiency, the
  *  weighted mean phase method is used the first PhaseInterpolated
  *  number of peaks, and Parabolic interpolation is used for the remaining peaks.
+ *  The correlation surface is Fourier transformed once. The spectrum of the
+ *  surface shifted to each peak is its phase ramped version, which is only
+ *  evaluated along the frequency axes, and the peaks are refined in parallel.
  *  This approach is summarized in:
  *
  *    https://www.ncbi.nlm.nih.gov/pubmed/31352341
@@ -216,6 +218,13 @@ public:
   itkGetConstMacro(ZeroSuppression, double);
   itkSetClampMacro(ZeroSuppression, double, 0.0, 100.0);
 
+  /** Get/Set the confidence ratio of the highest peak to the next one, at or
+   * above which the highest peak is unambiguous. Only that peak is then
+   * interpolated and returned, instead of up to OffsetCount peaks.
+   * Zero (the default) disables this. */
+  itkGetConstMacro(PeakConfidenceRatio, double);
+  itkSetClampMacro(PeakConfidenceRatio, double, 0.0, NumericTraits<double>::max());
+
   /** Get/Set expected maximum linear translation needed, in pixels.
    * Zero (the default) has a special meaning: sigmoid scaling
    * with half-way point at around quarter of image size.
@@ -223,6 +232,17 @@ public:
   itkGetConstMacro(PixelDistanceTolerance, SizeValueType);
   itkSetMacro(PixelDistanceTolerance, SizeValueType);
 
+  /** Get/Set whether to search for peaks only in the neighborhoods of the
+   * expected solution, when PixelDistanceTolerance is non-zero. Pixels
+   * further away are zeroed in the biased correlation image anyway, so the
+   * result is the same, but only O(tolerance^D) pixels are visited instead
+   * of the whole correlation image. AdjustedInput is not computed then.
+   * WeightedMeanPhase interpolation needs AdjustedInput, so it always
+   * searches the whole image. Default is true. */
+  itkGetConstMacro(WindowedPeakSearch, bool);
+  itkSetMacro(WindowedPeakSearch, bool);
+  itkBooleanMacro(WindowedPeakSearch);
+
   /** Get correlation image biased towards the expected solution. */
   itkGetConstObjectMacro(AdjustedInput, ImageType);
 
@@ -271,14 +291,13 @@ private:
   typename MaxCalculatorType::Pointer m_MaxCalculator = MaxCalculatorType::New();
   unsigned                            m_MergePeaks = 1;
   double                              m_ZeroSuppression = 5;
+  double                              m_PeakConfidenceRatio = 0.0;
   SizeValueType                       m_PixelDistanceTolerance = 0;
+  bool                                m_WindowedPeakSearch = true;
 
   typename ImageType::Pointer m_AdjustedInput;
   IndexContainerType          m_MaxIndices;
 
-  using CyclicShiftFilterType = CyclicShiftImageFilter<ImageType>;
-  typename CyclicShiftFilterType::Pointer m_CyclicShiftFilter = CyclicShiftFilterType::New();
-
   unsigned int m_PhaseInterpolated{ 1 };
 
   using PadFilterType = FFTPadImageFilter<ImageType, ImageType>;
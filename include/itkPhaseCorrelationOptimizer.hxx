@@ -20,11 +20,15 @@
 
 
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkCompensatedSummation.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <type_traits>
+#include <utility>
 
 //#ifndef NDEBUG
 #include "itkImageFileWriter.h"
@@ -71,8 +75,7 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::PhaseCorrelationOpti
   this->m_AdjustedInput = ImageType::New();
 
   this->m_PadFilter->SetSizeGreatestPrimeFactor(this->m_FFTFilter->GetSizeGreatestPrimeFactor());
-  this->m_CyclicShiftFilter->SetInput(this->m_PadFilter->GetOutput());
-  this->m_FFTFilter->SetInput(this->m_CyclicShiftFilter->GetOutput());
+  this->m_FFTFilter->SetInput(this->m_PadFilter->GetOutput());
 }
 
 
@@ -109,7 +112,9 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::PrintSelf(std::ostre
   os << indent << "MaxCalculator: " << m_MaxCalculator << std::endl;
   os << indent << "MergePeaks: " << m_MergePeaks << std::endl;
   os << indent << "ZeroSuppression: " << m_ZeroSuppression << std::endl;
+  os << indent << "PeakConfidenceRatio: " << m_PeakConfidenceRatio << std::endl;
   os << indent << "PixelDistanceTolerance: " << m_PixelDistanceTolerance << std::endl;
+  os << indent << "WindowedPeakSearch: " << (m_WindowedPeakSearch ? "On" : "Off") << std::endl;
 }
 
 
@@ -237,14 +242,6 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::ComputeOffset()
   OffsetType offset;
   offset.Fill(0);
 
-  // create the image which will be biased towards the expected solution
-  // other pixels get their value reduced by multiplication with
-  // e^(-f*(d/s)^2), where f is distancePenaltyFactor,
-  // d is pixel's distance, and s is approximate image size
-  m_AdjustedInput->CopyInformation(input);
-  m_AdjustedInput->SetRegions(input->GetBufferedRegion());
-  m_AdjustedInput->Allocate(false);
-
   typename ImageType::IndexType adjustedSize;
   typename ImageType::IndexType directExpectedIndex;
   typename ImageType::IndexType mirrorExpectedIndex;
@@ -267,128 +264,233 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::ComputeOffset()
     distancePenaltyFactor = std::log(0.9) / (m_PixelDistanceTolerance * m_PixelDistanceTolerance);
   }
 
+  const IndexValueType zeroDist2 =
+    100 * m_PixelDistanceTolerance * m_PixelDistanceTolerance; // round down to zero further from this
+  // biases the correlation towards the expected solution
+  auto penalize = [&](const typename ImageType::IndexType & ind, typename ImageType::PixelType pixel) {
+    IndexValueType dist = 0;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      IndexValueType distDirect = (directExpectedIndex[d] - ind[d]) * (directExpectedIndex[d] - ind[d]);
+      IndexValueType distMirror = (mirrorExpectedIndex[d] - ind[d]) * (mirrorExpectedIndex[d] - ind[d]);
+      if (distDirect <= distMirror)
+      {
+        dist += distDirect;
+      }
+      else
+      {
+        dist += distMirror;
+      }
+    }
+
+    if (m_PixelDistanceTolerance > 0 && dist > zeroDist2)
+    {
+      pixel = 0;
+    }
+    else // evaluate the expensive exponential function
+    {
+      pixel *= std::exp(distancePenaltyFactor * dist);
+#ifndef NDEBUG
+      pixel *= 1000; // make the intensities in this image more humane (close to 1.0)
+                     // it is really hard to count zeroes after decimal point when comparing pixel intensities
+                     // since this images is used to find maxima, absolute values are irrelevant
+#endif
+    }
+    return pixel;
+  };
+
+  // suppresses trivial zero solution
+  auto suppressZero = [&](const typename ImageType::IndexType & ind, typename ImageType::PixelType pixel) {
+    constexpr IndexValueType znSize = 4; // zero neighborhood size, in city-block distance
+    bool                     pixelValid = false;
+    IndexValueType           dist = 0;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      IndexValueType distD = ind[d] - oIndex[d];
+      if (distD > IndexValueType(size[d] / 2)) // wrap around
+      {
+        distD = size[d] - distD;
+      }
+      dist += distD;
+    }
+
+    if (dist < znSize) // neighborhood of [0,0,...,0] - in case zero peak is blurred
+    {
+      pixelValid = true;
+    }
+    else
+    {
+      for (unsigned d = 0; d < ImageDimension; d++) // lines/sheets of zero m_MaxIndices
+      {
+        if (ind[d] == oIndex[d]) // one of the m_MaxIndices is "zero"
+        {
+          pixelValid = true;
+        }
+      }
+    }
+
+    if (pixelValid) // either neighborhood or lines/sheets says update the pixel
+    {
+      // avoid the initial steep rise of function x/(1+x) by shifting it by 10
+      pixel *= (dist + 10) / (m_ZeroSuppression + dist + 10);
+    }
+    return pixel;
+  };
+
+  SizeValueType maximaCount = this->m_Offsets.size();
+  if (m_MergePeaks)
+  {
+    maximaCount = std::ceil(this->m_Offsets.size() / 2) * (static_cast<unsigned>(std::pow(3, ImageDimension)) - 1);
+  }
+
   MultiThreaderBase * mt = this->GetMultiThreader();
-  mt->ParallelizeImageRegion<ImageDimension>(
-    wholeImage,
-    [&](const typename ImageType::RegionType & region) {
-      ImageRegionConstIterator<ImageType>     iIt(input, region);
-      ImageRegionIteratorWithIndex<ImageType> oIt(m_AdjustedInput, region);
-      IndexValueType                          zeroDist2 =
-        100 * m_PixelDistanceTolerance * m_PixelDistanceTolerance; // round down to zero further from this
-      for (; !oIt.IsAtEnd(); ++iIt, ++oIt)
+  if (m_PixelDistanceTolerance > 0 && m_WindowedPeakSearch &&
+      m_PeakInterpolationMethod != PeakInterpolationMethodEnum::WeightedMeanPhase)
+  {
+    // along each axis, only indices close to direct or mirror expected index can have non-zero penalized value
+    using IntervalType = std::pair<IndexValueType, IndexValueType>; // first and last index
+    const IndexValueType                                  halfWidth = 10 * m_PixelDistanceTolerance;
+    std::array<std::vector<IntervalType>, ImageDimension> intervals;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      const IndexValueType first = oIndex[d];
+      const IndexValueType last = oIndex[d] + IndexValueType(size[d]) - 1;
+      for (IndexValueType center : { directExpectedIndex[d], mirrorExpectedIndex[d] })
       {
-        typename ImageType::IndexType ind = oIt.GetIndex();
-        IndexValueType                dist = 0;
-        for (unsigned d = 0; d < ImageDimension; d++)
+        const IndexValueType low = std::max(first, center - halfWidth);
+        const IndexValueType high = std::min(last, center + halfWidth);
+        if (low > high)
         {
-          IndexValueType distDirect = (directExpectedIndex[d] - ind[d]) * (directExpectedIndex[d] - ind[d]);
-          IndexValueType distMirror = (mirrorExpectedIndex[d] - ind[d]) * (mirrorExpectedIndex[d] - ind[d]);
-          if (distDirect <= distMirror)
-          {
-            dist += distDirect;
-          }
-          else
-          {
-            dist += distMirror;
-          }
+          continue; // outside of the image
+        }
+        if (!intervals[d].empty() && low <= intervals[d].back().second + 1)
+        {
+          intervals[d].back().second = std::max(intervals[d].back().second, high); // merge overlapping
+        }
+        else
+        {
+          intervals[d].emplace_back(low, high);
         }
+      }
+    }
 
-        typename ImageType::PixelType pixel;
-        if (m_PixelDistanceTolerance > 0 && dist > zeroDist2)
+    // visit all combinations of per-axis intervals
+    using CandidateType = std::pair<typename ImageType::PixelType, typename ImageType::IndexType>;
+    std::vector<CandidateType>    candidates;
+    typename ImageType::IndexType boxChoice;
+    boxChoice.Fill(0);
+    bool empty = false;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      empty = empty || intervals[d].empty();
+    }
+    while (!empty)
+    {
+      typename ImageType::RegionType box;
+      for (unsigned d = 0; d < ImageDimension; d++)
+      {
+        box.SetIndex(d, intervals[d][boxChoice[d]].first);
+        box.SetSize(d, intervals[d][boxChoice[d]].second - intervals[d][boxChoice[d]].first + 1);
+      }
+      ImageRegionConstIteratorWithIndex<ImageType> iIt(input, box);
+      for (; !iIt.IsAtEnd(); ++iIt)
+      {
+        typename ImageType::PixelType pixel = penalize(iIt.GetIndex(), iIt.Get());
+        if (m_ZeroSuppression > 0.0)
         {
-          pixel = 0;
+          pixel = suppressZero(iIt.GetIndex(), pixel);
         }
-        else // evaluate the expensive exponential function
+        if (pixel > 0)
         {
-          pixel = iIt.Get() * std::exp(distancePenaltyFactor * dist);
-#ifndef NDEBUG
-          pixel *= 1000; // make the intensities in this image more humane (close to 1.0)
-                         // it is really hard to count zeroes after decimal point when comparing pixel intensities
-                         // since this images is used to find maxima, absolute values are irrelevant
-#endif
+          candidates.emplace_back(pixel, iIt.GetIndex());
         }
-        oIt.Set(pixel);
       }
-    },
-    nullptr);
 
-  // WriteDebug(m_AdjustedInput.GetPointer(), "m_AdjustedInput.nrrd");
+      unsigned d = 0; // advance to the next combination
+      for (; d < ImageDimension; d++)
+      {
+        if (++boxChoice[d] < IndexValueType(intervals[d].size()))
+        {
+          break;
+        }
+        boxChoice[d] = 0;
+      }
+      empty = (d == ImageDimension);
+    }
 
-  if (m_ZeroSuppression > 0.0) // suppress trivial zero solution
+    // equal values are ordered by their offset in the buffer, like NMinimaMaximaImageCalculator does,
+    // so the result does not depend on the order in which the boxes were visited
+    const auto kept = candidates.begin() + std::min<SizeValueType>(candidates.size(), maximaCount);
+    const auto better = [input](const CandidateType & a, const CandidateType & b) {
+      return a.first > b.first ||
+             (a.first == b.first && input->ComputeOffset(a.second) < input->ComputeOffset(b.second));
+    };
+    std::partial_sort(candidates.begin(), kept, candidates.end(), better);
+    candidates.erase(kept, candidates.end());
+    this->m_Confidences.resize(candidates.size());
+    this->m_MaxIndices.resize(candidates.size());
+    for (unsigned i = 0; i < candidates.size(); i++)
+    {
+      this->m_Confidences[i] = candidates[i].first;
+      this->m_MaxIndices[i] = candidates[i].second;
+    }
+  }
+  else
   {
-    constexpr IndexValueType znSize = 4; // zero neighborhood size, in city-block distance
+    // create the image which will be biased towards the expected solution
+    // other pixels get their value reduced by multiplication with
+    // e^(-f*(d/s)^2), where f is distancePenaltyFactor,
+    // d is pixel's distance, and s is approximate image size
+    m_AdjustedInput->CopyInformation(input);
+    m_AdjustedInput->SetRegions(input->GetBufferedRegion());
+    m_AdjustedInput->Allocate(false);
+
     mt->ParallelizeImageRegion<ImageDimension>(
       wholeImage,
       [&](const typename ImageType::RegionType & region) {
+        ImageRegionConstIterator<ImageType>     iIt(input, region);
         ImageRegionIteratorWithIndex<ImageType> oIt(m_AdjustedInput, region);
-        for (; !oIt.IsAtEnd(); ++oIt)
+        for (; !oIt.IsAtEnd(); ++iIt, ++oIt)
         {
-          bool                          pixelValid = false;
-          typename ImageType::PixelType pixel;
-          typename ImageType::IndexType ind = oIt.GetIndex();
-          IndexValueType                dist = 0;
-          for (unsigned d = 0; d < ImageDimension; d++)
-          {
-            IndexValueType distD = ind[d] - oIndex[d];
-            if (distD > IndexValueType(size[d] / 2)) // wrap around
-            {
-              distD = size[d] - distD;
-            }
-            dist += distD;
-          }
+          oIt.Set(penalize(oIt.GetIndex(), iIt.Get()));
+        }
+      },
+      nullptr);
 
-          if (dist < znSize) // neighborhood of [0,0,...,0] - in case zero peak is blurred
-          {
-            pixelValid = true;
-          }
-          else
-          {
-            for (unsigned d = 0; d < ImageDimension; d++) // lines/sheets of zero m_MaxIndices
-            {
-              if (ind[d] == oIndex[d]) // one of the m_MaxIndices is "zero"
-              {
-                pixelValid = true;
-              }
-            }
-          }
+    // WriteDebug(m_AdjustedInput.GetPointer(), "m_AdjustedInput.nrrd");
 
-          if (pixelValid) // either neighborhood or lines/sheets says update the pixel
+    if (m_ZeroSuppression > 0.0) // suppress trivial zero solution
+    {
+      mt->ParallelizeImageRegion<ImageDimension>(
+        wholeImage,
+        [&](const typename ImageType::RegionType & region) {
+          ImageRegionIteratorWithIndex<ImageType> oIt(m_AdjustedInput, region);
+          for (; !oIt.IsAtEnd(); ++oIt)
           {
-            pixel = oIt.Get();
-            // avoid the initial steep rise of function x/(1+x) by shifting it by 10
-            pixel *= (dist + 10) / (m_ZeroSuppression + dist + 10);
-            oIt.Set(pixel);
+            oIt.Set(suppressZero(oIt.GetIndex(), oIt.Get()));
           }
-        }
-      },
-      nullptr);
+        },
+        nullptr);
 
-    // WriteDebug(m_AdjustedInput.GetPointer(), "m_AdjustedInputZS.nrrd");
-  }
+      // WriteDebug(m_AdjustedInput.GetPointer(), "m_AdjustedInputZS.nrrd");
+    }
 
-  m_MaxCalculator->SetImage(m_AdjustedInput);
-  if (m_MergePeaks)
-  {
-    m_MaxCalculator->SetN(std::ceil(this->m_Offsets.size() / 2) *
-                          (static_cast<unsigned>(std::pow(3, ImageDimension)) - 1));
-  }
-  else
-  {
-    m_MaxCalculator->SetN(this->m_Offsets.size());
-  }
+    m_MaxCalculator->SetImage(m_AdjustedInput);
+    m_MaxCalculator->SetN(maximaCount);
 
-  try
-  {
-    m_MaxCalculator->ComputeMaxima();
-  }
-  catch (ExceptionObject & err)
-  {
-    itkDebugMacro("exception caught during execution of max calculator - passing ");
-    throw err;
-  }
+    try
+    {
+      m_MaxCalculator->ComputeMaxima();
+    }
+    catch (ExceptionObject & err)
+    {
+      itkDebugMacro("exception caught during execution of max calculator - passing ");
+      throw err;
+    }
 
-  this->m_Confidences = m_MaxCalculator->GetMaxima();
-  this->m_MaxIndices = m_MaxCalculator->GetIndicesOfMaxima();
+    this->m_Confidences = m_MaxCalculator->GetMaxima();
+    this->m_MaxIndices = m_MaxCalculator->GetIndicesOfMaxima();
+  }
   itkAssertOrThrowMacro(this->m_Confidences.size() == m_MaxIndices.size(),
                         "Maxima and their m_MaxIndices must have the same number of elements");
   std::greater<RealPixelType> compGreater;
@@ -461,6 +563,13 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::ComputeOffset()
     m_MaxIndices.swap(tIndices);
   }
 
+  if (m_PeakConfidenceRatio > 0.0 && this->m_Confidences.size() > 1 &&
+      this->m_Confidences[0] >= m_PeakConfidenceRatio * this->m_Confidences[1])
+  {
+    this->m_Confidences.resize(1); // a dominant peak, the others are not worth interpolating
+    m_MaxIndices.resize(1);
+  }
+
   if (this->m_Offsets.size() > this->m_Confidences.size())
   {
     this->SetOffsetCount(this->m_Confidences.size());
@@ -576,22 +685,23 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::ComputeOffset()
     }   // for offsetIndex
     if (this->m_PeakInterpolationMethod == PeakInterpolationMethodEnum::WeightedMeanPhase)
     {
-      for (unsigned int peak = 0; peak < this->m_PhaseInterpolated && peak < this->m_Offsets.size(); ++peak)
-      {
-        this->m_PadFilter->SetInput(this->m_AdjustedInput);
-        typename CyclicShiftFilterType::OffsetType shiftFilterOffset;
-        for (unsigned int dim = 0; dim < ImageDimension; ++dim)
-        {
-          shiftFilterOffset[dim] = -maxIndices[peak][dim];
-        }
-        this->m_CyclicShiftFilter->SetShift(shiftFilterOffset);
-        this->m_FFTFilter->Update();
-        const typename FFTFilterType::OutputImageType * correlationFFT = this->m_FFTFilter->GetOutput();
+      // the spectrum of the correlation surface cyclically shifted to have the peak at the origin
+      // differs from the unshifted spectrum only by a phase ramp, so the surface is transformed once
+      this->m_AdjustedInput->Modified(); // refilled in place
+      this->m_PadFilter->SetInput(this->m_AdjustedInput);
+      this->m_FFTFilter->Update();
+      const typename FFTFilterType::OutputImageType * correlationFFT = this->m_FFTFilter->GetOutput();
+      const typename ImageType::SizeType paddedSize =
+        this->m_PadFilter->GetOutput()->GetLargestPossibleRegion().GetSize();
+
+      const SizeValueType peakCount = std::min<SizeValueType>(this->m_PhaseInterpolated, this->m_Offsets.size());
+      mt->ParallelizeArray(
+        0,
+        peakCount,
+        [&](SizeValueType peak) {
+          using ContinuousIndexType = ContinuousIndex<OffsetScalarType, ImageDimension>;
+          ContinuousIndexType maxIndex = maxIndices[peak];
 
-        using ContinuousIndexType = ContinuousIndex<OffsetScalarType, ImageDimension>;
-        ContinuousIndexType maxIndex = maxIndices[peak];
-        if (this->m_PeakInterpolationMethod == PeakInterpolationMethodEnum::WeightedMeanPhase)
-        {
           using SumType = CompensatedSummation<double>;
           SumType                                            powerSum;
           SumType                                            weightedPhase;
@@ -601,40 +711,44 @@ PhaseCorrelationOptimizer<TRealPixelType, VImageDimension>::ComputeOffset()
             powerSum.ResetToZero();
             weightedPhase.ResetToZero();
             index.Fill(0);
-            const SizeValueType maxFreqIndex = correlationFFT->GetLargestPossibleRegion().GetSize()[dim] / 2;
+            const auto           n = static_cast<IndexValueType>(paddedSize[dim]);
+            const IndexValueType peakPosition = ((maxIndices[peak][dim] % n) + n) % n;
+            const SizeValueType  maxFreqIndex = correlationFFT->GetLargestPossibleRegion().GetSize()[dim] / 2;
             for (SizeValueType freqIndex = 1; freqIndex < maxFreqIndex; ++freqIndex)
             {
               index[dim] = freqIndex;
-              const typename FFTFilterType::OutputPixelType correlation = correlationFFT->GetPixel(index);
-              const double                                  phase = std::arg(correlation);
-              const double power = correlation.imag() * correlation.imag() + correlation.real() * correlation.real();
+              // shifting by -peakPosition multiplies the spectrum by exp(2 pi i freqIndex peakPosition / n)
+              const IndexValueType ramp = (IndexValueType(freqIndex) * peakPosition) % n;
+              const std::complex<double> correlation =
+                std::complex<double>(correlationFFT->GetPixel(index)) * std::polar(1.0, 2.0 * Math::pi * ramp / n);
+              const double phase = std::arg(correlation);
+              const double power = std::norm(correlation);
               weightedPhase += phase / Math::pi * power;
               powerSum += power;
             }
             const double deltaToF = -1 * weightedPhase.GetSum() / powerSum.GetSum();
             maxIndex[dim] += deltaToF;
           }
-          //} else if(this->m_PeakInterpolationMethod == PeakInterpolationMethodEnum::PhaseFrequencySlope) {
-          //// todo: compute the linear regression of the phase, use
+          //// todo: PhaseFrequencySlope, compute the linear regression of the phase, use
           //// slope, add to maxIndex
-        }
 
-        for (unsigned i = 0; i < ImageDimension; ++i)
-        {
-          const OffsetScalarType directOffset =
-            (movingOrigin[i] - fixedOrigin[i]) - 1 * spacing[i] * (maxIndex[i] - oIndex[i]);
-          const OffsetScalarType mirrorOffset =
-            (movingOrigin[i] - fixedOrigin[i]) - 1 * spacing[i] * (maxIndex[i] - adjustedSize[i]);
-          if (itk::Math::abs(directOffset) <= itk::Math::abs(mirrorOffset))
+          for (unsigned i = 0; i < ImageDimension; ++i)
           {
-            this->m_Offsets[peak][i] = directOffset;
-          }
-          else
-          {
-            this->m_Offsets[peak][i] = mirrorOffset;
+            const OffsetScalarType directOffset =
+              (movingOrigin[i] - fixedOrigin[i]) - 1 * spacing[i] * (maxIndex[i] - oIndex[i]);
+            const OffsetScalarType mirrorOffset =
+              (movingOrigin[i] - fixedOrigin[i]) - 1 * spacing[i] * (maxIndex[i] - adjustedSize[i]);
+            if (itk::Math::abs(directOffset) <= itk::Math::abs(mirrorOffset))
+            {
+              this->m_Offsets[peak][i] = directOffset;
+            }
+            else
+            {
+              this->m_Offsets[peak][i] = mirrorOffset;
+            }
           }
-        }
-      }
+        },
+        nullptr);
     } // frequency domain interpolation
   }   // interpolate the peak
 }
@@ -0,0 +1,52 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkRawPixelDataLocation_h
+#define itkRawPixelDataLocation_h
+
+#include "MontageExport.h"
+
+#include <cstdint>
+#include <string>
+
+namespace itk
+{
+/** \struct RawPixelDataLocation
+ * \brief Where the uncompressed pixel data of an image file are stored.
+ *
+ * \ingroup Montage
+ */
+struct RawPixelDataLocation
+{
+  std::string  DataFileName; // the image file itself if the data are attached to the header
+  std::int64_t Offset = 0;   // in bytes from the start of the data file, negative if the data are at its end
+};
+
+/** Examines the header of a NRRD (.nrrd, .nhdr) or MetaImage (.mha, .mhd) file.
+ * If its pixel data are stored in binary, uncompressed, in a single file,
+ * their location is returned and true is returned. Otherwise, including for other file formats,
+ * false is returned. Pixel type, size and byte order are not examined,
+ * ImageIO should be consulted for those.
+ *
+ * \ingroup Montage
+ */
+Montage_EXPORT bool
+LocateRawPixelData(const std::string & fileName, RawPixelDataLocation & location);
+} // namespace itk
+
+#endif // itkRawPixelDataLocation_h
@@ -0,0 +1,189 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkTileCache_h
+#define itkTileCache_h
+
+#include "itkDataObject.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "MontageExport.h"
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace itk
+{
+/** \class TileCache
+ * \brief Decoded tiles read from files, shared by the filters which need them.
+ *
+ * TileMontage and TileMergeImageFilter given the same cache read each tile
+ * from its file only once, as long as the tiles fit into MemoryBudget.
+ * When the budget is exceeded, least recently used tiles are evicted first.
+ * Pinned tiles are never evicted, even if that exceeds the budget.
+ * TileMontage pins each tile from the start of the first of its pairs'
+ * registrations to the end of the last one, so tiles which are still needed
+ * are kept in preference to those which are finished.
+ *
+ * Tiles are identified by their file name and image type, so filters which read
+ * the same file with different pixel types have an entry each. The file's size
+ * and modification time are part of the identity, so a file overwritten under
+ * the same name is read again. Tiles are cached as read from the file,
+ * before adjustments such as forced spacing.
+ * Images returned by the cache share their pixels with it, and must not be modified.
+ *
+ * All the methods can be called concurrently from multiple threads.
+ *
+ * \ingroup Montage
+ */
+class Montage_EXPORT TileCache : public Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(TileCache);
+
+  /** Standard class type aliases. */
+  using Self = TileCache;
+  using Superclass = Object;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(TileCache, Object);
+
+  /** Set/Get the number of bytes of pixel data the unpinned tiles may occupy.
+   * Reducing it evicts tiles immediately. Default: 1 GiB. */
+  void
+  SetMemoryBudget(SizeValueType bytes);
+  SizeValueType
+  GetMemoryBudget() const;
+
+  /** Returns the cached image of the file, if its buffered region contains
+   * the region, and nullptr otherwise. An empty region matches any cached image,
+   * which is useful to obtain the metadata. */
+  template <typename TImage>
+  typename TImage::Pointer
+  GetImage(const std::string & fileName, const typename TImage::RegionType & region)
+  {
+    DataObject::Pointer entry = this->Find(this->MakeKey(fileName, typeid(TImage)));
+    auto *              image = dynamic_cast<TImage *>(entry.GetPointer());
+    if (image != nullptr && (region.GetNumberOfPixels() == 0 || image->GetBufferedRegion().IsInside(region)))
+    {
+      ++m_Hits;
+      return image;
+    }
+    ++m_Misses;
+    return nullptr;
+  }
+
+  /** Caches the image read from the file, replacing the previous entry of the same type. */
+  template <typename TImage>
+  void
+  AddImage(const std::string & fileName, TImage * image)
+  {
+    using ElementType = typename TImage::PixelContainer::Element;
+    const SizeValueType bytes = image->GetPixelContainer()->Size() * sizeof(ElementType);
+    this->Insert(this->MakeKey(fileName, typeid(TImage)), fileName, image, bytes);
+  }
+
+  /** Pinned tiles are not evicted. Pins of a file are counted,
+   * each Pin() must be matched by an Unpin(). */
+  void
+  Pin(const std::string & fileName);
+  void
+  Unpin(const std::string & fileName);
+
+  /** Evicts all the tiles, including the pinned ones, and resets the statistics.
+   * The pins are kept, so the files remain pinned until they are unpinned. */
+  void
+  Clear();
+
+  /** Number of bytes of pixel data currently cached. */
+  SizeValueType
+  GetSize() const;
+
+  /** Number of currently cached tiles. */
+  SizeValueType
+  GetNumberOfEntries() const;
+
+  /** Number of GetImage() calls which returned a cached image, and of those which did not. */
+  SizeValueType
+  GetHits() const
+  {
+    return m_Hits;
+  }
+  SizeValueType
+  GetMisses() const
+  {
+    return m_Misses;
+  }
+
+protected:
+  TileCache() = default;
+  ~TileCache() override = default;
+  void
+  PrintSelf(std::ostream & os, Indent indent) const override;
+
+  static std::string
+  MakeKey(const std::string & fileName, const std::type_info & imageType);
+
+  /** Returns the entry and marks it as the most recently used, or nullptr if there is none. */
+  DataObject::Pointer
+  Find(const std::string & key);
+
+  void
+  Insert(const std::string & key, const std::string & fileName, DataObject * image, SizeValueType bytes);
+
+  /** Evicts least recently used unpinned tiles until the budget is met. Expects m_Mutex to be locked. */
+  void
+  EvictOverBudget();
+
+  /** Accounts for the removal of an entry of the file. Expects m_Mutex to be locked. */
+  void
+  RemoveBytes(const std::string & fileName, SizeValueType bytes);
+
+private:
+  struct Entry
+  {
+    std::string         Key;
+    std::string         FileName;
+    DataObject::Pointer Image;
+    SizeValueType       Bytes;
+  };
+  using EntryList = std::list<Entry>; // the most recently used first
+
+  mutable std::mutex                                   m_Mutex;
+  SizeValueType                                        m_MemoryBudget = SizeValueType(1) << 30;
+  SizeValueType                                        m_Size = 0;
+  SizeValueType                                        m_PinnedSize = 0; // of the entries of pinned files
+  EntryList                                            m_Entries;
+  std::unordered_map<std::string, EntryList::iterator> m_Index;
+  std::unordered_map<std::string, unsigned>            m_Pins;
+  std::unordered_map<std::string, SizeValueType>       m_FileBytes; // of the entries of each file
+  std::atomic<SizeValueType>                           m_Hits{ 0 };
+  std::atomic<SizeValueType>                           m_Misses{ 0 };
+};
+} // namespace itk
+
+#endif // itkTileCache_h
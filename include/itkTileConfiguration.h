@@ -27,7 +27,10 @@
 
 #include "double-conversion/double-conversion.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <limits>
 #include <sstream>
@@ -150,64 +153,101 @@ struct ITK_TEMPLATE_EXPORT TileConfiguration
   static std::string
   TryParse(const std::string & pathToFile, unsigned & dimension)
   {
-    std::ifstream tileFile(pathToFile);
-    if (!tileFile)
+    const std::string contents = readFile(pathToFile);
+    if (isBinary(contents))
     {
-      throw std::runtime_error("Could not open for reading: " + pathToFile);
+      BinaryReader reader(contents, pathToFile);
+      reader.ReadHeader(dimension);
+      std::vector<SizeValueType> axisSizes(dimension);
+      for (unsigned d = 0; d < dimension; d++)
+      {
+        axisSizes[d] = reader.template Read<std::uint64_t>();
+      }
+      if (reader.template Read<std::uint64_t>() == 0)
+      {
+        return std::string();
+      }
+      for (unsigned d = 0; d < dimension; d++)
+      {
+        reader.template Read<double>();
+      }
+      return reader.ReadString();
     }
 
-    std::string temp = getNextNonCommentLine(tileFile);
-    if (temp.substr(0, 6) == "dim = ")
+    const char * pos = contents.data();
+    const char * end = pos + contents.size();
+    const char * lineBegin = pos;
+    const char * lineEnd = pos;
+    nextNonCommentLine(pos, end, lineBegin, lineEnd);
+    if (startsWith(lineBegin, lineEnd, "dim = "))
     {
-      dimension = std::stoul(temp.substr(6));
-      temp = TileConfiguration<Dimension>::getNextNonCommentLine(tileFile); // get next line
+      dimension = std::stoul(std::string(lineBegin + 6, lineEnd));
+      nextNonCommentLine(pos, end, lineBegin, lineEnd); // get next line
     }
 
     std::string     timePointID;
-    Tile<Dimension> tile = parseLine(temp, timePointID);
+    Tile<Dimension> tile = parseLine(lineBegin, lineEnd, timePointID);
     return tile.FileName;
   }
 
+  /** Reads the text format, or the binary format written by WriteBinary(). */
   void
   Parse(const std::string & pathToFile)
   {
-    std::ifstream tileFile(pathToFile);
-    if (!tileFile)
+    const std::string contents = readFile(pathToFile);
+    if (isBinary(contents))
     {
-      throw std::runtime_error("Could not open for reading: " + pathToFile);
+      this->ParseBinary(contents, pathToFile);
+      return;
     }
-    std::string line = getNextNonCommentLine(tileFile);
-    if (line.substr(0, 6) == "dim = ")
+
+    const char * pos = contents.data();
+    const char * end = pos + contents.size();
+    const char * lineBegin = pos;
+    const char * lineEnd = pos;
+    nextNonCommentLine(pos, end, lineBegin, lineEnd);
+    if (startsWith(lineBegin, lineEnd, "dim = "))
     {
-      unsigned dim = std::stoul(line.substr(6));
+      const std::string line(lineBegin, lineEnd);
+      unsigned          dim = std::stoul(line.substr(6));
       if (dim != Dimension)
       {
         throw std::runtime_error("Expected dimension " + std::to_string(Dimension) + ", but got " +
                                  std::to_string(dim) + " from string:\n\n" + line);
       }
-      line = TileConfiguration<Dimension>::getNextNonCommentLine(tileFile); // get next line
+      nextNonCommentLine(pos, end, lineBegin, lineEnd); // get next line
     }
 
-    AxisSizes.Fill(1);
+    // all the tiles are parsed in a single pass over the file's contents
     Tiles.clear();
+    std::string timePoint;
+    Tiles.push_back(parseLine(lineBegin, lineEnd, timePoint));
+    while (nextNonCommentLine(pos, end, lineBegin, lineEnd))
+    {
+      Tiles.push_back(parseLine(lineBegin, lineEnd, timePoint));
+    }
+    this->DetermineAxisSizes();
+  }
+
+  /** Determines AxisSizes from the order of tile positions, which are expected
+   * to be sorted by their last coordinate, then by the one before it etc. */
+  void
+  DetermineAxisSizes()
+  {
+    AxisSizes.Fill(1);
     TileIndexType cInd;
     cInd.Fill(0);
     unsigned initializedDimensions = 0; // no dimension has been initialized
 
-    std::string          timePoint;
-    itk::Tile<Dimension> tile = parseLine(line, timePoint);
-    Tiles.push_back(tile);
-    line = getNextNonCommentLine(tileFile);
-
-    while (tileFile)
+    for (size_t i = 1; i < Tiles.size(); i++)
     {
-      tile = parseLine(line, timePoint);
+      const TileND & tile = Tiles[i];
       // determine dominant axis change
       unsigned maxAxis = 0; // (0=x, 1=y, 2=z etc)
-      double   maxDiff = tile.Position[0] - Tiles.back().Position[0];
+      double   maxDiff = tile.Position[0] - Tiles[i - 1].Position[0];
       for (unsigned d = 1; d < Dimension; d++)
       {
-        double diff = tile.Position[d] - Tiles.back().Position[d];
+        double diff = tile.Position[d] - Tiles[i - 1].Position[d];
         if (diff > maxDiff)
         {
           maxDiff = diff;
@@ -245,9 +285,6 @@ struct ITK_TEMPLATE_EXPORT TileConfiguration
                               "Axis sizes: " << AxisSizes << ", but we reached index " << cInd[maxAxis]
                                              << ". Violation along axis " << maxAxis);
       }
-
-      Tiles.push_back(tile);
-      line = getNextNonCommentLine(tileFile);
     }
 
     for (unsigned d = 0; d < Dimension; ++d)
@@ -269,29 +306,70 @@ struct ITK_TEMPLATE_EXPORT TileConfiguration
       throw std::runtime_error("Could not open for writing: " + pathToFile);
     }
 
-    tileFile << "# Tile coordinates are in index space, not physical space\n";
-    tileFile << "dim = " << Dimension << "\n\n";
+    // composed in memory and written at once
+    std::string text = "# Tile coordinates are in index space, not physical space\n";
+    text += "dim = " + std::to_string(Dimension) + "\n\n";
     char                             buffer[25];
     double_conversion::StringBuilder conversionResult(buffer, 25);
 
     size_t totalTiles = this->LinearSize();
     for (SizeValueType linearIndex = 0; linearIndex < totalTiles; linearIndex++)
     {
-      tileFile << Tiles[linearIndex].FileName << ";;(";
+      text += Tiles[linearIndex].FileName;
+      text += ";;(";
 
       for (unsigned d = 0; d < Dimension; d++)
       {
         if (d > 0)
         {
-          tileFile << ", ";
+          text += ", ";
         }
 
         doubleConverter.ToShortest(Tiles[linearIndex].Position[d], &conversionResult);
-        tileFile << conversionResult.Finalize();
+        text += conversionResult.Finalize();
         conversionResult.Reset();
       }
-      tileFile << ')' << std::endl;
+      text += ")\n";
+    }
+    tileFile.write(text.data(), text.size());
+
+    if (!tileFile)
+    {
+      throw std::runtime_error("Writing not successful to: " + pathToFile);
+    }
+  }
+
+  /** Writes a compact binary file, which Parse() reads much faster than the text format.
+   * It holds axis sizes, exact positions and file names, in the byte order of this machine. */
+  void
+  WriteBinary(const std::string & pathToFile)
+  {
+    std::ofstream tileFile(pathToFile, std::ios::binary);
+    if (!tileFile)
+    {
+      throw std::runtime_error("Could not open for writing: " + pathToFile);
+    }
+
+    std::string data(binaryMagic, sizeof(binaryMagic));
+    auto        append = [&data](auto value) { data.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+    append(binaryByteOrderMark);
+    append(std::uint32_t(Dimension));
+    for (unsigned d = 0; d < Dimension; d++)
+    {
+      append(std::uint64_t(AxisSizes[d]));
+    }
+    const size_t totalTiles = this->LinearSize();
+    append(std::uint64_t(totalTiles));
+    for (size_t linearIndex = 0; linearIndex < totalTiles; linearIndex++)
+    {
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        append(double(Tiles[linearIndex].Position[d]));
+      }
+      append(std::uint32_t(Tiles[linearIndex].FileName.size()));
+      data += Tiles[linearIndex].FileName;
     }
+    tileFile.write(data.data(), data.size());
 
     if (!tileFile)
     {
@@ -302,59 +380,183 @@ struct ITK_TEMPLATE_EXPORT TileConfiguration
   static double_conversion::StringToDoubleConverter stringConverter;
   static double_conversion::DoubleToStringConverter doubleConverter;
 
+  static constexpr char          binaryMagic[8] = { 'I', 'T', 'K', 'T', 'C', 'F', 'G', '1' };
+  static constexpr std::uint32_t binaryByteOrderMark = 0x01020304;
+
   static std::string
-  getNextNonCommentLine(std::istream & in)
+  readFile(const std::string & pathToFile)
   {
-    std::string temp;
-    while (std::getline(in, temp))
+    std::ifstream tileFile(pathToFile, std::ios::binary | std::ios::ate);
+    if (!tileFile)
     {
-      if (temp.empty() || temp[0] == '#')
+      throw std::runtime_error("Could not open for reading: " + pathToFile);
+    }
+    std::string contents(static_cast<size_t>(tileFile.tellg()), '\0');
+    tileFile.seekg(0);
+    tileFile.read(&contents[0], contents.size());
+    if (!tileFile)
+    {
+      throw std::runtime_error("Could not read: " + pathToFile);
+    }
+    return contents;
+  }
+
+  static bool
+  isBinary(const std::string & contents)
+  {
+    return contents.compare(0, sizeof(binaryMagic), binaryMagic, sizeof(binaryMagic)) == 0;
+  }
+
+  // reads values from the contents of a binary file, with bounds checking
+  class BinaryReader
+  {
+  public:
+    BinaryReader(const std::string & contents, const std::string & pathToFile)
+      : m_Contents(contents)
+      , m_Path(pathToFile)
+    {}
+
+    template <typename T>
+    T
+    Read()
+    {
+      this->Require(sizeof(T));
+      T value;
+      std::memcpy(&value, m_Contents.data() + m_Position, sizeof(T));
+      m_Position += sizeof(T);
+      return value;
+    }
+
+    std::string
+    ReadString()
+    {
+      const std::uint32_t length = this->Read<std::uint32_t>();
+      this->Require(length);
+      std::string result = m_Contents.substr(m_Position, length);
+      m_Position += length;
+      return result;
+    }
+
+    void
+    ReadHeader(unsigned & dimension)
+    {
+      m_Position = sizeof(binaryMagic);
+      if (this->Read<std::uint32_t>() != binaryByteOrderMark)
       {
-        continue; // this is either an empty line or a comment
+        throw std::runtime_error("Byte order of this machine does not match the one of: " + m_Path);
       }
-      if (temp.size() == 1 && temp[0] == '\r')
+      dimension = this->Read<std::uint32_t>();
+    }
+
+  private:
+    void
+    Require(size_t size) const
+    {
+      if (m_Position + size > m_Contents.size())
       {
-        continue; // empty line ending in CRLF
+        throw std::runtime_error("Unexpected end of binary tile configuration: " + m_Path);
       }
-      if (temp[temp.size() - 1] == '\r')
+    }
+
+    const std::string & m_Contents;
+    const std::string & m_Path;
+    size_t              m_Position = 0;
+  };
+
+  void
+  ParseBinary(const std::string & contents, const std::string & pathToFile)
+  {
+    BinaryReader reader(contents, pathToFile);
+    unsigned     dim = 0;
+    reader.ReadHeader(dim);
+    if (dim != Dimension)
+    {
+      throw std::runtime_error("Expected dimension " + std::to_string(Dimension) + ", but got " +
+                               std::to_string(dim) + " from: " + pathToFile);
+    }
+    for (unsigned d = 0; d < Dimension; d++)
+    {
+      AxisSizes[d] = reader.template Read<std::uint64_t>();
+    }
+    const std::uint64_t totalTiles = reader.template Read<std::uint64_t>();
+    if (totalTiles != this->LinearSize())
+    {
+      throw std::runtime_error("Incorrect number of tiles in: " + pathToFile);
+    }
+    Tiles.resize(totalTiles);
+    for (TileND & tile : Tiles)
+    {
+      for (unsigned d = 0; d < Dimension; d++)
       {
-        temp.erase(temp.size() - 1, 1);
+        tile.Position[d] = reader.template Read<double>();
       }
-      break; // temp has interesting content
+      tile.FileName = reader.ReadString();
     }
-    return temp;
+  }
+
+  static bool
+  startsWith(const char * begin, const char * end, const char * prefix)
+  {
+    const size_t length = std::strlen(prefix);
+    return size_t(end - begin) >= length && std::memcmp(begin, prefix, length) == 0;
+  }
+
+  // finds the next line which is neither empty nor a comment, without its line ending
+  static bool
+  nextNonCommentLine(const char *& pos, const char * end, const char *& lineBegin, const char *& lineEnd)
+  {
+    while (pos < end)
+    {
+      lineBegin = pos;
+      lineEnd = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+      if (lineEnd == nullptr)
+      {
+        lineEnd = end;
+      }
+      pos = lineEnd + (lineEnd < end); // skip the newline
+      if (lineEnd > lineBegin && lineEnd[-1] == '\r')
+      {
+        --lineEnd;
+      }
+      if (lineEnd > lineBegin && *lineBegin != '#')
+      {
+        return true; // interesting content
+      }
+    }
+    lineBegin = end;
+    lineEnd = end;
+    return false;
   }
 
   static Tile<Dimension>
-  parseLine(const std::string line, std::string & timePointID)
+  parseLine(const char * begin, const char * end, std::string & timePointID)
   {
     itk::Tile<Dimension> tile;
-    std::stringstream    ss(line);
-    std::string          temp;
-
-    std::getline(ss, temp, ';');
-    tile.FileName = temp;
-    std::getline(ss, temp, ';');
+    const char *         fileNameEnd = std::find(begin, end, ';');
+    tile.FileName.assign(begin, fileNameEnd);
+    const char * timePointBegin = fileNameEnd + (fileNameEnd < end);
+    const char * timePointEnd = std::find(timePointBegin, end, ';');
     if (timePointID.empty())
     {
-      timePointID = temp;
+      timePointID.assign(timePointBegin, timePointEnd);
     }
     else
     {
-      itkAssertOrThrowMacro(temp == timePointID,
-                            "Only a single time point is supported. " << timePointID << " != " << temp);
+      itkAssertOrThrowMacro(timePointID.compare(0, std::string::npos, timePointBegin, timePointEnd - timePointBegin) ==
+                              0,
+                            "Only a single time point is supported. "
+                              << timePointID << " != " << std::string(timePointBegin, timePointEnd));
     }
-    std::getline(ss, temp, '(');
+    const char * pos = std::find(timePointEnd, end, '(');
+    pos += (pos < end);
 
-    using PointTypelocal = itk::Point<double, Dimension>;
-    PointTypelocal p;
     for (unsigned d = 0; d < Dimension; d++)
     {
-      std::getline(ss, temp, ',');
-      int processed = 0;
-      p[d] = stringConverter.StringToDouble(temp.c_str(), temp.length(), &processed);
+      const char * fieldEnd = std::find(pos, end, ',');
+      int          processed = 0;
+      tile.Position[d] = stringConverter.StringToDouble(pos, int(fieldEnd - pos), &processed);
+      pos = fieldEnd + (fieldEnd < end);
     }
-    tile.Position = p;
 
     return tile;
   }
@@ -24,6 +24,10 @@
 #include "itkLinearInterpolateImageFunction.h"
 #include "itkNumericTraits.h"
 
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
 namespace itk
 {
 /** \class TileMergeImageFilter
@@ -77,7 +81,7 @@ public:
   static constexpr unsigned int ImageDimension = ImageType::ImageDimension;
 
   /** This is envisioned to be the primary way of setting inputs.
-   * All required inputs are taken from TileMontage. Alternatively,
+   * All required inputs (and the tile cache, unless set) are taken from TileMontage. Alternatively,
    * inherited members can be called individually, e.g.:
    * SetMontageSize(), SetInputTile(), SetOriginAdjustment() etc. */
   void
@@ -176,6 +180,45 @@ public:
   itkGetMacro(CropToFill, bool);
   itkBooleanMacro(CropToFill);
 
+  /** Set/Get the number of resolution levels produced in a single pass. Default: 1.
+   * Level l is the output with index l (see GetOutput(idx)), downsampled by 2^l along
+   * each dimension: each of its pixels is the mean of a block of 2^D pixels of the
+   * previous level, less at the far edges of odd-sized levels. Level origins are
+   * the centers of their blocks. Requesting a region of any level generates the
+   * corresponding regions of all the levels, enlarged so that the blocks of the
+   * coarsest level are never split between requests, e.g. when streaming. */
+  void
+  SetNumberOfOutputLevels(unsigned levels);
+  itkGetConstMacro(NumberOfOutputLevels, unsigned);
+
+  /** Called for each completed chunk of each level, with a copy of its pixels
+   * whose buffered region is the chunk. The chunk is not retained by the filter.
+   * Calls come from a dedicated thread, one chunk after the other, while the following
+   * chunks are merged, so chunks can be compressed and written, e.g. into a chunked store,
+   * without holding up merging. The callback may use ITK's multi-threading itself. */
+  using ChunkCallbackType = std::function<void(unsigned level, const ImageType * chunk)>;
+
+  /** When a chunk callback is set, the requested region is merged in batches aligned
+   * to the chunks of the coarsest level, each batch is passed to the callback chunk by chunk,
+   * and the outputs only hold the last batch. Chunks are aligned to ChunkSize within each level,
+   * so they are complete except at the far edges of the mosaic. */
+  void
+  SetChunkCallback(ChunkCallbackType callback)
+  {
+    m_ChunkCallback = std::move(callback);
+    this->Modified();
+  }
+  const ChunkCallbackType &
+  GetChunkCallback() const
+  {
+    return m_ChunkCallback;
+  }
+
+  /** Set/Get the size of the chunks passed to the callback, in pixels of each level.
+   * Default: 256 along each dimension. */
+  itkSetMacro(ChunkSize, SizeType);
+  itkGetConstReferenceMacro(ChunkSize, SizeType);
+
 protected:
   TileMergeImageFilter();
   ~TileMergeImageFilter() override = default;
@@ -190,6 +233,51 @@ protected:
   void
   GenerateOutputInformation() override;
 
+  /** Any region of the output can be generated on its own,
+   * so the requested region is only cropped to the largest possible region.
+   * This allows the output to be streamed, e.g. by ImageFileWriter. */
+  void
+  EnlargeOutputRequestedRegion(DataObject * output) override;
+
+  /** Requested regions of all the levels cover the same part of the mosaic,
+   * aligned to the blocks of the coarsest level. */
+  void
+  GenerateOutputRequestedRegion(DataObject * output) override;
+
+  /** Sets the requested regions of all the levels from a region of the full-resolution level,
+   * enlarged to whole blocks, see GetLevelBlockSize(). */
+  void
+  RequestLevels(const RegionType & region);
+
+  /** Size of the full-resolution blocks which are never split between requests:
+   * the coarsest level's pixel, or its chunk when a chunk callback is set. */
+  SizeType
+  GetLevelBlockSize() const;
+
+  /** Merges the requested regions of all the levels into their buffers.
+   * Each tile is evicted after the last of its regions counted in m_PendingRegions,
+   * which are those of this request, unless countPendingRegions is false. */
+  void
+  MergeRequestedRegion(bool countPendingRegions = true);
+
+  /** The indices of the regions which intersect the region of the full-resolution level. */
+  std::vector<SizeValueType>
+  ScheduleRegions(const RegionType & region) const;
+
+  /** Adds the regions to the counts of the regions which need each of their tiles. */
+  void
+  CountPendingRegions(const std::vector<SizeValueType> & schedule);
+
+  /** Merges the requested region batch by batch, passing the chunks to the callback. */
+  void
+  GenerateChunks();
+
+  /** Requests from the in-memory input tiles only the part which
+   * maps into the requested region of the output (plus interpolation margin).
+   * Tiles given by filename are read on demand, see GetImage(). */
+  void
+  GenerateInputRequestedRegion() override;
+
   using Superclass::MakeOutput;
 
   /** Make a DataObject of the correct type to be used as the specified output. */
@@ -200,12 +288,58 @@ protected:
 
   /** If not already read, reads the image into memory.
    * Only the part which overlaps output image's requested region is read.
-   * If size of the wantedRegion is zero, only reads metadata. */
+   * The wantedRegion is in the index space of the tile, and must be in memory
+   * on return. If size of the wantedRegion is zero, only reads metadata. */
   ImageConstPointer
   GetImage(TileIndexType nDIndex, RegionType wantedRegion);
 
-  /** A set of linear indices of input tiles which contribute to this region. */
-  using ContributingTiles = std::set<SizeValueType>;
+  /** Maps a region of the output into the index space of the tile with the given linear index.
+   * The region is expanded by the interpolation margin and cropped to the tile's largest region.
+   * Returns false if the tile does not overlap the region. */
+  bool
+  OutputRegionToTileRegion(SizeValueType linearIndex, const RegionType & tileRegion, RegionType & region) const;
+
+  /** Frees the pixels of the tile, keeping its metadata. Caller must hold the tile's read lock. */
+  void
+  EvictTile(SizeValueType linearIndex);
+
+  /** Linear indices of input tiles which contribute to a region, in increasing order. */
+  using ContributingTiles = std::vector<SizeValueType>;
+
+  /** Contributors of a region, stored contiguously with those of the other regions. */
+  struct ContributorRange
+  {
+    const SizeValueType * m_Begin;
+    const SizeValueType * m_End;
+
+    const SizeValueType *
+    begin() const
+    {
+      return m_Begin;
+    }
+    const SizeValueType *
+    end() const
+    {
+      return m_End;
+    }
+    SizeValueType
+    size() const
+    {
+      return m_End - m_Begin;
+    }
+    bool
+    empty() const
+    {
+      return m_Begin == m_End;
+    }
+  };
+
+  ContributorRange
+  GetRegionContributors(SizeValueType regionIndex) const
+  {
+    const SizeValueType * tiles = m_Contributors.data();
+    return { tiles + m_ContributorOffsets[regionIndex], tiles + m_ContributorOffsets[regionIndex + 1] };
+  }
 
   void
   SplitRegionAndCopyContributions(std::vector<RegionType> &        regions,
@@ -214,6 +348,13 @@ protected:
                                   size_t                           oldRegionIndex,
                                   SizeValueType                    tileIndex);
 
+  /** Splits the total region into m_Regions, such that all the pixels of a region
+   * are covered by the same input tiles. The regions are found through a uniform
+   * grid of buckets with cells as large as the largest tile, so each tile is only
+   * tested against the regions in the few buckets which it overlaps. */
+  void
+  PartitionRegion(const RegionType & totalRegion, std::vector<ContributingTiles> & regionContributors);
+
   /** The region will be inside of the rectangle given by min and max indices.
    * The min is rounded up, while the max is rounded down. */
   RegionType
@@ -223,25 +364,86 @@ protected:
   SizeValueType
   DistanceFromEdge(ImageIndexType index, RegionType region);
 
+  /** Position of the tile along a Hilbert curve through the montage,
+   * so tiles with close keys are also close to each other in the mosaic. */
+  std::uint64_t
+  HilbertKey(TileIndexType nDIndex) const;
+
+  /** Component types, so multi-component pixels (e.g. RGB) can be blended one component at a time. */
+  using PixelComponentType = typename NumericTraits<PixelType>::ValueType;
+  using AccumulateComponentType = typename NumericTraits<TPixelAccumulateType>::ValueType;
+  static constexpr unsigned PixelComponents = sizeof(PixelType) / sizeof(PixelComponentType);
+
+  /** Blends a scanline of overlapping tiles into the output, weighting each tile's
+   * pixels by the given distances from its edge. VTiles is the number of tiles
+   * if it is known at compile time, and zero otherwise, in which case nTiles is used.
+   * The sums and distances are scratch arrays of the same size as the output. */
+  template <unsigned VTiles, typename TInputComponent>
+  static void
+  BlendScanline(unsigned                        nTiles,
+                const TInputComponent * const * inputs,
+                const SizeValueType * const *   weights,
+                SizeValueType                   length,
+                AccumulateComponentType *       sums,
+                SizeValueType *                 distances,
+                PixelComponentType *            output);
+
+  /** Interpolated pixel type, and its component type. */
+  using InterpolatorOutputType = typename TInterpolator::OutputType;
+  using RealComponentType = typename NumericTraits<InterpolatorOutputType>::ValueType;
+
+  /** Difference between continuous indices of a tile and of the output. */
+  using IndexDifferenceType = Vector<typename ContinuousIndexType::ValueType, ImageDimension>;
+
+  /** Linear interpolation of a tile which is only translated with respect to the output
+   * uses the same weights for all the pixels, which allows a faster implementation. */
+  static constexpr bool IsLinearInterpolator =
+    std::is_same<TInterpolator, LinearInterpolateImageFunction<ImageType, typename TInterpolator::CoordRepType>>::value;
+
+  /** Linearly interpolates a scanline of the input, starting at the given output index,
+   * into values (PixelComponents per pixel). The input's continuous index is the output
+   * index plus the difference. Equivalent to evaluating a LinearInterpolateImageFunction
+   * at every pixel, but the weights and the neighbors' offsets are computed only once. */
+  static void
+  InterpolateScanline(const ImageType *           input,
+                      const ImageIndexType &      lineIndex,
+                      SizeValueType               length,
+                      const IndexDifferenceType & difference,
+                      RealComponentType *         values);
+
   /** Resamples a single region into m_SingleImage.
    * This method does not access other regions,
    * and can be run in parallel with other indices. */
   void
   ResampleSingleRegion(SizeValueType regionIndex);
 
+  /** Computes the requested region of a level by downsampling the previous level. */
+  void
+  DownsampleLevel(unsigned level);
+
 private:
   bool      m_CropToFill = false;       // crop to avoid background filling?
   PixelType m_Background = PixelType(); // default background value (not covered by any input tile)
+  unsigned  m_NumberOfOutputLevels = 1; // resolution levels, each downsampled by 2 from the previous one
+
+  ChunkCallbackType m_ChunkCallback;
+  SizeType          m_ChunkSize = SizeType::Filled(256);
 
   std::vector<TransformConstPointer> m_Transforms;
   std::vector<ImagePointer>         m_Tiles; // metadata/image storage (if filenames are given instead of actual images)
   typename Superclass::ConstPointer m_Montage;
   std::vector<RegionType>           m_InputMappings;           // where do input tile regions map into the output
   std::vector<ContinuousIndexType>  m_InputsContinuousIndices; // where do input tile region indices map into the output
+  std::vector<OffsetType>           m_OutputToTileOffsets;     // from output indices to input tile indices
   std::vector<RegionType>           m_Regions;                 // regions which completely cover the output,
                                                                // grouped by the set of contributing input tiles
-  std::vector<ContributingTiles> m_RegionContributors; // set of input tiles which contribute to corresponding regions
-};                                                     // class TileMergeImageFilter
+                                                               // and sorted by index along the last dimension
+  std::vector<SizeValueType>  m_ContributorOffsets; // contributors of region r are at [offsets[r], offsets[r + 1])
+  std::vector<SizeValueType>  m_Contributors;       // input tiles which contribute to the regions, region by region
+  std::vector<IndexValueType> m_RegionMaxEnds;      // running maximum of regions' ends along the last dimension
+  std::vector<SizeValueType>  m_PendingRegions;     // regions of the current request (or batches) which need the tile
+  std::vector<std::uint64_t>  m_RegionOrderKeys;    // Hilbert keys of regions' first contributors, see GenerateData()
+};                                                  // class TileMergeImageFilter
 
 } // namespace itk
 
@@ -20,12 +20,23 @@
 #define itkTileMergeImageFilter_hxx
 
 
+#include "itkImageScanlineIterator.h"
 #include "itkMultiThreaderBase.h"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <utility>
 
 namespace itk
 {
@@ -45,6 +56,9 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::PrintSelf
   Superclass::PrintSelf(os, indent);
   os << indent << "CropToFill: " << (m_CropToFill ? "Yes" : "No") << std::endl;
   os << indent << "Background: " << m_Background << std::endl;
+  os << indent << "NumberOfOutputLevels: " << m_NumberOfOutputLevels << std::endl;
+  os << indent << "ChunkCallback: " << (m_ChunkCallback ? "Set" : "None") << std::endl;
+  os << indent << "ChunkSize: " << m_ChunkSize << std::endl;
   os << indent << "RegionsSize: " << m_Regions.size() << std::endl;
 
   auto nullCount = std::count(m_Transforms.begin(), m_Transforms.end(), nullptr);
@@ -70,6 +84,11 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::SetMontag
     this->m_FinishedPairs.store(montage->m_FinishedPairs);
     this->m_OriginAdjustment = montage->m_OriginAdjustment;
     this->m_ForcedSpacing = montage->m_ForcedSpacing;
+    this->m_MemoryMapTiles = montage->m_MemoryMapTiles;
+    if (this->m_TileCache.IsNull())
+    {
+      this->m_TileCache = montage->m_TileCache; // so the tiles read during registration are not read again
+    }
 
     for (SizeValueType i = 0; i < this->m_LinearMontageSize; i++)
     {
@@ -128,7 +147,30 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::SetMontag
   Superclass::SetMontageSize(montageSize);
   m_Transforms.resize(this->m_LinearMontageSize);
   m_Tiles.resize(this->m_LinearMontageSize);
-  this->SetNumberOfRequiredOutputs(1);
+  m_PendingRegions.resize(this->m_LinearMontageSize);
+  this->SetNumberOfRequiredOutputs(m_NumberOfOutputLevels);
+  this->SetNumberOfIndexedOutputs(m_NumberOfOutputLevels); // our outputs are levels, not transforms
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::SetNumberOfOutputLevels(unsigned levels)
+{
+  levels = std::max(levels, 1u);
+  if (m_NumberOfOutputLevels != levels)
+  {
+    m_NumberOfOutputLevels = levels;
+    this->SetNumberOfRequiredOutputs(levels);
+    this->SetNumberOfIndexedOutputs(levels);
+    for (unsigned level = 1; level < levels; level++)
+    {
+      if (this->ProcessObject::GetOutput(level) == nullptr)
+      {
+        this->SetNthOutput(level, this->MakeOutput(level).GetPointer());
+      }
+    }
+    this->Modified();
+  }
 }
 
 template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
@@ -191,7 +233,127 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::SplitRegi
       regionContributors.push_back(regionContributors[oldRegionIndex]);
     }
   }
-  regionContributors[oldRegionIndex].insert(tileIndex);
+  regionContributors[oldRegionIndex].push_back(tileIndex); // tiles are added in increasing order
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::PartitionRegion(
+  const RegionType &               totalRegion,
+  std::vector<ContributingTiles> & regionContributors)
+{
+  SizeType cellSize;
+  SizeType cellCount;
+  cellSize.Fill(1);
+  for (const RegionType & mapping : m_InputMappings)
+  {
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      cellSize[d] = std::max(cellSize[d], mapping.GetSize(d));
+    }
+  }
+  SizeValueType bucketCount = 1;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    cellCount[d] = std::max<SizeValueType>(1, (totalRegion.GetSize(d) + cellSize[d] - 1) / cellSize[d]);
+    bucketCount *= cellCount[d];
+  }
+  std::vector<std::vector<SizeValueType>> buckets(bucketCount); // indices of the regions which overlap the cell
+
+  // calls f with the linear index of each bucket whose cell overlaps the region
+  auto forEachBucket = [&](const RegionType & region, auto f) {
+    ImageIndexType first;
+    ImageIndexType last;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      IndexValueType begin = region.GetIndex(d) - totalRegion.GetIndex(d);
+      IndexValueType end = begin + IndexValueType(region.GetSize(d));
+      begin = std::max<IndexValueType>(begin, 0);
+      end = std::min<IndexValueType>(end, totalRegion.GetSize(d));
+      if (begin >= end)
+      {
+        return; // no overlap with the total region
+      }
+      first[d] = begin / IndexValueType(cellSize[d]);
+      last[d] = (end - 1) / IndexValueType(cellSize[d]);
+    }
+    ImageIndexType cell = first;
+    while (true)
+    {
+      SizeValueType linearIndex = 0;
+      for (int d = ImageDimension - 1; d >= 0; d--)
+      {
+        linearIndex = linearIndex * cellCount[d] + cell[d];
+      }
+      f(linearIndex);
+
+      unsigned d = 0;
+      for (; d < ImageDimension && cell[d] == last[d]; d++)
+      {
+        cell[d] = first[d];
+      }
+      if (d == ImageDimension)
+      {
+        return;
+      }
+      ++cell[d];
+    }
+  };
+
+  std::vector<SizeValueType> lastVisitor; // one more than the index of the last tile which tested the region
+  auto                       addRegions = [&](SizeValueType begin) {
+    lastVisitor.resize(m_Regions.size(), 0);
+    for (SizeValueType r = begin; r < m_Regions.size(); r++)
+    {
+      forEachBucket(m_Regions[r], [&buckets, r](SizeValueType b) { buckets[b].push_back(r); });
+    }
+  };
+
+  m_Regions.push_back(totalRegion);
+  regionContributors.emplace_back(); // we start with an empty set
+  addRegions(0);
+  std::vector<SizeValueType> candidates;
+  std::vector<SizeValueType> roIndices;
+  for (SizeValueType i = 0; i < this->m_LinearMontageSize; i++)
+  {
+    // the regions which the tile overlaps are in the buckets it overlaps,
+    // split regions keep their buckets, which are a superset of the buckets they overlap
+    candidates.clear();
+    forEachBucket(m_InputMappings[i], [&](SizeValueType b) {
+      for (SizeValueType r : buckets[b])
+      {
+        if (lastVisitor[r] != i + 1)
+        {
+          lastVisitor[r] = i + 1;
+          candidates.push_back(r);
+        }
+      }
+    });
+    std::sort(candidates.begin(), candidates.end());
+
+    roIndices.clear();
+    for (SizeValueType r : candidates)
+    {
+      if (m_InputMappings[i].IsInside(m_Regions[r]))
+      {
+        regionContributors[r].push_back(i);
+      }
+      else
+      {
+        RegionType testR = m_InputMappings[i];
+        if (testR.Crop(m_Regions[r]))
+        {
+          roIndices.push_back(r);
+        }
+      }
+    }
+    for (SizeValueType roIndex : roIndices)
+    {
+      const SizeValueType oldSize = m_Regions.size();
+      this->SplitRegionAndCopyContributions(m_Regions, regionContributors, m_InputMappings[i], roIndex, i);
+      addRegions(oldSize); // remnants outside of this tile
+    }
+  }
 }
 
 template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
@@ -227,6 +389,67 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::DistanceF
   return 1 + dist;
 }
 
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+std::uint64_t
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::HilbertKey(TileIndexType nDIndex) const
+{
+  unsigned bits = 1;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    while (bits < 64 / ImageDimension && (SizeValueType(1) << bits) < this->m_MontageSize[d])
+    {
+      ++bits;
+    }
+  }
+
+  // John Skilling, "Programming the Hilbert curve", AIP Conference Proceedings 707, 381 (2004)
+  std::uint64_t x[ImageDimension];
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    x[d] = nDIndex[d];
+  }
+  const std::uint64_t m = std::uint64_t(1) << (bits - 1);
+  for (std::uint64_t q = m; q > 1; q >>= 1) // inverse undo
+  {
+    const std::uint64_t p = q - 1;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      if (x[d] & q)
+      {
+        x[0] ^= p; // invert
+      }
+      else
+      {
+        const std::uint64_t t = (x[0] ^ x[d]) & p; // exchange
+        x[0] ^= t;
+        x[d] ^= t;
+      }
+    }
+  }
+  for (unsigned d = 1; d < ImageDimension; d++) // Gray encode
+  {
+    x[d] ^= x[d - 1];
+  }
+  std::uint64_t t = 0;
+  for (std::uint64_t q = m; q > 1; q >>= 1)
+  {
+    if (x[ImageDimension - 1] & q)
+    {
+      t ^= q - 1;
+    }
+  }
+
+  std::uint64_t key = 0; // interleave the bits of the transposed index
+  for (int b = bits - 1; b >= 0; b--)
+  {
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      key = (key << 1) | (((x[d] ^ t) >> b) & 1);
+    }
+  }
+  return key;
+}
+
 
 template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
 typename TImageType::ConstPointer
@@ -234,29 +457,72 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GetImage(
                                                                                 RegionType    wantedRegion)
 {
   SizeValueType linearIndex = this->nDIndexToLinearIndex(nDIndex);
+  RegionType    reg0;
 
-  ImagePointer                outputImage = this->GetOutput();
-  RegionType                  reqR = outputImage->GetRequestedRegion();
   std::lock_guard<std::mutex> lockGuard(this->m_TileReadLocks[linearIndex]);
+  bool                        onlyMetadata = (wantedRegion.GetNumberOfPixels() == 0);
   if (m_Tiles[linearIndex].IsNotNull())
   {
-    RegionType r = m_Tiles[linearIndex]->GetBufferedRegion();
-    if (r.Crop(reqR) && r.IsInside(wantedRegion))
+    if (onlyMetadata || m_Tiles[linearIndex]->GetBufferedRegion().IsInside(wantedRegion))
     {
       return m_Tiles[linearIndex];
     }
   }
 
-  bool onlyMetadata = (wantedRegion.GetNumberOfPixels() == 0);
-  m_Tiles[linearIndex] = Superclass::template GetImageHelper<ImageType>(nDIndex, onlyMetadata, reqR);
+  RegionType regionToRead = wantedRegion;
+  if (!onlyMetadata && m_Tiles[linearIndex].IsNotNull() && linearIndex < m_InputMappings.size())
+  {
+    // read the part needed by the whole requested region of the output,
+    // so the other output regions of this request find it in memory
+    RegionType requested = this->GetOutput()->GetRequestedRegion();
+    if (this->OutputRegionToTileRegion(linearIndex, m_Tiles[linearIndex]->GetLargestPossibleRegion(), requested) &&
+        requested.IsInside(wantedRegion))
+    {
+      regionToRead = requested;
+    }
+  }
+
+  m_Tiles[linearIndex] =
+    Superclass::template GetImageHelper<ImageType>(nDIndex, onlyMetadata, onlyMetadata ? reg0 : regionToRead);
   return m_Tiles[linearIndex];
 }
 
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+bool
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::OutputRegionToTileRegion(
+  SizeValueType      linearIndex,
+  const RegionType & tileRegion,
+  RegionType &       region) const
+{
+  region.PadByRadius(1); // interpolation also accesses the neighboring pixels
+  if (!region.Crop(m_InputMappings[linearIndex]))
+  {
+    return false;
+  }
+  const OffsetType outputToTile = tileRegion.GetIndex() - m_InputMappings[linearIndex].GetIndex();
+  region.SetIndex(region.GetIndex() + outputToTile);
+  return true;
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::EvictTile(SizeValueType linearIndex)
+{
+  if (m_Tiles[linearIndex].IsNotNull())
+  {
+    // a new image, because the pixel container might be shared with an input tile
+    ImagePointer metadata = ImageType::New();
+    metadata->CopyInformation(m_Tiles[linearIndex]);
+    m_Tiles[linearIndex] = metadata;
+  }
+}
+
 template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
 void
 TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateOutputInformation()
 {
-  Superclass::GenerateOutputInformation();
+  // the superclass would make an output per tile
+  ProcessObject::GenerateOutputInformation();
 
   TileIndexType     nDIndex0 = { 0 };
   RegionType        reg0;
@@ -284,8 +550,10 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateO
   // clean up internal variables
   m_InputMappings.clear();
   m_InputsContinuousIndices.clear();
+  m_OutputToTileOffsets.clear();
   m_Regions.clear();
-  m_RegionContributors.clear();
+  m_ContributorOffsets.clear();
+  m_Contributors.clear();
 
   ImagePointer outputImage = this->GetOutput();
   outputImage->CopyInformation(input0); // origin, spacing, direction
@@ -301,10 +569,31 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateO
     totalRegion = this->ConstructRegion(this->m_MinOuter, this->m_MaxOuter);
   }
   outputImage->SetRegions(totalRegion);
+  for (unsigned level = 1; level < m_NumberOfOutputLevels; level++)
+  {
+    const SizeValueType                     factor = SizeValueType(1) << level;
+    ContinuousIndex<double, ImageDimension> blockCenter;
+    RegionType                              levelRegion;
+    SpacingType                             spacing = outputImage->GetSpacing();
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      blockCenter[d] = totalRegion.GetIndex(d) + (factor - 1) / 2.0;
+      levelRegion.SetSize(d, (totalRegion.GetSize(d) + factor - 1) / factor);
+      spacing[d] *= factor;
+    }
+    typename ImageType::PointType origin;
+    outputImage->TransformContinuousIndexToPhysicalPoint(blockCenter, origin);
+    ImageType * levelImage = this->GetOutput(level);
+    levelImage->CopyInformation(outputImage);
+    levelImage->SetSpacing(spacing);
+    levelImage->SetOrigin(origin);
+    levelImage->SetRegions(levelRegion);
+  }
 
   // determine where does each input tile map into the output image
   m_InputMappings.resize(this->m_LinearMontageSize);
   m_InputsContinuousIndices.resize(this->m_LinearMontageSize);
+  m_OutputToTileOffsets.resize(this->m_LinearMontageSize);
   for (SizeValueType i = 0; i < this->m_LinearMontageSize; i++)
   {
     TransformPointer inverseT = TransformType::New();
@@ -328,48 +617,429 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateO
     for (unsigned d = 0; d < ImageDimension; d++)
     {
       reg.SetIndex(d, reg.GetIndex(d) + ind[d]);
+      m_OutputToTileOffsets[i][d] = -ind[d];
     }
     m_InputMappings[i] = reg;
   }
 
   // now we split the totalRegion into pieces which have contributions
   // by the same input tiles
-  m_Regions.push_back(totalRegion);
-  m_RegionContributors.emplace_back(); // we start with an empty set
+  std::vector<ContributingTiles> regionContributors;
+  this->PartitionRegion(totalRegion, regionContributors);
+
+  // sort the regions along the slowest dimension, so that a request for
+  // a stripe of the output only visits the regions which intersect it
+  constexpr unsigned  lastDim = ImageDimension - 1;
+  std::vector<size_t> order(m_Regions.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return m_Regions[a].GetIndex(lastDim) < m_Regions[b].GetIndex(lastDim);
+  });
+  std::vector<RegionType> sortedRegions(m_Regions.size());
+  m_RegionMaxEnds.resize(m_Regions.size());
+  m_ContributorOffsets.resize(m_Regions.size() + 1);
+  m_ContributorOffsets[0] = 0;
+  IndexValueType maxEnd = NumericTraits<IndexValueType>::NonpositiveMin();
+  for (size_t r = 0; r < order.size(); r++)
+  {
+    sortedRegions[r] = m_Regions[order[r]];
+    maxEnd = std::max(maxEnd, sortedRegions[r].GetIndex(lastDim) + IndexValueType(sortedRegions[r].GetSize(lastDim)));
+    m_RegionMaxEnds[r] = maxEnd;
+    m_ContributorOffsets[r + 1] = m_ContributorOffsets[r] + regionContributors[order[r]].size();
+  }
+  m_Regions.swap(sortedRegions);
+
+  // contributors of all the regions are stored in a single array, in the order of the regions
+  m_Contributors.resize(m_ContributorOffsets.back());
+  for (size_t r = 0; r < order.size(); r++)
+  {
+    const ContributingTiles & tiles = regionContributors[order[r]];
+    std::copy(tiles.begin(), tiles.end(), m_Contributors.begin() + m_ContributorOffsets[r]);
+  }
+
+  // regions not covered by any tile are the cheapest, so they are scheduled last
+  m_RegionOrderKeys.resize(m_Regions.size());
+  for (size_t r = 0; r < m_Regions.size(); r++)
+  {
+    const ContributorRange contributors = this->GetRegionContributors(r);
+    m_RegionOrderKeys[r] = contributors.empty() ? NumericTraits<std::uint64_t>::max()
+                                                : this->HilbertKey(this->LinearIndexTonDIndex(*contributors.begin()));
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::EnlargeOutputRequestedRegion(DataObject * output)
+{
+  Superclass::EnlargeOutputRequestedRegion(output);
+  auto * outputImage = dynamic_cast<ImageType *>(output);
+  if (outputImage)
+  {
+    RegionType reqR = outputImage->GetRequestedRegion();
+    if (reqR.Crop(outputImage->GetLargestPossibleRegion()))
+    {
+      outputImage->SetRequestedRegion(reqR);
+    }
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateOutputRequestedRegion(
+  DataObject * output)
+{
+  unsigned requestedLevel = 0;
+  while (requestedLevel < m_NumberOfOutputLevels && this->ProcessObject::GetOutput(requestedLevel) != output)
+  {
+    ++requestedLevel;
+  }
+  if (requestedLevel == m_NumberOfOutputLevels)
+  {
+    Superclass::GenerateOutputRequestedRegion(output);
+    return;
+  }
+
+  // the requested part of the mosaic, in the index space of the full-resolution level
+  const RegionType     fullRegion = this->GetOutput()->GetLargestPossibleRegion();
+  const RegionType     requested = this->GetOutput(requestedLevel)->GetRequestedRegion();
+  const RegionType     requestedLargest = this->GetOutput(requestedLevel)->GetLargestPossibleRegion();
+  const IndexValueType scale = IndexValueType(1) << requestedLevel;
+  RegionType           region;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    region.SetIndex(d, fullRegion.GetIndex(d) + (requested.GetIndex(d) - requestedLargest.GetIndex(d)) * scale);
+    region.SetSize(d, requested.GetSize(d) * scale);
+  }
+  this->RequestLevels(region);
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::RequestLevels(const RegionType & region)
+{
+  const RegionType fullRegion = this->GetOutput()->GetLargestPossibleRegion();
+  const SizeType   blockSize = this->GetLevelBlockSize();
+  IndexValueType   begin[ImageDimension]; // relative to the start of the full-resolution level
+  IndexValueType   end[ImageDimension];
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    const IndexValueType fullSize = fullRegion.GetSize(d);
+    const IndexValueType block = blockSize[d];
+    const IndexValueType start = region.GetIndex(d) - fullRegion.GetIndex(d);
+    begin[d] = std::clamp<IndexValueType>(start, 0, fullSize);
+    end[d] = std::clamp<IndexValueType>(start + IndexValueType(region.GetSize(d)), begin[d], fullSize);
+    begin[d] = begin[d] / block * block;
+    end[d] = std::min((end[d] + block - 1) / block * block, fullSize);
+  }
+
+  for (unsigned level = 0; level < m_NumberOfOutputLevels; level++)
+  {
+    ImageType *          levelImage = this->GetOutput(level);
+    const RegionType     largest = levelImage->GetLargestPossibleRegion();
+    const IndexValueType factor = IndexValueType(1) << level;
+    RegionType           levelRegion;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      const IndexValueType levelBegin = begin[d] / factor;
+      const IndexValueType levelEnd = std::min<IndexValueType>((end[d] + factor - 1) / factor, largest.GetSize(d));
+      levelRegion.SetIndex(d, largest.GetIndex(d) + levelBegin);
+      levelRegion.SetSize(d, levelEnd - levelBegin);
+    }
+    levelImage->SetRequestedRegion(levelRegion);
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+auto
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GetLevelBlockSize() const -> SizeType
+{
+  SizeType blockSize;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    blockSize[d] = (m_ChunkCallback ? std::max<SizeValueType>(m_ChunkSize[d], 1) : 1) << (m_NumberOfOutputLevels - 1);
+  }
+  return blockSize;
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateInputRequestedRegion()
+{
+  const RegionType reqR = this->GetOutput()->GetRequestedRegion();
   for (SizeValueType i = 0; i < this->m_LinearMontageSize; i++)
   {
-    // first determine the region indices which the newRegion overlaps
-    std::vector<size_t> roIndices;
-    for (unsigned r = 0; r < m_Regions.size(); r++)
+    auto * input = dynamic_cast<ImageType *>(this->ProcessObject::GetInput(i));
+    if (input == nullptr || std::equal_to<const void *>{}(input, this->m_Dummy.GetPointer()))
     {
-      if (m_InputMappings[i].IsInside(m_Regions[r]))
+      continue; // tile will be read from file
+    }
+
+    RegionType tileRegion = reqR;
+    if (!this->OutputRegionToTileRegion(i, input->GetLargestPossibleRegion(), tileRegion))
+    {
+      // this tile does not contribute to the requested region
+      tileRegion.SetIndex(input->GetLargestPossibleRegion().GetIndex());
+      tileRegion.SetSize(SizeType::Filled(0));
+    }
+    input->SetRequestedRegion(tileRegion);
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateData()
+{
+  if (m_ChunkCallback)
+  {
+    this->GenerateChunks();
+  }
+  else
+  {
+    this->MergeRequestedRegion();
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateChunks()
+{
+  const RegionType requested = this->GetOutput()->GetRequestedRegion();
+  const RegionType fullRegion = this->GetOutput()->GetLargestPossibleRegion();
+  const SizeType   batchSize = this->GetLevelBlockSize();
+  ImageIndexType   firstBatch;
+  ImageIndexType   lastBatch;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    if (requested.GetSize(d) == 0)
+    {
+      return; // nothing requested
+    }
+    const IndexValueType start = requested.GetIndex(d) - fullRegion.GetIndex(d);
+    firstBatch[d] = start / IndexValueType(batchSize[d]);
+    lastBatch[d] = (start + IndexValueType(requested.GetSize(d)) - 1) / IndexValueType(batchSize[d]);
+  }
+  auto requestBatch = [&](const ImageIndexType & batchIndex) {
+    RegionType batch;
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      batch.SetIndex(d, fullRegion.GetIndex(d) + batchIndex[d] * IndexValueType(batchSize[d]));
+      batch.SetSize(d, batchSize[d]);
+    }
+    batch.Crop(requested);
+    this->RequestLevels(batch);
+  };
+  auto nextBatch = [&firstBatch, &lastBatch](ImageIndexType & batchIndex) { // the first dimension is the fastest
+    unsigned d = 0;
+    for (; d < ImageDimension && batchIndex[d] == lastBatch[d]; d++)
+    {
+      batchIndex[d] = firstBatch[d];
+    }
+    if (d == ImageDimension)
+    {
+      return false;
+    }
+    ++batchIndex[d];
+    return true;
+  };
+
+  // tiles which straddle batches are kept until the last batch which needs them
+  std::fill(m_PendingRegions.begin(), m_PendingRegions.end(), 0);
+  ImageIndexType batchIndex = firstBatch;
+  do
+  {
+    requestBatch(batchIndex);
+    this->CountPendingRegions(this->ScheduleRegions(this->GetOutput()->GetRequestedRegion()));
+  } while (nextBatch(batchIndex));
+
+  // the callback runs on a dedicated thread, chunk after chunk, while the following batches are merged.
+  // At most a batch of chunks waits for it, so merging does not get far ahead of the callback.
+  SizeValueType maximumPending = 0;
+  for (unsigned level = 0; level < m_NumberOfOutputLevels; level++)
+  {
+    maximumPending += SizeValueType(1) << ((m_NumberOfOutputLevels - 1 - level) * ImageDimension);
+  }
+  std::mutex                                    queueMutex;
+  std::condition_variable                       queueCondition;
+  std::deque<std::pair<unsigned, ImagePointer>> queue; // level and chunk
+  bool                                          merged = false; // no more chunks will be queued
+  std::exception_ptr                            failure = nullptr;
+  std::thread                                   callbackThread([&]() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true)
+    {
+      queueCondition.wait(lock, [&]() { return !queue.empty() || merged; });
+      if (queue.empty())
       {
-        m_RegionContributors[r].insert(i);
+        return;
       }
-      else
+      const std::pair<unsigned, ImagePointer> item = std::move(queue.front());
+      queue.pop_front();
+      lock.unlock();
+      queueCondition.notify_all();
+      std::exception_ptr error = nullptr;
+      try
       {
-        RegionType testR = m_InputMappings[i];
-        if (testR.Crop(m_Regions[r]))
+        m_ChunkCallback(item.first, item.second.GetPointer());
+      }
+      catch (...)
+      {
+        error = std::current_exception();
+      }
+      lock.lock();
+      if (error)
+      {
+        failure = error;
+        queue.clear();
+        queueCondition.notify_all();
+        return;
+      }
+    }
+  });
+  auto failed = [&]() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return failure != nullptr;
+  };
+  auto finishCallbacks = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      merged = true;
+    }
+    queueCondition.notify_all();
+    callbackThread.join();
+    for (SizeValueType tile = 0; tile < this->m_LinearMontageSize; tile++)
+    {
+      if (m_PendingRegions[tile] > 0) // the batches which were not merged because of an error
+      {
+        this->EvictTile(tile);
+      }
+    }
+  };
+
+  try
+  {
+    batchIndex = firstBatch;
+    do
+    {
+      requestBatch(batchIndex);
+      this->MergeRequestedRegion(false);
+
+      for (unsigned level = 0; level < m_NumberOfOutputLevels && !failed(); level++)
+      {
+        const ImageType * levelImage = this->GetOutput(level);
+        const RegionType  levelRegion = levelImage->GetBufferedRegion();
+        const RegionType  largest = levelImage->GetLargestPossibleRegion();
+        RegionType        chunkGrid; // indices of the chunks within the level's region
+        for (unsigned d = 0; d < ImageDimension; d++)
         {
-          roIndices.push_back(r);
+          const IndexValueType chunkSize = std::max<SizeValueType>(m_ChunkSize[d], 1);
+          const IndexValueType start = levelRegion.GetIndex(d) - largest.GetIndex(d);
+          const IndexValueType end = start + IndexValueType(levelRegion.GetSize(d));
+          chunkGrid.SetIndex(d, start / chunkSize);
+          chunkGrid.SetSize(d, end > start ? (end - 1) / chunkSize + 1 - start / chunkSize : 0);
+        }
+        for (SizeValueType c = 0; c < chunkGrid.GetNumberOfPixels(); c++)
+        {
+          RegionType    chunkRegion;
+          SizeValueType remainder = c;
+          for (unsigned d = 0; d < ImageDimension; d++)
+          {
+            const IndexValueType chunkSize = std::max<SizeValueType>(m_ChunkSize[d], 1);
+            const IndexValueType chunkIndex = chunkGrid.GetIndex(d) + remainder % chunkGrid.GetSize(d);
+            chunkRegion.SetIndex(d, largest.GetIndex(d) + chunkIndex * chunkSize);
+            chunkRegion.SetSize(d, chunkSize);
+            remainder /= chunkGrid.GetSize(d);
+          }
+          chunkRegion.Crop(levelRegion);
+
+          // a copy, so the callback may keep it after the next batch reuses the level's buffer
+          ImagePointer chunk = ImageType::New();
+          chunk->CopyInformation(levelImage);
+          chunk->SetBufferedRegion(chunkRegion);
+          chunk->SetRequestedRegion(chunkRegion);
+          chunk->Allocate(false);
+          ImageAlgorithm::Copy(levelImage, chunk.GetPointer(), chunkRegion, chunkRegion);
+          {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [&]() { return queue.size() < maximumPending || failure; });
+            if (failure)
+            {
+              break;
+            }
+            queue.emplace_back(level, chunk);
+          }
+          queueCondition.notify_all();
         }
       }
+    } while (!failed() && nextBatch(batchIndex));
+  }
+  catch (...)
+  {
+    finishCallbacks();
+    throw;
+  }
+
+  finishCallbacks();
+  if (failure)
+  {
+    std::rethrow_exception(failure);
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+auto
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::ScheduleRegions(const RegionType & region) const
+  -> std::vector<SizeValueType>
+{
+  // only the regions between these two intersect the region along the last dimension
+  constexpr unsigned   lastDim = ImageDimension - 1;
+  const IndexValueType reqStart = region.GetIndex(lastDim);
+  const IndexValueType reqEnd = reqStart + IndexValueType(region.GetSize(lastDim));
+  const auto           firstRegion = std::partition_point(
+    m_RegionMaxEnds.begin(), m_RegionMaxEnds.end(), [reqStart](IndexValueType end) { return end <= reqStart; });
+  const auto endRegion = std::partition_point(m_Regions.begin(), m_Regions.end(), [reqEnd](const RegionType & r) {
+    return r.GetIndex(lastDim) < reqEnd;
+  });
+  const SizeValueType first = firstRegion - m_RegionMaxEnds.begin();
+  const SizeValueType last = std::max<SizeValueType>(first, endRegion - m_Regions.begin());
+
+  std::vector<SizeValueType> schedule;
+  for (SizeValueType i = first; i < last; i++)
+  {
+    RegionType currentRegion = m_Regions[i];
+    if (currentRegion.Crop(region))
+    {
+      schedule.push_back(i);
     }
-    for (auto & roIndex : roIndices)
+  }
+  return schedule;
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::CountPendingRegions(
+  const std::vector<SizeValueType> & schedule)
+{
+  for (SizeValueType i : schedule)
+  {
+    for (auto tile : this->GetRegionContributors(i))
     {
-      this->SplitRegionAndCopyContributions(m_Regions, m_RegionContributors, m_InputMappings[i], roIndex, i);
+      ++m_PendingRegions[tile];
     }
   }
 }
 
 template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
 void
-TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateData()
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::MergeRequestedRegion(bool countPendingRegions)
 {
   ImagePointer outputImage = this->GetOutput();
   RegionType   reqR = outputImage->GetRequestedRegion();
-  outputImage->SetBufferedRegion(reqR);
-  outputImage->Allocate(false);
+  for (unsigned level = 0; level < m_NumberOfOutputLevels; level++)
+  {
+    ImageType * levelImage = this->GetOutput(level);
+    levelImage->SetBufferedRegion(levelImage->GetRequestedRegion());
+    levelImage->Allocate(false);
+  }
 
   // for debugging purposes, just color the regions by their contributing tiles
   // to make sure that the regions have been generated correctly without cracks
@@ -381,11 +1051,11 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateD
       PixelType val = NumericTraits<PixelType>::ZeroValue();
       PixelType val1 = NumericTraits<PixelType>::OneValue();
       unsigned  bits = sizeof(typename NumericTraits<PixelType>::ValueType) * 8;
-      if (m_RegionContributors[i].empty())
+      if (this->GetRegionContributors(i).empty())
       {
         val = NumericTraits<PixelType>::max();
       }
-      for (auto tile : m_RegionContributors[i])
+      for (auto tile : this->GetRegionContributors(i))
       {
         val += val1 * std::pow(2, tile % bits);
       }
@@ -401,23 +1071,256 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::GenerateD
       }
       this->UpdateProgress((i + 1) / float(m_Regions.size()));
     }
+    for (unsigned level = 1; level < m_NumberOfOutputLevels; level++)
+    {
+      this->DownsampleLevel(level);
+    }
     return;
   }
 
+  // count how many of the regions need each tile, so it can be evicted after the last one
+  std::vector<SizeValueType> schedule = this->ScheduleRegions(reqR);
+  if (countPendingRegions)
+  {
+    std::fill(m_PendingRegions.begin(), m_PendingRegions.end(), 0);
+    this->CountPendingRegions(schedule);
+  }
+
+  // regions are processed tile by tile along a Hilbert curve through the montage,
+  // with regions of the same contributing tiles next to each other. Each work unit
+  // gets a contiguous part of the schedule, so it works on a neighborhood of tiles,
+  // which are then evicted soon after being read, and are rarely wanted concurrently.
+  std::sort(schedule.begin(), schedule.end(), [this](SizeValueType a, SizeValueType b) {
+    if (m_RegionOrderKeys[a] != m_RegionOrderKeys[b])
+    {
+      return m_RegionOrderKeys[a] < m_RegionOrderKeys[b];
+    }
+    const ContributorRange ca = this->GetRegionContributors(a);
+    const ContributorRange cb = this->GetRegionContributors(b);
+    if (!std::equal(ca.begin(), ca.end(), cb.begin(), cb.end()))
+    {
+      return std::lexicographical_compare(ca.begin(), ca.end(), cb.begin(), cb.end());
+    }
+    return a < b;
+  });
+
   // now we will do resampling, one region at a time (in parallel)
   // within each of these regions the set of contributing tiles is the same
-  MultiThreaderBase::Pointer                   mt = MultiThreaderBase::New();
-  MultiThreaderBase::ArrayThreadingFunctorType tf = std::bind(&Self::ResampleSingleRegion, this, std::placeholders::_1);
-  mt->ParallelizeArray(0, m_Regions.size(), tf, this);
+  MontageProfiler::Scope     scope(this->GetModifiableProfiler(), "MergeRegions", "merge");
+  MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+  mt->ParallelizeArray(
+    0,
+    schedule.size(),
+    [this, &schedule](SizeValueType k) {
+      const SizeValueType i = schedule[k];
+      this->ResampleSingleRegion(i);
+      for (auto tile : this->GetRegionContributors(i))
+      {
+        std::lock_guard<std::mutex> lockGuard(this->m_TileReadLocks[tile]);
+        if (--m_PendingRegions[tile] == 0)
+        {
+          this->EvictTile(tile); // not needed by the rest of this request, nor its following batches
+        }
+      }
+    },
+    this);
 
-  // release data from input tiles
-  RegionType reg0;
-  for (SizeValueType i = 0; i < this->m_LinearMontageSize; i++)
+  // the levels are computed from the just merged part of the mosaic, while it is still in memory
+  MontageProfiler::Scope levelsScope(this->GetModifiableProfiler(), "DownsampleLevels", "merge");
+  for (unsigned level = 1; level < m_NumberOfOutputLevels; level++)
+  {
+    this->DownsampleLevel(level);
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::DownsampleLevel(unsigned level)
+{
+  const ImageType *  fine = this->GetOutput(level - 1);
+  ImageType *        coarse = this->GetOutput(level);
+  const RegionType   fineLargest = fine->GetLargestPossibleRegion();
+  const RegionType   coarseLargest = coarse->GetLargestPossibleRegion();
+  constexpr unsigned C = PixelComponents;
+  constexpr unsigned Rows = 1u << (ImageDimension - 1); // scanlines of the finer level per scanline of this one
+
+  MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+  mt->template ParallelizeImageRegion<ImageDimension>(
+    coarse->GetRequestedRegion(),
+    [fine, coarse, &fineLargest, &coarseLargest](const RegionType & piece) {
+      const SizeValueType   length = piece.GetSize(0);
+      std::vector<double>   sums(length * C);
+      std::vector<unsigned> counts(length);
+
+      ImageScanlineIterator<ImageType> it(coarse, piece);
+      for (; !it.IsAtEnd(); it.NextLine())
+      {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0u);
+        const ImageIndexType lineIndex = it.GetIndex();
+        for (unsigned r = 0; r < Rows; r++)
+        {
+          ImageIndexType rowIndex;
+          bool           inside = true;
+          for (unsigned d = 0; d < ImageDimension; d++)
+          {
+            const IndexValueType corner = d > 0 ? (r >> (d - 1)) & 1u : 0;
+            rowIndex[d] = fineLargest.GetIndex(d) + 2 * (lineIndex[d] - coarseLargest.GetIndex(d)) + corner;
+            inside = inside && rowIndex[d] < fineLargest.GetIndex(d) + IndexValueType(fineLargest.GetSize(d));
+          }
+          if (!inside)
+          {
+            continue; // beyond the last row of an odd-sized level
+          }
+          const auto * row =
+            reinterpret_cast<const PixelComponentType *>(fine->GetBufferPointer() + fine->ComputeOffset(rowIndex));
+          const SizeValueType available = fineLargest.GetIndex(0) + fineLargest.GetSize(0) - rowIndex[0];
+          for (SizeValueType x = 0; x < length; x++)
+          {
+            for (SizeValueType fx = 2 * x; fx < std::min(2 * x + 2, available); fx++)
+            {
+              ++counts[x];
+              for (unsigned c = 0; c < C; c++)
+              {
+                sums[x * C + c] += row[fx * C + c];
+              }
+            }
+          }
+        }
+
+        auto * out =
+          reinterpret_cast<PixelComponentType *>(coarse->GetBufferPointer() + coarse->ComputeOffset(lineIndex));
+        for (SizeValueType x = 0; x < length; x++)
+        {
+          for (unsigned c = 0; c < C; c++)
+          {
+            const double mean = sums[x * C + c] / counts[x];
+            out[x * C + c] =
+              static_cast<PixelComponentType>(std::is_integral<PixelComponentType>::value ? std::round(mean) : mean);
+          }
+        }
+      }
+    },
+    nullptr); // the progress is that of merging the regions, which would otherwise restart from zero
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+template <unsigned VTiles, typename TInputComponent>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::BlendScanline(
+  unsigned                        nTiles,
+  const TInputComponent * const * inputs,
+  const SizeValueType * const *   weights,
+  SizeValueType                   length,
+  AccumulateComponentType *       sums,
+  SizeValueType *                 distances,
+  PixelComponentType *            output)
+{
+  static_assert(sizeof(PixelType) == PixelComponents * sizeof(PixelComponentType),
+                "Pixel components must be contiguous");
+  static_assert(sizeof(TPixelAccumulateType) == PixelComponents * sizeof(AccumulateComponentType),
+                "Accumulation pixel must have the same number of components as the pixel");
+  const unsigned tileCount = VTiles > 0 ? VTiles : nTiles;
+  constexpr unsigned C = PixelComponents;
+
+  // tiles are accumulated in the same order for each pixel as in the per-pixel version,
+  // so the results are identical, but the inner loops run over contiguous memory
+  for (SizeValueType x = 0; x < length; x++)
+  {
+    distances[x] = weights[0][x];
+    for (unsigned c = 0; c < C; c++)
+    {
+      sums[x * C + c] = AccumulateComponentType(inputs[0][x * C + c]) * weights[0][x];
+    }
+  }
+  for (unsigned t = 1; t < tileCount; t++)
+  {
+    const TInputComponent * in = inputs[t];
+    const SizeValueType *      w = weights[t];
+    for (SizeValueType x = 0; x < length; x++)
+    {
+      distances[x] += w[x];
+      for (unsigned c = 0; c < C; c++)
+      {
+        sums[x * C + c] += AccumulateComponentType(in[x * C + c]) * w[x];
+      }
+    }
+  }
+  for (SizeValueType x = 0; x < length; x++)
+  {
+    for (unsigned c = 0; c < C; c++)
+    {
+      output[x * C + c] = static_cast<PixelComponentType>(sums[x * C + c] / distances[x]);
+    }
+  }
+}
+
+template <typename TImageType, typename TPixelAccumulateType, typename TInterpolator>
+void
+TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::InterpolateScanline(
+  const ImageType *           input,
+  const ImageIndexType &      lineIndex,
+  SizeValueType               length,
+  const IndexDifferenceType & difference,
+  RealComponentType *         values)
+{
+  static_assert(sizeof(InterpolatorOutputType) == PixelComponents * sizeof(RealComponentType),
+                "Interpolated pixel must have the same number of components as the pixel");
+  constexpr unsigned C = PixelComponents;
+  constexpr unsigned Corners = 1u << (ImageDimension - 1); // neighboring scanlines along the other dimensions
+
+  // like the interpolator, we clamp the neighbors to the buffered region
+  const RegionType     buffered = input->GetBufferedRegion();
+  const ImageIndexType start = buffered.GetIndex();
+  ImageIndexType       last;
+  OffsetType           shift;
+  double               fraction[ImageDimension];
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    last[d] = start[d] + IndexValueType(buffered.GetSize(d)) - 1;
+    const double base = std::floor(difference[d]);
+    shift[d] = static_cast<OffsetValueType>(base);
+    fraction[d] = difference[d] - base;
+  }
+
+  // the neighboring scanlines and their weights are the same for all the pixels
+  std::array<const PixelComponentType *, Corners> rows;
+  std::array<double, Corners>                     rowWeights;
+  unsigned                                        nRows = 0;
+  for (unsigned c = 0; c < Corners; c++)
+  {
+    ImageIndexType rowIndex = start;
+    double         weight = 1.0;
+    for (unsigned d = 1; d < ImageDimension; d++)
+    {
+      const bool upper = (c >> (d - 1)) & 1u;
+      rowIndex[d] = std::clamp<IndexValueType>(lineIndex[d] + shift[d] + upper, start[d], last[d]);
+      weight *= upper ? fraction[d] : 1.0 - fraction[d];
+    }
+    if (weight > 0.0) // skip the neighbors which do not contribute
+    {
+      rows[nRows] = reinterpret_cast<const PixelComponentType *>(input->GetBufferPointer() +
+                                                                 input->ComputeOffset(rowIndex));
+      rowWeights[nRows] = weight;
+      ++nRows;
+    }
+  }
+
+  const double w0 = 1.0 - fraction[0];
+  const double w1 = fraction[0];
+  for (SizeValueType x = 0; x < length; x++)
   {
-    if (m_Tiles[i])
+    const IndexValueType i = lineIndex[0] + IndexValueType(x) + shift[0];
+    const IndexValueType x0 = std::clamp(i, start[0], last[0]) - start[0];
+    const IndexValueType x1 = std::clamp(i + 1, start[0], last[0]) - start[0];
+    for (unsigned k = 0; k < C; k++)
     {
-      m_Tiles[i]->SetBufferedRegion(reg0);
-      m_Tiles[i]->Allocate(false);
+      double value = 0.0;
+      for (unsigned r = 0; r < nRows; r++)
+      {
+        value += rowWeights[r] * (w0 * rows[r][x0 * C + k] + w1 * rows[r][x1 * C + k]);
+      }
+      values[x * C + k] = static_cast<RealComponentType>(value);
     }
   }
 }
@@ -427,15 +1330,22 @@ void
 TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::ResampleSingleRegion(SizeValueType i)
 {
   ImagePointer outputImage = this->GetOutput();
-  RegionType   reg0; // empty region
   RegionType   reqR = outputImage->GetRequestedRegion();
   RegionType   currentRegion = m_Regions[i];
   if (!currentRegion.Crop(reqR)) // empty intersection
   {
     return; // nothing to do
   }
+  const ContributorRange contributors = this->GetRegionContributors(i);
+  auto                   formatRegionName = [&currentRegion, &contributors]() {
+    std::ostringstream regionName;
+    regionName << currentRegion.GetIndex() << currentRegion.GetSize() << " tiles: " << contributors.size();
+    return regionName.str();
+  };
+  MontageProfiler::Scope scope(this->GetModifiableProfiler(), "MergeRegion", "merge", formatRegionName);
+
   ImageRegionIteratorWithIndex<ImageType> oIt(outputImage, currentRegion);
-  if (m_RegionContributors[i].empty()) // not covered by any tile
+  if (contributors.empty()) // not covered by any tile
   {
     while (!oIt.IsAtEnd())
     {
@@ -446,19 +1356,17 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::ResampleS
   }
 
   using ContinuousValueType = typename ContinuousIndexType::ValueType;
-  std::vector<SizeValueType>     tileIndices(m_RegionContributors[i].begin(), m_RegionContributors[i].end());
-  const unsigned                 nTiles = tileIndices.size();
-  std::vector<ImageConstPointer> inputs(nTiles);
-  std::vector<RegionType *>      tileRegions(nTiles);
-  std::vector<RegionType>        inRegions(nTiles);
-  std::vector<Vector<ContinuousValueType, ImageDimension>> continuousIndexDifferences(nTiles);
+  std::vector<SizeValueType>       tileIndices(contributors.begin(), contributors.end());
+  const unsigned                   nTiles = tileIndices.size();
+  std::vector<ImageConstPointer>   inputs(nTiles);
+  std::vector<RegionType *>        tileRegions(nTiles);
+  std::vector<RegionType>          inRegions(nTiles);
+  std::vector<IndexDifferenceType> continuousIndexDifferences(nTiles);
   for (unsigned t = 0; t < nTiles; t++)
   {
     TileIndexType nDIndex = this->LinearIndexTonDIndex(tileIndices[t]);
-    OffsetType    tileToRegion = currentRegion.GetIndex() - m_InputMappings[tileIndices[t]].GetIndex();
     inRegions[t] = currentRegion;
-    ImageConstPointer input = this->GetImage(nDIndex, reg0); // matadata (at least)
-    inRegions[t].SetIndex(input->GetLargestPossibleRegion().GetIndex() + tileToRegion);
+    inRegions[t].SetIndex(currentRegion.GetIndex() + m_OutputToTileOffsets[tileIndices[t]]);
     inputs[t] = this->GetImage(nDIndex, inRegions[t]); // metadata + at least inRegions[t] of data
     tileRegions[t] = &m_InputMappings[tileIndices[t]];
     for (unsigned d = 0; d < ImageDimension; d++)
@@ -495,12 +1403,30 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::ResampleS
     }
   }
 
+  const SizeValueType length = currentRegion.GetSize(0);
   if (nTiles == 1) // blending not needed
   {
     if (!interpolate)
     {
       ImageAlgorithm::Copy(inputs[0].GetPointer(), outputImage.GetPointer(), inRegions[0], currentRegion);
     }
+    else if (IsLinearInterpolator)
+    {
+      std::vector<RealComponentType>   values(length * PixelComponents);
+      ImageScanlineIterator<ImageType> lIt(outputImage, currentRegion);
+      while (!lIt.IsAtEnd())
+      {
+        const ImageIndexType lineIndex = lIt.GetIndex();
+        this->InterpolateScanline(inputs[0], lineIndex, length, continuousIndexDifferences[0], values.data());
+        auto * outLine = reinterpret_cast<PixelComponentType *>(outputImage->GetBufferPointer() +
+                                                                outputImage->ComputeOffset(lineIndex));
+        for (SizeValueType k = 0; k < length * PixelComponents; k++)
+        {
+          outLine[k] = static_cast<PixelComponentType>(values[k]);
+        }
+        lIt.NextLine();
+      }
+    }
     else
     {
       typename TInterpolator::Pointer interp = TInterpolator::New();
@@ -516,63 +1442,114 @@ TileMergeImageFilter<TImageType, TPixelAccumulateType, TInterpolator>::ResampleS
   }
   else // more than one tile contributes
   {
-    const TPixelAccumulateType zeroSum = NumericTraits<TPixelAccumulateType>::ZeroValue();
-    if (!interpolate)
+    // weights are piecewise-linear along a scanline, so they are computed
+    // for the whole scanline, which is then blended over contiguous memory
+    std::vector<SizeValueType>              weights(nTiles * length);
+    std::vector<SizeValueType>              distances(length);
+    std::vector<AccumulateComponentType>    sums(length * PixelComponents);
+    std::vector<const SizeValueType *>      weightLines(nTiles);
+    std::vector<const PixelComponentType *> inputLines(nTiles);
+    std::vector<OffsetType>                 outputToInput(nTiles);
+    for (unsigned t = 0; t < nTiles; t++)
     {
-      std::vector<ImageRegionConstIterator<ImageType>> iIt(nTiles);
-      for (unsigned t = 0; t < nTiles; t++)
-      {
-        iIt[t] = ImageRegionConstIterator<ImageType>(inputs[t], inRegions[t]);
-      }
+      weightLines[t] = &weights[t * length];
+      outputToInput[t] = inRegions[t].GetIndex() - currentRegion.GetIndex();
+    }
 
-      while (!oIt.IsAtEnd())
+    // interpolated scanlines of the tiles, in case interpolation is needed
+    std::vector<RealComponentType>               values;
+    std::vector<const RealComponentType *>       valueLines(nTiles);
+    std::vector<typename TInterpolator::Pointer> iInt(nTiles);
+    if (interpolate)
+    {
+      values.resize(nTiles * length * PixelComponents);
+      for (unsigned t = 0; t < nTiles; t++)
       {
-        ImageIndexType       pixelIndex = oIt.GetIndex();
-        SizeValueType        dist = 0;
-        TPixelAccumulateType sum = zeroSum;
-        for (unsigned t = 0; t < nTiles; t++)
+        valueLines[t] = &values[t * length * PixelComponents];
+        if (!IsLinearInterpolator)
         {
-          SizeValueType dt = this->DistanceFromEdge(pixelIndex, *tileRegions[t]);
-          sum += TPixelAccumulateType(iIt[t].Get()) * dt;
-          dist += dt;
-          ++iIt[t];
+          iInt[t] = TInterpolator::New();
+          iInt[t]->SetInputImage(inputs[t]);
         }
-        sum /= dist;
-        oIt.Set(sum);
-        ++oIt;
       }
     }
-    else
+
+    auto blend = [&](auto lines, PixelComponentType * outLine) {
+      switch (nTiles)
+      {
+        case 2:
+          BlendScanline<2>(nTiles, lines, weightLines.data(), length, sums.data(), distances.data(), outLine);
+          break;
+        case 4:
+          BlendScanline<4>(nTiles, lines, weightLines.data(), length, sums.data(), distances.data(), outLine);
+          break;
+        default:
+          BlendScanline<0>(nTiles, lines, weightLines.data(), length, sums.data(), distances.data(), outLine);
+          break;
+      }
+    };
+
+    ImageScanlineIterator<ImageType> lIt(outputImage, currentRegion);
+    while (!lIt.IsAtEnd())
     {
-      std::vector<typename TInterpolator::Pointer> iInt(nTiles);
+      const ImageIndexType lineIndex = lIt.GetIndex();
       for (unsigned t = 0; t < nTiles; t++)
       {
-        for (unsigned d = 0; d < ImageDimension; d++)
+        // distance from the edges along the other dimensions is constant within the scanline
+        const RegionType & tileRegion = *tileRegions[t];
+        IndexValueType     lineDist = NumericTraits<IndexValueType>::max();
+        for (unsigned d = 1; d < ImageDimension; d++)
         {
-          continuousIndexDifferences[t][d] =
-            inputs[t]->GetLargestPossibleRegion().GetIndex(d) - m_InputsContinuousIndices[tileIndices[t]][d];
+          const IndexValueType tileStart = tileRegion.GetIndex(d);
+          const IndexValueType tileEnd = tileStart + IndexValueType(tileRegion.GetSize(d));
+          lineDist = std::min(lineDist, std::min(lineIndex[d] - tileStart, tileEnd - lineIndex[d]));
+        }
+        const IndexValueType tileStart = tileRegion.GetIndex(0);
+        const IndexValueType tileEnd = tileStart + IndexValueType(tileRegion.GetSize(0));
+        SizeValueType *      w = &weights[t * length];
+        for (SizeValueType x = 0; x < length; x++)
+        {
+          const IndexValueType i = lineIndex[0] + IndexValueType(x);
+          w[x] = 1 + std::min(lineDist, std::min(i - tileStart, tileEnd - i)); // as in DistanceFromEdge
         }
-        iInt[t] = TInterpolator::New();
-        iInt[t]->SetInputImage(inputs[t]);
-      }
 
-      while (!oIt.IsAtEnd())
-      {
-        ImageIndexType       pixelIndex = oIt.GetIndex();
-        SizeValueType        dist = 0;
-        TPixelAccumulateType sum = zeroSum;
-        for (unsigned t = 0; t < nTiles; t++)
+        if (!interpolate)
         {
-          SizeValueType       dt = this->DistanceFromEdge(pixelIndex, *tileRegions[t]);
-          ContinuousIndexType continuousIndex = pixelIndex;
-          continuousIndex += continuousIndexDifferences[t];
-          sum += TPixelAccumulateType(iInt[t]->EvaluateAtContinuousIndex(continuousIndex)) * dt;
-          dist += dt;
+          const ImageIndexType inputIndex = lineIndex + outputToInput[t];
+          const PixelType *    line = inputs[t]->GetBufferPointer() + inputs[t]->ComputeOffset(inputIndex);
+          inputLines[t] = reinterpret_cast<const PixelComponentType *>(line);
         }
-        sum /= dist;
-        oIt.Set(sum);
-        ++oIt;
+        else if (IsLinearInterpolator)
+        {
+          auto * valueLine = const_cast<RealComponentType *>(valueLines[t]);
+          this->InterpolateScanline(inputs[t], lineIndex, length, continuousIndexDifferences[t], valueLine);
+        }
+        else
+        {
+          auto * valueLine = reinterpret_cast<InterpolatorOutputType *>(&values[t * length * PixelComponents]);
+          ContinuousIndexType continuousIndex;
+          for (SizeValueType x = 0; x < length; x++)
+          {
+            ImageIndexType pixelIndex = lineIndex;
+            pixelIndex[0] += IndexValueType(x);
+            continuousIndex = pixelIndex;
+            continuousIndex += continuousIndexDifferences[t];
+            valueLine[x] = iInt[t]->EvaluateAtContinuousIndex(continuousIndex);
+          }
+        }
+      }
+
+      auto * outLine = reinterpret_cast<PixelComponentType *>(outputImage->GetBufferPointer() +
+                                                              outputImage->ComputeOffset(lineIndex));
+      if (!interpolate)
+      {
+        blend(inputLines.data(), outLine);
+      }
+      else
+      {
+        blend(valueLines.data(), outLine);
       }
+      lIt.NextLine();
     }
   }
 }
@@ -19,13 +19,21 @@
 #ifndef itkTileMontage_h
 #define itkTileMontage_h
 
+#include "itkFFTDiskCache.h"
 #include "itkImageFileReader.h"
 #include "itkPhaseCorrelationOptimizer.h"
 #include "itkPhaseCorrelationImageRegistrationMethod.h"
+#include "itkTileCache.h"
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace itk
@@ -137,6 +145,22 @@ public:
   itkSetMacro(RelativeThreshold, float);
   itkGetConstMacro(RelativeThreshold, float);
 
+  /** Set/Get whether global optimization of tile positions uses a direct solver
+   * (sparse LDLT factorization of the normal equations) instead of the iterative
+   * least squares solver. Replacing an outlier equation rarely changes the
+   * sparsity pattern, so usually only the numerical factorization is repeated.
+   * Faster for large montages with many outliers. Default: false. */
+  itkSetMacro(UseDirectSolver, bool);
+  itkGetConstMacro(UseDirectSolver, bool);
+  itkBooleanMacro(UseDirectSolver);
+
+  /** Set/Get the maximum number of outlier equations replaced in one iteration
+   * of global optimization. Besides the worst equation, only the equations above
+   * AbsoluteThreshold which do not share tiles with the other chosen ones are
+   * replaced in the same iteration. Default: 1 (only the worst equation). */
+  itkSetClampMacro(MaximumOutliersPerIteration, unsigned, 1, NumericTraits<unsigned>::max());
+  itkGetConstMacro(MaximumOutliersPerIteration, unsigned);
+
   /** Set/Get tile positioning precision.
    * Get/Set expected maximum linear translation needed, in pixels.
    * Zero (the default) means unknown, and allows translations
@@ -151,10 +175,23 @@ public:
    * region for computing the cross correlation? Default: True.
    *
    * This improves results, and in case overlaps are less than 25%
-   * computation is also faster. */
+   * computation is also faster. Tiles given by filename are then read only
+   * within the overlaps, if their image format supports streaming.
+   * The registration pyramid still reads whole tiles. */
   itkSetMacro(CropToOverlap, bool);
   itkGetConstMacro(CropToOverlap, bool);
 
+  /** Set/Get whether the in-memory FFT cache keeps the tiles' forward FFTs
+   * in half precision. The cache is only used without CropToOverlap, and then
+   * holds the FFT of each tile until all its pairs are registered. Half precision
+   * reduces its memory to a half (float TCoordinate) or a quarter (double),
+   * at the cost of decoding an FFT whenever it is used. The values of each FFT
+   * are scaled to the range of half precision, so their relative error is about 1e-3,
+   * which rarely moves the correlation peak. Default: false. */
+  itkSetMacro(HalfPrecisionFFTCache, bool);
+  itkGetConstMacro(HalfPrecisionFFTCache, bool);
+  itkBooleanMacro(HalfPrecisionFFTCache);
+
   /** Set/Get obligatory padding.
    * If set, padding of this many pixels is added on both beginning and end
    * sides of each dimension of the image. Default value of 8 is usually fine. */
@@ -179,6 +216,167 @@ public:
   itkSetEnumMacro(PeakInterpolationMethod, typename PCMOptimizerType::PeakInterpolationMethodEnum);
   itkGetConstMacro(PeakInterpolationMethod, typename PCMOptimizerType::PeakInterpolationMethodEnum);
 
+  /** Set/Get the confidence ratio of the highest peak to the next one, at or above
+   * which a pair's registration keeps only the highest peak as its candidate, see
+   * PhaseCorrelationOptimizer::SetPeakConfidenceRatio(). Peak interpolation and
+   * candidate storage are then spent only on ambiguous pairs. If such a candidate
+   * is an outlier in global optimization, the pair is assumed to have no translation.
+   * Zero (the default) keeps all the candidates of every pair. */
+  itkSetClampMacro(PeakConfidenceRatio, double, 0.0, NumericTraits<double>::max());
+  itkGetConstMacro(PeakConfidenceRatio, double);
+
+  /** Set/Get the directory of the persistent FFT cache.
+   * If set, forward FFTs of the tiles read from files are stored in this
+   * directory, and re-used by subsequent runs on the same tiles. This
+   * makes repeated runs (e.g. when tuning the thresholds or PositionTolerance)
+   * much faster. Entries are keyed by tile file (including its size and
+   * modification time), region used, padding method, ObligatoryPadding and
+   * FFT size, so stale entries are never used. The cache is never
+   * pruned, that is left to the user. Default: empty (disabled). */
+  itkSetStringMacro(FFTCacheDirectory);
+  itkGetStringMacro(FFTCacheDirectory);
+
+  /** Shrink factors of the coarse levels of the registration pyramid. */
+  using ShrinkFactorsType = std::vector<unsigned>;
+
+  /** Set/Get the shrink factors of the registration pyramid, from the coarsest
+   * to the finest level. Full resolution is always registered last.
+   * Each pair is first registered on tiles downsampled by the first factor.
+   * Each subsequent level registers only a window of at most PyramidWindowSize
+   * pixels around the overlap predicted by the previous levels, and restricts
+   * the peak search (see PositionTolerance) to about the previous level's pixel size.
+   * Only used with CropToOverlap. Example: {8, 2}. Default: empty (disabled). */
+  void
+  SetPyramidShrinkFactors(const ShrinkFactorsType & factors)
+  {
+    if (std::find(factors.begin(), factors.end(), 0u) != factors.end())
+    {
+      itkExceptionMacro("Shrink factors must be positive");
+    }
+    if (this->m_PyramidShrinkFactors != factors)
+    {
+      this->m_PyramidShrinkFactors = factors;
+      this->Modified();
+    }
+  }
+  itkGetConstReferenceMacro(PyramidShrinkFactors, ShrinkFactorsType);
+
+  /** Set/Get the maximum size, in pixels along each dimension, of the window
+   * around the predicted overlap which is registered by the finer levels of
+   * the registration pyramid. Default: 256. */
+  itkSetMacro(PyramidWindowSize, SizeValueType);
+  itkGetConstMacro(PyramidWindowSize, SizeValueType);
+
+  /** Set/Get the number of pixels up to which padded FFTs are considered small.
+   * Multi-threading does not pay off for small FFTs, so such pairs are registered
+   * with single-threaded pipelines, as many pairs in parallel as there are threads.
+   * Pairs with larger FFTs use multi-threaded FFTs, and only NumberOfWorkUnits of them
+   * are registered in parallel. Upcoming pairs are grouped by their FFT size, so the
+   * pipelines and FFT buffers of one size are re-used by the following pairs.
+   * The sizes are predicted from the tiles' headers, which are read as the
+   * registrations progress. With a registration pyramid (see PyramidShrinkFactors)
+   * pairs are not grouped, and are considered small if a window of PyramidWindowSize is.
+   * Zero disables this, pairs are then registered in order. Default: 65536. */
+  itkSetMacro(SmallFFTSize, SizeValueType);
+  itkGetConstMacro(SmallFFTSize, SizeValueType);
+
+  /** Set/Get the number of tiles read ahead of the registrations. If positive,
+   * tiles given by filename are read whole by a dedicated thread, in the order
+   * in which the pairs are registered, at most PrefetchCount tiles ahead of the
+   * most recently started pair. Zero disables prefetching. Default: 0. */
+  itkSetMacro(PrefetchCount, SizeValueType);
+  itkGetConstMacro(PrefetchCount, SizeValueType);
+
+  /** Get the number of times during the last Update() that a registration
+   * needed a tile which was not yet prefetched. It then either waited for
+   * the prefetch thread to finish reading it, or read it itself if the
+   * prefetch thread had not started reading it yet. */
+  itkGetConstMacro(PrefetchStalls, SizeValueType);
+
+  /** Set/Get incremental update. If enabled, Update() after some of the tiles
+   * were replaced (see SetInputTile) registers only the pairs involving them,
+   * including tiles whose files were overwritten and set again under the same name,
+   * and re-uses the registrations of the other pairs from the previous Update().
+   * Global optimization of tile positions starts from the previous solution.
+   * Changes of the parameters which affect registrations (e.g. PaddingMethod
+   * or PositionTolerance) require registering all the pairs again. Default: false. */
+  itkSetMacro(IncrementalUpdate, bool);
+  itkGetConstMacro(IncrementalUpdate, bool);
+  itkBooleanMacro(IncrementalUpdate);
+
+  /** Set/Get the shard of the pairs which Update() registers. Pairs are split
+   * into ShardCount bands of tile rows along the last dimension, a pair
+   * belonging to the band of its tile with the larger index. If ShardCount
+   * is greater than one, Update() registers only the pairs of shard ShardIndex,
+   * and does not optimize the tile positions, so the output transforms stay identity.
+   * The shards can then be registered by separate processes, each of which
+   * writes its pairs' registrations with WritePairCandidates(). A final process
+   * reads all of them with ReadPairCandidates(), and its Update() only optimizes
+   * the tile positions. Defaults: 0 and 1 (all the pairs). */
+  itkSetMacro(ShardIndex, SizeValueType);
+  itkGetConstMacro(ShardIndex, SizeValueType);
+  itkSetMacro(ShardCount, SizeValueType);
+  itkGetConstMacro(ShardCount, SizeValueType);
+
+  /** Writes the registrations of the pairs determined (registered, re-used or read)
+   * by the last Update(): the candidate offsets of each pair with their confidences,
+   * including the candidates which the optimization of tile positions rejected.
+   * The format is binary, in the byte order of this machine, and records the
+   * montage size and the parameters which affect registrations. */
+  void
+  WritePairCandidates(const std::string & fileName) const;
+
+  /** Reads pair registrations written by WritePairCandidates(). The following
+   * Update() does not register the pairs which were read. May be called for several
+   * files, pairs present in more than one file are taken from the last one.
+   * The montage size and the parameters which affect registrations must be
+   * the same as when the file was written, otherwise an exception is thrown. */
+  void
+  ReadPairCandidates(const std::string & fileName);
+
+  /** Candidate offsets of a pair's registration, and their confidences. */
+  using PairOffsetsType = std::vector<typename TransformType::OutputVectorType>;
+  using PairConfidencesType = typename PCMType::ConfidencesVector;
+
+  /** Sets the registration of the pair of the tile and the preceding tile along
+   * the dimension, as if it was read by ReadPairCandidates(). The offsets are
+   * the candidate translations of the tile, in physical units, from its position
+   * given by the tiles' origins. Their number must match that of the confidences.
+   * The tile must be within the montage, so the montage size is set first. */
+  void
+  SetPairCandidates(TileIndexType               tile,
+                    unsigned                    dimension,
+                    const PairOffsetsType &     offsets,
+                    const PairConfidencesType & confidences);
+
+  /** Forgets the pair registrations read by ReadPairCandidates() or set by SetPairCandidates(). */
+  void
+  ClearPairCandidates();
+
+  /** Set/Get the profiler. If set, reading of the tiles, registration of each pair
+   * (including its stages), global optimization and (in TileMergeImageFilter)
+   * merging of each region are timed, and bytes read and FFT cache hits counted.
+   * Default: nullptr (no profiling). */
+  itkSetObjectMacro(Profiler, MontageProfiler);
+  itkGetModifiableObjectMacro(Profiler, MontageProfiler);
+
+  /** Set/Get the cache of tiles read from files. If set, tiles are read whole
+   * and kept in the cache, so the pairs' registrations and other filters sharing
+   * the cache (e.g. TileMergeImageFilter) do not read them again.
+   * Tiles are pinned while their pairs are being registered.
+   * Default: nullptr (tiles are read as needed). */
+  itkSetObjectMacro(TileCache, TileCache);
+  itkGetModifiableObjectMacro(TileCache, TileCache);
+
+  /** Set/Get memory mapping of tiles. If enabled, tiles given by NRRD or MetaImage
+   * files whose pixels are stored uncompressed and suitably aligned, with the pixel type
+   * and byte order of the image type, are memory-mapped instead of read. Their pixels are then
+   * loaded by the operating system when first accessed, and shared with other
+   * processes mapping the same files. Other tiles are read as usual. Default: false. */
+  itkSetMacro(MemoryMapTiles, bool);
+  itkGetConstMacro(MemoryMapTiles, bool);
+  itkBooleanMacro(MemoryMapTiles);
+
   /** Get/Set size of the image mosaic. */
   itkGetConstMacro(MontageSize, SizeType);
   void
@@ -191,12 +389,14 @@ public:
   {
     this->SetNthInput(linearIndex, image);
     m_FFTCache[linearIndex] = nullptr;
+    m_HalfFFTCache[linearIndex] = nullptr;
     m_Tiles[linearIndex] = nullptr;
   }
   void
   SetInputTile(SizeValueType linearIndex, const std::string & imageFilename)
   {
     m_Filenames[linearIndex] = imageFilename;
+    this->Modified(); // the file might have been overwritten, and the input (m_Dummy) might not change
     this->SetInputTile(linearIndex, m_Dummy);
   }
   void
@@ -266,10 +466,21 @@ protected:
   typename TImageToRead::Pointer
   GetImageHelper(TileIndexType nDIndex, bool metadataOnly, RegionType region);
 
+  /** Backs the image, whose metadata were read by the imageIO, by the memory-mapped
+   * pixel data of the file. Returns false if the file's pixels cannot be mapped. */
+  template <typename TImageToRead>
+  static bool
+  MapTile(const std::string & fileName, const ImageIOBase * imageIO, TImageToRead * image);
+
   /** Just get image pointer if the image is present, otherwise read it from file. */
   typename ImageType::Pointer
   GetImage(TileIndexType nDIndex, bool metadataOnly);
 
+  /** Like GetImage(), but tiles given by filename are read only within the region,
+   * as far as the reader supports streaming. The largest possible region is that of the file. */
+  typename ImageType::Pointer
+  GetImageRegion(TileIndexType nDIndex, const RegionType & region);
+
   DataObjectPointerArraySizeType
   nDIndexToLinearIndex(TileIndexType nDIndex) const;
   TileIndexType
@@ -277,13 +488,112 @@ protected:
   DataObjectPointerArraySizeType
   ReferenceLinearIndex(DataObjectPointerArraySizeType candidateIndex) const;
 
+  /** Downsamples the image by the given factor, for a coarse level of the pyramid. */
+  static ImagePointer
+  ShrinkTile(const ImageType * image, unsigned factor);
+
+  /** Replaces the images by windows of at most PyramidWindowSize around their overlap,
+   * assuming the moving image is translated by the given offset. The moving window's
+   * origin is adjusted by the offset, so only the residual offset remains to be found. */
+  void
+  CropToPredictedOverlap(ImageConstPointer &       fixedImage,
+                         ImageConstPointer &       movingImage,
+                         const TranslationOffset & offset) const;
+
+  /** Registers the coarse levels of the pyramid, accumulating their results into offset.
+   * Returns the position tolerance for the full resolution level. */
+  SizeValueType
+  PredictOffset(const ImageType * fixedImage, const ImageType * movingImage, TranslationOffset & offset);
+
+  /** Whether the FFT of this padded size is small, see SmallFFTSize. */
+  bool
+  IsSmallFFT(const SizeType & paddedSize) const;
+
+  /** The number of pairs registered in parallel, depending on their FFT size. */
+  ThreadIdType
+  PairParallelism(bool smallFFT) const;
+
+  /** The number of work units of a registration pipeline with FFTs of this padded size. */
+  ThreadIdType
+  PipelineWorkUnits(const SizeType & paddedSize) const;
+
+  /** Groups the window of upcoming pairs which starts at the given position by their padded FFT size,
+   * predicted from the tiles' metadata, and determines which of them are small.
+   * Each tile's metadata is read at most once. Returns the end of the window. */
+  SizeValueType
+  GroupByFFTSize(std::vector<SizeValueType> & candidateIndices,
+                 SizeValueType                start,
+                 std::vector<ImagePointer> &  metadata,
+                 std::vector<bool> &          smallFFT);
+
+  /** Moves the first pair at or after position next, within the grouped window, whose tiles' forward FFTs
+   * are not claimed by a dispatched pair (see FFTClaims) to position next.
+   * Returns false if all the pairs of the window wait for such FFTs. */
+  bool
+  SelectPairWithAvailableFFTs(std::vector<SizeValueType> & candidateIndices,
+                              std::vector<bool> &          smallFFT,
+                              SizeValueType                next,
+                              SizeValueType                grouped);
+
+  /** The forward FFTs of a pair's tiles which RegisterPairs dispatched it to compute.
+   * The claims are released once the FFTs are cached, or if the registration throws. */
+  struct FFTClaims
+  {
+    ITK_DISALLOW_COPY_AND_MOVE(FFTClaims);
+
+    FFTClaims(TileMontage * montage, SizeValueType fixedTile, SizeValueType movingTile);
+    ~FFTClaims() { this->Release(); }
+
+    /** Releases the claims which are still held. */
+    void
+    Release();
+
+    TileMontage * Montage;
+    SizeValueType Tiles[2];   // fixed and moving tile's linear index
+    bool          Claimed[2]; // whether this pair computes the tile's forward FFT
+  };
+
   /** Register a pair of images with given indices. Handles FFTcaching. */
   void
   RegisterPair(TileIndexType fixed, TileIndexType moving);
 
-  /** If possible, removes from memory tile with index smaller by 1 along all dimensions. */
+  /** Registers the pairs identified by their candidate indices
+   * (moving tile's linear index + dimension * linear montage size).
+   * Pairs are grouped by FFT size (see SmallFFTSize), dispatched to the thread
+   * pool as soon as a work unit is free, and retired in the order in which they finish. Without CropToOverlap,
+   * a pair whose tile's forward FFT is being computed by another pair is dispatched after an upcoming pair
+   * whose FFTs are available, or after that FFT is cached. Each tile is released
+   * as soon as all of the pairs it participates in are finished. */
   void
-  ReleaseMemory(TileIndexType finishedTile);
+  RegisterPairs(const std::vector<SizeValueType> & candidateIndices);
+
+  /** Starts the thread prefetching the tiles of the pairs, in the order of the pairs.
+   * Returns each tile's position in that order (the maximum value for tiles which are not prefetched),
+   * or an empty vector if prefetching is disabled. */
+  std::vector<SizeValueType>
+  StartPrefetching(const std::vector<SizeValueType> & candidateIndices);
+
+  /** Allows the prefetch thread to read the tiles up to this position in the prefetching order. */
+  void
+  AdvancePrefetching(SizeValueType limit);
+
+  /** Stops and joins the prefetch thread, and forgets the tiles it read. */
+  void
+  StopPrefetching();
+
+  /** Body of the prefetch thread. */
+  void
+  PrefetchTiles(std::vector<SizeValueType> order);
+
+  /** Returns the prefetched tile, waiting for it if it is being read. Returns nullptr
+   * if the tile is not prefetched, or was not reached yet and should be read by the caller. */
+  ImagePointer
+  GetPrefetchedTile(SizeValueType linearIndex);
+
+  /** Removes from memory the tile with given linear index.
+   * Called once all the registration pairs involving this tile are finished. */
+  void
+  ReleaseMemory(SizeValueType linearIndex);
 
   /** Accesses output, sets a transform to it, and updates progress. */
   void
@@ -302,11 +612,84 @@ protected:
   using FFTPointer = typename FFTType::Pointer;
   using FFTConstPointer = typename FFTType::ConstPointer;
 
-  using OffsetVector = std::vector<TranslationOffset>;
-  using ConfidencesType = typename PCMType::ConfidencesVector;
+  using OffsetVector = PairOffsetsType;
+  using ConfidencesType = PairConfidencesType;
+
+  using FFTDiskCacheType = FFTDiskCache<FFTType>;
+
+  /** Forward FFT of a tile in half precision, for the in-memory FFT cache. */
+  struct HalfPrecisionFFT
+  {
+    FFTPointer                 Information; // metadata and regions, without pixels
+    SizeType                   PaddedSize;
+    double                     Scale;  // of the values, so that they fit into half precision
+    std::vector<std::uint16_t> Values; // real and imaginary part of each pixel
+  };
+  using HalfPrecisionFFTPointer = std::shared_ptr<const HalfPrecisionFFT>;
+
+  /** Encodes the FFT, which was padded to paddedSize, in half precision. */
+  static HalfPrecisionFFTPointer
+  EncodeFFT(const FFTType * fft, const SizeType & paddedSize);
+
+  /** Decodes the FFT into an idle FFT buffer, or into a new image if there is none. */
+  FFTPointer
+  DecodeFFT(const HalfPrecisionFFT & encoded);
+
+  /** Key of the persistent FFT cache entry for the given region of a tile,
+   * padded to fftSize. Empty for tiles which were not read from a file. */
+  std::string
+  FFTCacheKey(SizeValueType linearIndex, const RegionType & region, const SizeType & fftSize) const;
+
+  /** Returns an idle registration pipeline from the pool, or creates a new one.
+   * Pipelines are only created when all the existing ones are busy,
+   * so there is at most one pipeline per work unit. */
+  typename PCMType::Pointer
+  AcquirePCM();
+
+  /** Returns the pipeline to the pool of idle ones. The forward FFTs it computed
+   * are kept as scratch buffers for the following pairs, if recycle flags are set. */
+  void
+  ReleasePCM(PCMType * pcm, bool recycleFixedFFT, bool recycleMovingFFT);
+
+  /** Takes an idle FFT buffer of the given padded size from the pool.
+   * Returns nullptr if there is no such buffer. */
+  FFTPointer
+  AcquireFFTBuffer(const SizeType & paddedSize);
+
+  /** Frees the idle registration pipelines and FFT buffers. */
+  void
+  ClearPCMPool();
+
+  /** Parameters which affect the registrations, so a change of any of them
+   * means the previous registrations cannot be re-used by an incremental update. */
+  std::string
+  RegistrationParameters() const;
+
+  /** Size and modification time of the tile's file, empty for in-memory tiles. */
+  std::string
+  TileFileStamp(SizeValueType linearIndex) const;
+
+  /** Whether the tile changed since the previous registration,
+   * including its file being overwritten under the same name. */
+  bool
+  TileChanged(SizeValueType linearIndex) const;
+
+  /** Start of the files written by WritePairCandidates(), followed by the byte order mark. */
+  static constexpr char          PairCandidatesMagic[8] = { 'I', 'T', 'K', 'P', 'A', 'I', 'R', '1' };
+  static constexpr std::uint32_t PairCandidatesByteOrderMark = 0x01020304;
+
+  /** Whether the pair belongs to shard ShardIndex. */
+  bool
+  IsPairInShard(SizeValueType candidateIndex) const;
+
+  /** Remembers the tiles, for the subsequent incremental update. */
+  void
+  StoreRegistrations();
 
+  /** Finds the tile positions from the registrations of the pairs.
+   * If warmStart is set, the solver starts from the current adjustments. */
   void
-  OptimizeTiles();
+  OptimizeTiles(bool warmStart = false);
 
   std::deque<std::mutex> m_TileReadLocks; // to avoid reading the same tile by more than one thread in parallel
   // deque is not reallocated when resized, so no mutex moving causing a crash
@@ -322,12 +705,73 @@ private:
   SpacingType   m_ForcedSpacing;
   float         m_AbsoluteThreshold = 1.0;
   float         m_RelativeThreshold = 3.0;
+  double        m_PeakConfidenceRatio = 0.0;
   SizeValueType m_PositionTolerance = 0;
   bool          m_CropToOverlap = true;
+  bool          m_HalfPrecisionFFTCache = false;
+  bool          m_MemoryMapTiles = false;
+  bool          m_UseDirectSolver = false;
+  unsigned      m_MaximumOutliersPerIteration = 1;
   SizeType      m_ObligatoryPadding;
 
+  ShrinkFactorsType m_PyramidShrinkFactors;
+  SizeValueType     m_PyramidWindowSize = 256;
+  SizeValueType     m_SmallFFTSize = 65536;
+  SizeValueType     m_PrefetchCount = 0;
+  SizeValueType     m_PrefetchStalls = 0;
+  bool              m_IncrementalUpdate = false;
+  SizeValueType     m_ShardIndex = 0;
+  SizeValueType     m_ShardCount = 1;
+
+  // the tiles of the previous Update, for incremental updates
+  std::string                     m_RegistrationParameters;
+  std::vector<const DataObject *> m_RegisteredInputs;
+  std::vector<ModifiedTimeType>   m_RegisteredInputTimes;
+  std::vector<std::string>        m_RegisteredFilenames;
+  std::vector<std::string>        m_RegisteredFileStamps;
+
+  // the pairs' registrations of the previous Update, as OptimizeTiles removes outliers from the working copy
+  std::vector<OffsetVector>    m_RegisteredCandidates;
+  std::vector<ConfidencesType> m_RegisteredConfidences;
+
+  // the pairs' candidates read by ReadPairCandidates, copied into the working copy by each Update
+  std::vector<OffsetVector>    m_ProvidedCandidates;
+  std::vector<ConfidencesType> m_ProvidedConfidences;
+
+  std::vector<bool> m_ProvidedPairs;   // candidates read by ReadPairCandidates, by candidate index
+  std::vector<bool> m_DeterminedPairs; // candidates determined by the last Update, by candidate index
+
   std::mutex m_MemberProtector; // to prevent concurrent access to non-thread-safe internal member variables
 
+  // without CropToOverlap, the other pairs of a tile are dispatched after its forward FFT instead of computing it too
+  std::vector<bool> m_FFTInFlight; // forward FFTs claimed by a dispatched registration, by tile's linear index
+
+  std::mutex                                   m_PCMPoolMutex;
+  std::vector<typename PCMType::Pointer>       m_PCMPool;       // idle registration pipelines
+  std::vector<std::pair<SizeType, FFTPointer>> m_FFTBufferPool; // idle FFT buffers, with their padded size
+
+  MontageProfiler::Pointer m_Profiler;
+  TileCache::Pointer       m_TileCache;
+
+  // tiles read ahead of the registrations, see StartPrefetching()
+  enum class PrefetchState : uint8_t
+  {
+    None,    // not prefetched, or claimed by a registration
+    Pending, // not read yet
+    Reading, // being read by the prefetch thread
+    Ready
+  };
+  std::mutex                 m_PrefetchMutex;
+  std::condition_variable    m_PrefetchCondition;
+  std::thread                m_PrefetchThread;
+  std::vector<PrefetchState> m_PrefetchStates; // empty if not prefetching
+  std::vector<ImagePointer>  m_PrefetchedTiles;
+  SizeValueType              m_PrefetchLimit = 0; // positions in the prefetching order which may be read
+  bool                       m_PrefetchStop = false;
+
+  std::string                        m_FFTCacheDirectory;
+  typename FFTDiskCacheType::Pointer m_FFTDiskCache; // only exists during GenerateData, if enabled
+
   typename PCMType::PaddingMethodEnum m_PaddingMethod = PCMType::PaddingMethodEnum::MirrorWithExponentialDecay;
 
   std::vector<std::string>       m_Filenames;
@@ -338,6 +782,8 @@ private:
   std::vector<TranslationOffset> m_CurrentAdjustments;
   std::vector<float>             m_TileReliabilities;
 
+  std::vector<HalfPrecisionFFTPointer> m_HalfFFTCache; // instead of m_FFTCache, with HalfPrecisionFFTCache
+
   typename PCMOptimizerType::PeakInterpolationMethodEnum m_PeakInterpolationMethod =
     PCMOptimizerType::PeakInterpolationMethodEnum::Parabolic;
 
@@ -20,18 +20,34 @@
 #define itkTileMontage_hxx
 
 
+#include "itkBinShrinkImageFilter.h"
+#include "itkByteSwapper.h"
+#include "itkMemoryMappedImportImageContainer.h"
 #include "itkMultiThreaderBase.h"
 #include "itkNumericTraits.h"
+#include "itkRawPixelDataLocation.h"
+#include "itkRegionOfInterestImageFilter.h"
 #include "itkThreadPool.h"
 #include "itkConfigure.h" // for ITK_USE_FFTWF and ITK_USE_FFTWD
+#include "itkHalfPrecision.h"
+#include "itksys/SystemTools.hxx"
 
 #include "itk_eigen.h"
 #include ITK_EIGEN(Sparse)
+#include ITK_EIGEN(SparseCholesky)
 
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <typeinfo>
 
 namespace itk
 {
@@ -80,7 +96,29 @@ TileMontage<TImageType, TCoordinate>::PrintSelf(std::ostream & os, Indent indent
   os << indent << "Obligatory Padding: " << m_ObligatoryPadding << std::endl;
   os << indent << "Absolute Threshold: " << m_AbsoluteThreshold << std::endl;
   os << indent << "Relative Threshold: " << m_RelativeThreshold << std::endl;
+  os << indent << "Peak Confidence Ratio: " << m_PeakConfidenceRatio << std::endl;
   os << indent << "Position Tolerance: " << m_PositionTolerance << std::endl;
+  os << indent << "FFT Cache Directory: " << m_FFTCacheDirectory << std::endl;
+  os << indent << "Half Precision FFT Cache: " << (m_HalfPrecisionFFTCache ? "On" : "Off") << std::endl;
+  os << indent << "Pyramid Shrink Factors:";
+  for (unsigned factor : m_PyramidShrinkFactors)
+  {
+    os << " " << factor;
+  }
+  os << std::endl;
+  os << indent << "Pyramid Window Size: " << m_PyramidWindowSize << std::endl;
+  os << indent << "Small FFT Size: " << m_SmallFFTSize << std::endl;
+  os << indent << "Prefetch Count: " << m_PrefetchCount << std::endl;
+  os << indent << "Prefetch Stalls: " << m_PrefetchStalls << std::endl;
+  os << indent << "Use Direct Solver: " << (m_UseDirectSolver ? "On" : "Off") << std::endl;
+  os << indent << "Maximum Outliers Per Iteration: " << m_MaximumOutliersPerIteration << std::endl;
+  os << indent << "Profiler: " << m_Profiler.GetPointer() << std::endl;
+  os << indent << "TileCache: " << m_TileCache.GetPointer() << std::endl;
+  os << indent << "MemoryMapTiles: " << (m_MemoryMapTiles ? "On" : "Off") << std::endl;
+  os << indent << "Incremental Update: " << (m_IncrementalUpdate ? "On" : "Off") << std::endl;
+  os << indent << "Shard Index: " << m_ShardIndex << std::endl;
+  os << indent << "Shard Count: " << m_ShardCount << std::endl;
+  os << indent << "Provided Pairs: " << std::count(m_ProvidedPairs.begin(), m_ProvidedPairs.end(), true) << std::endl;
 
   auto nullCount = std::count(m_Filenames.begin(), m_Filenames.end(), std::string());
   os << indent << "Filenames (filled/capacity): " << m_Filenames.size() - nullCount << "/" << m_Filenames.size()
@@ -88,6 +126,9 @@ TileMontage<TImageType, TCoordinate>::PrintSelf(std::ostream & os, Indent indent
   nullCount = std::count(m_FFTCache.begin(), m_FFTCache.end(), nullptr);
   os << indent << "FFTCache (filled/capacity): " << m_FFTCache.size() - nullCount << "/" << m_FFTCache.size()
      << std::endl;
+  nullCount = std::count(m_HalfFFTCache.begin(), m_HalfFFTCache.end(), nullptr);
+  os << indent << "HalfFFTCache (filled/capacity): " << m_HalfFFTCache.size() - nullCount << "/"
+     << m_HalfFFTCache.size() << std::endl;
 
   os << indent << "MinInner: " << m_MinInner << std::endl;
   os << indent << "MaxInner: " << m_MaxInner << std::endl;
@@ -112,11 +153,18 @@ TileMontage<TImageType, TCoordinate>::SetMontageSize(SizeType montageSize)
     m_TileReadLocks.resize(m_LinearMontageSize);
     m_Filenames.resize(m_LinearMontageSize);
     m_FFTCache.resize(m_LinearMontageSize);
+    m_HalfFFTCache.resize(m_LinearMontageSize);
+    m_FFTInFlight.assign(m_LinearMontageSize, false);
     m_Tiles.resize(m_LinearMontageSize);
     m_CurrentAdjustments.resize(m_LinearMontageSize);
     m_TileReliabilities.resize(m_LinearMontageSize);
     m_TransformCandidates.resize(ImageDimension * m_LinearMontageSize); // adjacency along each dimension
     m_CandidateConfidences.resize(ImageDimension * m_LinearMontageSize);
+    m_ProvidedCandidates.resize(ImageDimension * m_LinearMontageSize);
+    m_ProvidedConfidences.resize(ImageDimension * m_LinearMontageSize);
+    m_ProvidedPairs.assign(ImageDimension * m_LinearMontageSize, false);
+    m_DeterminedPairs.assign(ImageDimension * m_LinearMontageSize, false);
+    m_RegisteredInputs.clear(); // previous registrations do not correspond to the new tiles
     this->Modified();
   }
 }
@@ -142,23 +190,62 @@ TileMontage<TImageType, TCoordinate>::GetImageHelper(TileIndexType nDIndex, bool
   }
   else // examine cache and read from file if necessary
   {
-    using ImageReaderType = ImageFileReader<TImageToRead>;
-    typename ImageReaderType::Pointer iReader = ImageReaderType::New();
-    iReader->SetFileName(this->m_Filenames[linearIndex]);
-    iReader->UpdateOutputInformation();
-    result = iReader->GetOutput();
-
-    if (!metadataOnly)
+    const std::string &            filename = this->m_Filenames[linearIndex];
+    typename TImageToRead::Pointer cached = nullptr;
+    if (m_TileCache)
     {
-      RegionType regionToRead = result->GetLargestPossibleRegion();
-      if (region.GetNumberOfPixels() > 0)
+      cached = m_TileCache->template GetImage<TImageToRead>(filename, metadataOnly ? RegionType() : region);
+    }
+    if (cached.IsNull())
+    {
+      using ImageReaderType = ImageFileReader<TImageToRead>;
+      typename ImageReaderType::Pointer iReader = ImageReaderType::New();
+      iReader->SetFileName(filename);
+      iReader->UpdateOutputInformation();
+      result = iReader->GetOutput();
+
+      if (!metadataOnly && m_MemoryMapTiles && MapTile(filename, iReader->GetImageIO(), result.GetPointer()))
+      {
+        if (m_Profiler)
+        {
+          m_Profiler->AddToCounter("BytesMapped",
+                                   double(result->GetBufferedRegion().GetNumberOfPixels()) *
+                                     sizeof(typename TImageToRead::PixelType));
+        }
+      }
+      else if (!metadataOnly)
       {
-        regionToRead.Crop(region);
-        result->SetRequestedRegion(regionToRead);
+        RegionType regionToRead = result->GetLargestPossibleRegion();
+        if (region.GetNumberOfPixels() > 0 && m_TileCache.IsNull()) // cached tiles are read whole
+        {
+          regionToRead.Crop(region);
+          result->SetRequestedRegion(regionToRead);
+        }
+        MontageProfiler::Scope scope(m_Profiler, "ReadTile", "io", filename);
+        iReader->Update();
+        if (m_Profiler)
+        {
+          m_Profiler->AddToCounter("BytesRead",
+                                   double(result->GetBufferedRegion().GetNumberOfPixels()) *
+                                     sizeof(typename TImageToRead::PixelType));
+        }
       }
-      iReader->Update();
+      result->DisconnectPipeline();
+      if (!metadataOnly && m_TileCache)
+      {
+        m_TileCache->AddImage(filename, result.GetPointer());
+        cached = result;
+      }
+    }
+    if (cached.IsNotNull())
+    {
+      // construct new metadata so adjustments do not modify the cached tile
+      result = TImageToRead::New();
+      result->CopyInformation(cached);
+      result->SetBufferedRegion(cached->GetBufferedRegion());
+      result->SetRequestedRegion(cached->GetBufferedRegion());
+      result->SetPixelContainer(cached->GetPixelContainer());
     }
-    result->DisconnectPipeline();
   }
 
   // adjust origin and spacing
@@ -176,12 +263,71 @@ TileMontage<TImageType, TCoordinate>::GetImageHelper(TileIndexType nDIndex, bool
   return result;
 }
 
+template <typename TImageType, typename TCoordinate>
+template <typename TImageToRead>
+bool
+TileMontage<TImageType, TCoordinate>::MapTile(const std::string & fileName,
+                                              const ImageIOBase * imageIO,
+                                              TImageToRead *      image)
+{
+  using PixelType = typename TImageToRead::PixelType;
+  using ComponentType = typename NumericTraits<PixelType>::ValueType;
+  using ElementType = typename TImageToRead::PixelContainer::Element;
+  const SizeValueType numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  const auto          nativeOrder = ByteSwapper<int>::SystemIsBigEndian() ? IOByteOrderEnum::BigEndian
+                                                                          : IOByteOrderEnum::LittleEndian;
+  if (imageIO == nullptr || imageIO->GetComponentType() != ImageIOBase::MapPixelType<ComponentType>::CType ||
+      imageIO->GetNumberOfComponents() * sizeof(ComponentType) != sizeof(PixelType) ||
+      (sizeof(ComponentType) > 1 && imageIO->GetByteOrder() != nativeOrder) ||
+      imageIO->GetImageSizeInPixels() != numberOfPixels || numberOfPixels == 0)
+  {
+    return false; // the reader would need to convert the pixels
+  }
+
+  RawPixelDataLocation      location;
+  MemoryMappedFile::Pointer file = MemoryMappedFile::New();
+  if (!LocateRawPixelData(fileName, location) || !file->Open(location.DataFileName))
+  {
+    return false;
+  }
+  const std::size_t bytes = numberOfPixels * sizeof(PixelType);
+  if (location.Offset < 0) // the data are at the end of the file
+  {
+    location.Offset = std::int64_t(file->GetSize()) - std::int64_t(bytes);
+  }
+  if (location.Offset < 0)
+  {
+    return false; // the file is too small
+  }
+  const auto offset = static_cast<std::size_t>(location.Offset);
+  if (offset + bytes > file->GetSize() || offset % alignof(ElementType) != 0)
+  {
+    return false;
+  }
+
+  using ContainerType = MemoryMappedImportImageContainer<SizeValueType, ElementType>;
+  typename ContainerType::Pointer container = ContainerType::New();
+  container->SetMappedFile(file, offset, numberOfPixels);
+  image->SetPixelContainer(container);
+  image->SetBufferedRegion(image->GetLargestPossibleRegion());
+  return true;
+}
+
 template <typename TImageType, typename TCoordinate>
 auto
 TileMontage<TImageType, TCoordinate>::GetImage(TileIndexType nDIndex, bool metadataOnly) -> typename ImageType::Pointer
 {
-  RegionType                  reg0; // default-initialized to zeroes
-  SizeValueType               linearIndex = this->nDIndexToLinearIndex(nDIndex);
+  RegionType    reg0; // default-initialized to zeroes
+  SizeValueType linearIndex = this->nDIndexToLinearIndex(nDIndex);
+  if (!metadataOnly)
+  {
+    ImagePointer prefetched = this->GetPrefetchedTile(linearIndex);
+    if (prefetched)
+    {
+      return prefetched;
+    }
+  }
+
   std::lock_guard<std::mutex> lockGuard(m_TileReadLocks[linearIndex]);
   // if we are not cropping to overlap, FFTCache will kick in later
   // and we don't want to double-cache the input tiles
@@ -197,6 +343,22 @@ TileMontage<TImageType, TCoordinate>::GetImage(TileIndexType nDIndex, bool metad
   return GetImageHelper<ImageType>(nDIndex, metadataOnly, reg0);
 }
 
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::GetImageRegion(TileIndexType nDIndex, const RegionType & region)
+  -> typename ImageType::Pointer
+{
+  SizeValueType linearIndex = this->nDIndexToLinearIndex(nDIndex);
+  ImagePointer  prefetched = this->GetPrefetchedTile(linearIndex);
+  if (prefetched)
+  {
+    return prefetched; // whole tile
+  }
+
+  std::lock_guard<std::mutex> lockGuard(m_TileReadLocks[linearIndex]);
+  return GetImageHelper<ImageType>(nDIndex, false, region);
+}
+
 template <typename TImageType, typename TCoordinate>
 DataObject::DataObjectPointerArraySizeType
 TileMontage<TImageType, TCoordinate>::nDIndexToLinearIndex(TileIndexType nDIndex) const
@@ -244,111 +406,990 @@ TileMontage<TImageType, TCoordinate>::ReferenceLinearIndex(DataObjectPointerArra
   return this->nDIndexToLinearIndex(referenceIndex);
 }
 
+template <typename TImageType, typename TCoordinate>
+std::string
+TileMontage<TImageType, TCoordinate>::FFTCacheKey(SizeValueType      linearIndex,
+                                                  const RegionType & region,
+                                                  const SizeType &   fftSize) const
+{
+  const std::string & filename = m_Filenames[linearIndex];
+  if (filename.empty() || this->GetInput(linearIndex) != m_Dummy.GetPointer())
+  {
+    return std::string(); // in-memory tiles are not cached on disk
+  }
+
+  std::ostringstream key;
+  key << itksys::SystemTools::CollapseFullPath(filename) << '|' << this->TileFileStamp(linearIndex) << '|'
+      << region.GetIndex() << region.GetSize() << '|' << m_PaddingMethod << '|' << m_ObligatoryPadding << '|' << fftSize
+      << '|' << typeid(PixelType).name() << '|' << typeid(RealType).name();
+  return key.str();
+}
+
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::ShrinkTile(const ImageType * image, unsigned factor) -> ImagePointer
+{
+  using ShrinkType = BinShrinkImageFilter<ImageType, ImageType>;
+  typename ShrinkType::Pointer shrinker = ShrinkType::New();
+  shrinker->SetInput(image);
+  shrinker->SetShrinkFactors(factor);
+  shrinker->Update();
+  ImagePointer result = shrinker->GetOutput();
+  result->DisconnectPipeline();
+  return result;
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::CropToPredictedOverlap(ImageConstPointer &       fixedImage,
+                                                             ImageConstPointer &       movingImage,
+                                                             const TranslationOffset & offset) const
+{
+  // moving image's region in fixed image's index space
+  const SpacingType spacing = fixedImage->GetSpacing();
+  RegionType        fRegion = fixedImage->GetLargestPossibleRegion();
+  RegionType        mRegion = movingImage->GetLargestPossibleRegion();
+  OffsetType        shift;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    const double predictedOrigin = movingImage->GetOrigin()[d] - offset[d];
+    shift[d] = std::round((predictedOrigin - fixedImage->GetOrigin()[d]) / spacing[d]);
+  }
+  mRegion.SetIndex(mRegion.GetIndex() + shift);
+  if (!fRegion.Crop(mRegion))
+  {
+    return; // no overlap predicted, so leave it to the usual cropping
+  }
+
+  // restrict the overlap to a window around its center
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    if (fRegion.GetSize(d) > m_PyramidWindowSize)
+    {
+      fRegion.SetIndex(d, fRegion.GetIndex(d) + (fRegion.GetSize(d) - m_PyramidWindowSize) / 2);
+      fRegion.SetSize(d, m_PyramidWindowSize);
+    }
+  }
+  mRegion = fRegion;
+  mRegion.SetIndex(fRegion.GetIndex() - shift);
+
+  using RoIType = RegionOfInterestImageFilter<ImageType, ImageType>;
+  typename RoIType::Pointer fixedRoI = RoIType::New();
+  fixedRoI->SetInput(fixedImage);
+  fixedRoI->SetRegionOfInterest(fRegion);
+  fixedRoI->Update();
+  ImagePointer fixedWindow = fixedRoI->GetOutput();
+  fixedWindow->DisconnectPipeline();
+
+  typename RoIType::Pointer movingRoI = RoIType::New();
+  movingRoI->SetInput(movingImage);
+  movingRoI->SetRegionOfInterest(mRegion);
+  movingRoI->Update();
+  ImagePointer movingWindow = movingRoI->GetOutput();
+  movingWindow->DisconnectPipeline();
+  PointType origin = movingWindow->GetOrigin();
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    origin[d] -= offset[d];
+  }
+  movingWindow->SetOrigin(origin);
+
+  fixedImage = fixedWindow;
+  movingImage = movingWindow;
+}
+
+template <typename TImageType, typename TCoordinate>
+SizeValueType
+TileMontage<TImageType, TCoordinate>::PredictOffset(const ImageType *   fixedImage,
+                                                    const ImageType *   movingImage,
+                                                    TranslationOffset & offset)
+{
+  SizeValueType tolerance = m_PositionTolerance; // in full resolution pixels
+  bool          coarsest = true;
+  for (unsigned factor : m_PyramidShrinkFactors)
+  {
+    if (factor == 1)
+    {
+      continue; // full resolution is registered by the caller
+    }
+
+    ImageConstPointer fixedLevel = ShrinkTile(fixedImage, factor);
+    ImageConstPointer movingLevel = ShrinkTile(movingImage, factor);
+    if (!coarsest)
+    {
+      this->CropToPredictedOverlap(fixedLevel, movingLevel, offset);
+    }
+
+    typename PCMType::Pointer pcm = this->AcquirePCM();
+    pcm->GetModifiableOptimizer()->SetPixelDistanceTolerance(std::ceil(tolerance / double(factor)));
+    pcm->SetFixedImage(fixedLevel);
+    pcm->SetMovingImage(movingLevel);
+    pcm->UpdateOutputInformation();
+    pcm->SetNumberOfWorkUnits(this->PipelineWorkUnits(pcm->GetPaddedSize()));
+    pcm->SetFFTBuffers(this->AcquireFFTBuffer(pcm->GetPaddedSize()), this->AcquireFFTBuffer(pcm->GetPaddedSize()));
+    pcm->Update();
+
+    const typename PCMType::OffsetVector & offsets = pcm->GetOffsets();
+    if (!offsets.empty())
+    {
+      for (unsigned d = 0; d < ImageDimension; d++)
+      {
+        if (std::isfinite(offsets[0][d]))
+        {
+          offset[d] += offsets[0][d];
+        }
+      }
+    }
+    this->ReleasePCM(pcm, true, true);
+
+    // the residual of this level is about one of its pixels
+    tolerance = factor;
+    coarsest = false;
+  }
+  return tolerance;
+}
+
+template <typename TImageType, typename TCoordinate>
+TileMontage<TImageType, TCoordinate>::FFTClaims::FFTClaims(TileMontage * montage,
+                                                           SizeValueType fixedTile,
+                                                           SizeValueType movingTile)
+  : Montage(montage)
+  , Tiles{ fixedTile, movingTile }
+{
+  // RegisterPairs does not dispatch another pair of a tile while its forward FFT is claimed
+  std::lock_guard<std::mutex> lock(montage->m_MemberProtector);
+  for (unsigned t = 0; t < 2; t++)
+  {
+    Claimed[t] = !montage->m_CropToOverlap && montage->m_FFTInFlight[Tiles[t]];
+  }
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::FFTClaims::Release()
+{
+  if (Claimed[0] || Claimed[1])
+  {
+    std::lock_guard<std::mutex> lock(Montage->m_MemberProtector);
+    for (unsigned t = 0; t < 2; t++)
+    {
+      Montage->m_FFTInFlight[Tiles[t]] = Montage->m_FFTInFlight[Tiles[t]] && !Claimed[t];
+      Claimed[t] = false;
+    }
+  }
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::RegisterPair(TileIndexType fixed, TileIndexType moving)
+{
+  SizeValueType lFixedInd = nDIndexToLinearIndex(fixed);
+  SizeValueType lMovingInd = nDIndexToLinearIndex(moving);
+
+  MontageProfiler::Scope scope(m_Profiler, "RegisterPair", "registration", [&fixed, &moving]() {
+    std::ostringstream pairName;
+    pairName << fixed << "->" << moving;
+    return pairName.str();
+  });
+
+  // pyramid levels are shrunk from whole tiles, otherwise only the overlaps are read
+  const bool        usePyramid = m_CropToOverlap && !m_PyramidShrinkFactors.empty();
+  const bool        readOverlap = m_CropToOverlap && !usePyramid;
+  ImageConstPointer fImage = this->GetImage(fixed, readOverlap);
+  ImageConstPointer mImage = this->GetImage(moving, readOverlap);
+  SizeValueType     tolerance = m_PositionTolerance;
+  TranslationOffset predictedOffset;
+  predictedOffset.Fill(0);
+  if (usePyramid) // full resolution only refines the offset predicted by the coarse levels
+  {
+    tolerance = this->PredictOffset(fImage, mImage, predictedOffset);
+    this->CropToPredictedOverlap(fImage, mImage, predictedOffset);
+  }
+
+  typename PCMType::Pointer m_PCM = this->AcquirePCM();
+  m_PCM->GetModifiableOptimizer()->SetPixelDistanceTolerance(tolerance);
+  m_PCM->SetFixedImage(fImage);
+  m_PCM->SetMovingImage(mImage);
+  if (readOverlap)
+  {
+    // the regions the PCM crops to include its extra padding, and depend only on metadata
+    m_PCM->UpdateOutputInformation();
+    fImage = this->GetImageRegion(fixed, m_PCM->GetFixedImageRegion());
+    mImage = this->GetImageRegion(moving, m_PCM->GetMovingImageRegion());
+    m_PCM->SetFixedImage(fImage);
+    m_PCM->SetMovingImage(mImage);
+  }
+  HalfPrecisionFFTPointer fixedHalfFFT, movingHalfFFT;
+  FFTClaims               claims(this, lFixedInd, lMovingInd); // also released if the registration throws
+  // scoping the lock
+  {
+    std::lock_guard<std::mutex> lock(m_MemberProtector);
+    m_PCM->SetFixedImageFFT(m_FFTCache[lFixedInd]);   // maybe null
+    m_PCM->SetMovingImageFFT(m_FFTCache[lMovingInd]); // maybe null
+    fixedHalfFFT = m_HalfFFTCache[lFixedInd];         // maybe null
+    movingHalfFFT = m_HalfFFTCache[lMovingInd];       // maybe null
+  }
+
+  // decoded outside of the lock, as the encoded FFTs are never modified
+  if (fixedHalfFFT)
+  {
+    m_PCM->SetFixedImageFFT(this->DecodeFFT(*fixedHalfFFT));
+  }
+  if (movingHalfFFT)
+  {
+    m_PCM->SetMovingImageFFT(this->DecodeFFT(*movingHalfFFT));
+  }
+
+  m_PCM->UpdateOutputInformation(); // determines the regions and the padded size
+  m_PCM->SetNumberOfWorkUnits(this->PipelineWorkUnits(m_PCM->GetPaddedSize()));
+
+  // consult the persistent cache for the FFTs we do not have yet
+  std::string fixedKey, movingKey; // remain non-empty if the FFT should be stored after it is computed
+  if (m_FFTDiskCache && !usePyramid) // windows around the predicted overlap are not tiles' regions
+  {
+    if (m_PCM->GetFixedImageFFT() == nullptr)
+    {
+      fixedKey = this->FFTCacheKey(lFixedInd, m_PCM->GetFixedImageRegion(), m_PCM->GetPaddedSize());
+      FFTPointer cached = fixedKey.empty() ? FFTPointer() : m_FFTDiskCache->Read(fixedKey);
+      if (cached)
+      {
+        m_PCM->SetFixedImageFFT(cached);
+        fixedKey.clear();
+      }
+    }
+    if (m_PCM->GetMovingImageFFT() == nullptr)
+    {
+      movingKey = this->FFTCacheKey(lMovingInd, m_PCM->GetMovingImageRegion(), m_PCM->GetPaddedSize());
+      FFTPointer cached = movingKey.empty() ? FFTPointer() : m_FFTDiskCache->Read(movingKey);
+      if (cached)
+      {
+        m_PCM->SetMovingImageFFT(cached);
+        movingKey.clear();
+      }
+    }
+  }
+
+  // the FFTs which still need to be computed can re-use buffers left over by earlier pairs
+  const bool computeFixedFFT = m_PCM->GetFixedImageFFT() == nullptr;
+  const bool computeMovingFFT = m_PCM->GetMovingImageFFT() == nullptr;
+  if (m_Profiler)
+  {
+    m_Profiler->AddToCounter("FFTCacheHits", !computeFixedFFT + !computeMovingFFT);
+    m_Profiler->AddToCounter("FFTCacheMisses", computeFixedFFT + computeMovingFFT);
+  }
+  m_PCM->SetFFTBuffers(computeFixedFFT ? this->AcquireFFTBuffer(m_PCM->GetPaddedSize()) : FFTPointer(),
+                       computeMovingFFT ? this->AcquireFFTBuffer(m_PCM->GetPaddedSize()) : FFTPointer());
+
+  // m_PCM->DebugOn();
+  m_PCM->Update();
+
+  // an overridden PCM (e.g. running on a GPU) might not provide the forward FFTs
+  if (!m_CropToOverlap && m_HalfPrecisionFFTCache)
+  {
+    // encoded outside of the lock, FFTs decoded from the cache are already there
+    HalfPrecisionFFTPointer fixedEncoded, movingEncoded;
+    if (!fixedHalfFFT && m_PCM->GetFixedImageFFT())
+    {
+      fixedEncoded = EncodeFFT(m_PCM->GetFixedImageFFT(), m_PCM->GetPaddedSize());
+    }
+    if (!movingHalfFFT && m_PCM->GetMovingImageFFT())
+    {
+      movingEncoded = EncodeFFT(m_PCM->GetMovingImageFFT(), m_PCM->GetPaddedSize());
+    }
+    std::lock_guard<std::mutex> lock(m_MemberProtector);
+    if (fixedEncoded)
+    {
+      m_HalfFFTCache[lFixedInd] = fixedEncoded;
+    }
+    if (movingEncoded)
+    {
+      m_HalfFFTCache[lMovingInd] = movingEncoded;
+    }
+  }
+  else if (!m_CropToOverlap)
+  {
+    std::lock_guard<std::mutex> lock(m_MemberProtector);
+    m_FFTCache[lFixedInd] = m_PCM->GetFixedImageFFT();   // null is not cached
+    m_FFTCache[lMovingInd] = m_PCM->GetMovingImageFFT(); // null is not cached
+  }
+  claims.Release(); // the deferred pairs can use the cached FFTs, or compute them if there are none
+  if (!fixedKey.empty() && m_PCM->GetFixedImageFFT())
+  {
+    m_FFTDiskCache->Write(fixedKey, m_PCM->GetFixedImageFFT());
+  }
+  if (!movingKey.empty() && m_PCM->GetMovingImageFFT())
+  {
+    m_FFTDiskCache->Write(movingKey, m_PCM->GetMovingImageFFT());
+  }
+
+  const typename PCMType::OffsetVector & offsets = m_PCM->GetOffsets();
+  SizeValueType                          regLinearIndex = lMovingInd;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    if (fixed[d] != moving[d]) // this is the different dimension
+    {
+      regLinearIndex += d * m_LinearMontageSize;
+      break;
+    }
+  }
+
+  m_CandidateConfidences[regLinearIndex] = m_PCM->GetConfidences();
+  m_TransformCandidates[regLinearIndex].resize(offsets.size());
+  for (unsigned i = 0; i < offsets.size(); i++)
+  {
+    if (m_CandidateConfidences[regLinearIndex][i] == 0)
+    {
+      m_CandidateConfidences[regLinearIndex][i] = std::numeric_limits<TCoordinate>::epsilon();
+    }
+
+    for (unsigned d = 0; d < ImageDimension; d++)
+    {
+      if (std::isfinite(offsets[i][d]))
+      {
+        m_TransformCandidates[regLinearIndex][i][d] = predictedOffset[d] + offsets[i][d];
+      }
+      else
+      {
+        m_TransformCandidates[regLinearIndex][i][d] = predictedOffset[d];
+      }
+    }
+  }
+
+  // FFTs kept in the in-memory cache must not be overwritten by subsequent pairs,
+  // while those decoded from the half-precision cache are only copies
+  const bool keepFFTs = !m_CropToOverlap && !m_HalfPrecisionFFTCache;
+  this->ReleasePCM(m_PCM,
+                   (computeFixedFFT && !keepFFTs) || fixedHalfFFT != nullptr,
+                   (computeMovingFFT && !keepFFTs) || movingHalfFFT != nullptr);
+}
+
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::EncodeFFT(const FFTType * fft, const SizeType & paddedSize)
+  -> HalfPrecisionFFTPointer
+{
+  using ValueType = typename FFTType::PixelType::value_type;
+  auto encoded = std::make_shared<HalfPrecisionFFT>();
+  encoded->Information = FFTType::New();
+  encoded->Information->CopyInformation(fft);
+  encoded->Information->SetRegions(fft->GetBufferedRegion());
+  encoded->PaddedSize = paddedSize;
+
+  // std::complex is laid out as an array of its real and imaginary part
+  const auto * values = reinterpret_cast<const ValueType *>(fft->GetBufferPointer());
+  const size_t count = 2 * fft->GetBufferedRegion().GetNumberOfPixels();
+  double       maximum = 0.0;
+  for (size_t i = 0; i < count; i++)
+  {
+    maximum = std::max(maximum, std::abs(double(values[i])));
+  }
+  // the largest value becomes 2^15, well below the largest half-precision number
+  encoded->Scale = (maximum > 0.0 && std::isfinite(maximum)) ? maximum / 32768.0 : 1.0;
+  encoded->Values.resize(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    encoded->Values[i] = FloatToHalf(static_cast<float>(values[i] / encoded->Scale));
+  }
+  return encoded;
+}
+
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::DecodeFFT(const HalfPrecisionFFT & encoded) -> FFTPointer
+{
+  using ValueType = typename FFTType::PixelType::value_type;
+  FFTPointer fft = this->AcquireFFTBuffer(encoded.PaddedSize);
+  if (fft.IsNull())
+  {
+    fft = FFTType::New();
+  }
+  fft->CopyInformation(encoded.Information);
+  fft->SetRegions(encoded.Information->GetBufferedRegion());
+  fft->Allocate(); // pooled buffers already have the right size
+
+  auto * values = reinterpret_cast<ValueType *>(fft->GetBufferPointer());
+  for (size_t i = 0; i < encoded.Values.size(); i++)
+  {
+    values[i] = static_cast<ValueType>(HalfToFloat(encoded.Values[i]) * encoded.Scale);
+  }
+  return fft;
+}
+
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::AcquirePCM() -> typename PCMType::Pointer
+{
+  {
+    std::lock_guard<std::mutex> lock(m_PCMPoolMutex);
+    if (!m_PCMPool.empty())
+    {
+      typename PCMType::Pointer pcm = m_PCMPool.back();
+      m_PCMPool.pop_back();
+      return pcm;
+    }
+  }
+
+  // parameters do not change during GenerateData, so the pipeline is set up only once
+  typename PCMType::Pointer          pcm = PCMType::New();
+  typename PCMOperatorType::Pointer  pcmOperator = PCMOperatorType::New();
+  typename PCMOptimizerType::Pointer pcmOptimizer = PCMOptimizerType::New();
+  pcm->SetPaddingMethod(m_PaddingMethod);
+  pcm->SetCropToOverlap(m_CropToOverlap);
+  pcm->SetOperator(pcmOperator);
+  pcm->SetOptimizer(pcmOptimizer);
+  pcm->SetObligatoryPadding(m_ObligatoryPadding);
+  pcm->SetReleaseDataFlag(this->GetReleaseDataFlag());
+  pcm->SetReleaseDataBeforeUpdateFlag(false); // so the buffers of internal filters are re-used by the next pair
+  pcm->SetProfiler(m_Profiler);
+  pcmOptimizer->SetPixelDistanceTolerance(m_PositionTolerance);
+  pcmOptimizer->SetPeakInterpolationMethod(m_PeakInterpolationMethod);
+  pcmOptimizer->SetPeakConfidenceRatio(m_PeakConfidenceRatio);
+  return pcm;
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::ReleasePCM(PCMType * pcm, bool recycleFixedFFT, bool recycleMovingFFT)
+{
+  const SizeType paddedSize = pcm->GetPaddedSize();
+  FFTPointer     fixedFFT = recycleFixedFFT ? const_cast<FFTType *>(pcm->GetFixedImageFFT()) : nullptr;
+  FFTPointer     movingFFT = recycleMovingFFT ? const_cast<FFTType *>(pcm->GetMovingImageFFT()) : nullptr;
+  pcm->ReleaseInputs(); // so the tiles can be released while the pipeline is idle
+
+  std::lock_guard<std::mutex> lock(m_PCMPoolMutex);
+  for (FFTPointer fft : { fixedFFT, movingFFT })
+  {
+    if (fft)
+    {
+      m_FFTBufferPool.emplace_back(paddedSize, fft);
+    }
+  }
+  // keep only as many of the most recent buffers as the busy pipelines could need
+  const size_t smallBuffers = 2 * this->PairParallelism(true);
+  const size_t largeBuffers = 2 * this->PairParallelism(false);
+  size_t       smallCount = 0;
+  size_t       largeCount = 0;
+  auto         firstKept = m_FFTBufferPool.end();
+  for (auto it = m_FFTBufferPool.end(); it != m_FFTBufferPool.begin();)
+  {
+    --it;
+    const bool smallFFT = this->IsSmallFFT(it->first);
+    if (smallFFT ? (++smallCount > smallBuffers) : (++largeCount > largeBuffers))
+    {
+      continue; // will be removed
+    }
+    --firstKept;
+    if (firstKept != it)
+    {
+      *firstKept = std::move(*it);
+    }
+  }
+  m_FFTBufferPool.erase(m_FFTBufferPool.begin(), firstKept);
+  m_PCMPool.push_back(pcm);
+}
+
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::AcquireFFTBuffer(const SizeType & paddedSize) -> FFTPointer
+{
+  std::lock_guard<std::mutex> lock(m_PCMPoolMutex);
+  for (auto it = m_FFTBufferPool.rbegin(); it != m_FFTBufferPool.rend(); ++it)
+  {
+    if (it->first == paddedSize)
+    {
+      FFTPointer buffer = it->second;
+      m_FFTBufferPool.erase(std::next(it).base());
+      return buffer;
+    }
+  }
+  return nullptr;
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::ClearPCMPool()
+{
+  std::lock_guard<std::mutex> lock(m_PCMPoolMutex);
+  m_PCMPool.clear();
+  m_FFTBufferPool.clear();
+}
+
+template <typename TImageType, typename TCoordinate>
+bool
+TileMontage<TImageType, TCoordinate>::IsSmallFFT(const SizeType & paddedSize) const
+{
+  SizeValueType pixels = 1;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    pixels *= paddedSize[d];
+  }
+  return pixels <= m_SmallFFTSize;
+}
+
+template <typename TImageType, typename TCoordinate>
+ThreadIdType
+TileMontage<TImageType, TCoordinate>::PairParallelism(bool smallFFT) const
+{
+  if (smallFFT) // single-threaded pipelines
+  {
+    return std::max(this->GetNumberOfWorkUnits(), MultiThreaderBase::GetGlobalDefaultNumberOfThreads());
+  }
+  return this->GetNumberOfWorkUnits();
+}
+
+template <typename TImageType, typename TCoordinate>
+ThreadIdType
+TileMontage<TImageType, TCoordinate>::PipelineWorkUnits(const SizeType & paddedSize) const
+{
+  if (this->IsSmallFFT(paddedSize))
+  {
+    return 1; // many such pairs are registered in parallel instead
+  }
+  return MultiThreaderBase::GetGlobalDefaultNumberOfThreads(); // FFTs are multi-threaded
+}
+
+template <typename TImageType, typename TCoordinate>
+SizeValueType
+TileMontage<TImageType, TCoordinate>::GroupByFFTSize(std::vector<SizeValueType> & candidateIndices,
+                                                     SizeValueType                start,
+                                                     std::vector<ImagePointer> &  metadata,
+                                                     std::vector<bool> &          smallFFT)
+{
+  // a small window, so the order of tiles (and their release) is not changed much
+  const SizeValueType end = std::min<SizeValueType>(candidateIndices.size(), start + 4 * this->PairParallelism(true));
+  auto                tileMetadata = [this, &metadata](SizeValueType linearIndex) {
+    if (metadata[linearIndex].IsNull())
+    {
+      metadata[linearIndex] = this->GetImage(this->LinearIndexTonDIndex(linearIndex), true);
+    }
+    return metadata[linearIndex].GetPointer();
+  };
+
+  std::vector<std::pair<SizeType, SizeValueType>> sizes; // padded size and candidate index of each pair
+  typename PCMType::Pointer                       pcm = this->AcquirePCM();
+  for (SizeValueType p = start; p < end; p++)
+  {
+    pcm->SetFixedImage(tileMetadata(this->ReferenceLinearIndex(candidateIndices[p])));
+    pcm->SetMovingImage(tileMetadata(candidateIndices[p] % m_LinearMontageSize));
+    pcm->UpdateOutputInformation(); // no pixels are needed to determine the padded size
+    sizes.emplace_back(pcm->GetPaddedSize(), candidateIndices[p]);
+  }
+  this->ReleasePCM(pcm, false, false);
+
+  std::stable_sort(sizes.begin(), sizes.end(), [](const auto & a, const auto & b) {
+    return std::lexicographical_compare(a.first.begin(), a.first.end(), b.first.begin(), b.first.end());
+  });
+  for (SizeValueType p = start; p < end; p++)
+  {
+    candidateIndices[p] = sizes[p - start].second;
+    smallFFT[p] = this->IsSmallFFT(sizes[p - start].first);
+  }
+  return end;
+}
+
+template <typename TImageType, typename TCoordinate>
+bool
+TileMontage<TImageType, TCoordinate>::SelectPairWithAvailableFFTs(std::vector<SizeValueType> & candidateIndices,
+                                                                  std::vector<bool> &          smallFFT,
+                                                                  SizeValueType                next,
+                                                                  SizeValueType                grouped)
+{
+  // within the grouped window, so pairs of different FFT sizes are not mixed much
+  const SizeValueType end = std::min<SizeValueType>(grouped, next + 4 * this->PairParallelism(true));
+  SizeValueType       available = next;
+  {
+    std::lock_guard<std::mutex> lock(m_MemberProtector);
+    for (; available < end; available++)
+    {
+      const SizeValueType candidateIndex = candidateIndices[available];
+      if (!m_FFTInFlight[candidateIndex % m_LinearMontageSize] &&
+          !m_FFTInFlight[this->ReferenceLinearIndex(candidateIndex)])
+      {
+        break;
+      }
+    }
+  }
+  if (available == end)
+  {
+    return false;
+  }
+
+  // moved before the deferred pairs, which keep their order
+  std::rotate(
+    candidateIndices.begin() + next, candidateIndices.begin() + available, candidateIndices.begin() + available + 1);
+  std::rotate(smallFFT.begin() + next, smallFFT.begin() + available, smallFFT.begin() + available + 1);
+  return true;
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::RegisterPairs(const std::vector<SizeValueType> & unorderedIndices)
+{
+  // count the pairs each tile participates in, so it can be released after the last one
+  std::vector<SizeValueType> pendingPairs(m_LinearMontageSize, 0);
+  std::vector<bool>          pinned(m_LinearMontageSize, false); // in m_TileCache
+  for (SizeValueType candidateIndex : unorderedIndices)
+  {
+    ++pendingPairs[candidateIndex % m_LinearMontageSize];
+    ++pendingPairs[this->ReferenceLinearIndex(candidateIndex)];
+  }
+
+  // the pairs are grouped by FFT size one window of upcoming pairs at a time, just before they are submitted,
+  // so the tiles' headers are read while the registrations of the previous windows run
+  std::vector<SizeValueType> candidateIndices = unorderedIndices;
+  std::vector<bool>          smallFFT(candidateIndices.size(), false);
+  std::vector<ImagePointer>  metadata(m_LinearMontageSize);
+  SizeValueType              grouped = candidateIndices.size(); // the pairs before this position are grouped
+  if (m_SmallFFTSize > 0 && m_CropToOverlap && !m_PyramidShrinkFactors.empty())
+  {
+    // only windows around the overlaps predicted by the coarse levels are registered at full resolution
+    SizeType windowSize;
+    windowSize.Fill(m_PyramidWindowSize);
+    smallFFT.assign(candidateIndices.size(), this->IsSmallFFT(windowSize));
+  }
+  else if (m_SmallFFTSize > 0)
+  {
+    grouped = 0;
+  }
+
+  // grouping only changes the order within the windows, so the prefetching order is still close
+  const std::vector<SizeValueType> prefetchPosition = this->StartPrefetching(candidateIndices);
+
+  typename ThreadPool::Pointer pool = ThreadPool::GetInstance();
+  ThreadIdType                 tpThreads = pool->GetMaximumNumberOfThreads();
+  ThreadIdType                 workUnits = this->PairParallelism(false);
+  ThreadIdType                 smallWorkUnits = this->PairParallelism(true);
+  ThreadIdType                 maxInFlight = m_SmallFFTSize > 0 ? smallWorkUnits : workUnits;
+  if (tpThreads <= maxInFlight)
+  {
+    pool->AddThreads(maxInFlight - tpThreads + 1);
+  }
+
+  // finished pairs are retired in the order of completion, not submission,
+  // so a slow pair (e.g. waiting for a tile to be read) does not hold back the others
+  std::mutex                     queueMutex;
+  std::condition_variable        queueCondition;
+  std::deque<SizeValueType>      finishedQueue; // positions in candidateIndices
+  std::vector<std::future<void>> futures(candidateIndices.size());
+  SizeValueType                  submitted = 0;
+  SizeValueType                  retired = 0;
+  std::exception_ptr             firstError = nullptr;
+  while (retired < submitted || (submitted < candidateIndices.size() && !firstError))
+  {
+    // filling ThreadPool's queue with more top-level jobs
+    // than there are threads causes dead-lock, so let's be conservative
+    while (submitted < candidateIndices.size() && !firstError)
+    {
+      if (submitted == grouped)
+      {
+        try
+        {
+          grouped = this->GroupByFFTSize(candidateIndices, submitted, metadata, smallFFT);
+        }
+        catch (...) // e.g. a tile's header cannot be read, wait for the pairs in flight before re-throwing
+        {
+          firstError = std::current_exception();
+          break;
+        }
+      }
+      if (!m_CropToOverlap && !this->SelectPairWithAvailableFFTs(candidateIndices, smallFFT, submitted, grouped))
+      {
+        break; // the pairs in the window wait for FFTs being computed, pool threads do not
+      }
+      if (submitted - retired >= (smallFFT[submitted] ? smallWorkUnits : workUnits))
+      {
+        break;
+      }
+
+      const SizeValueType p = submitted++;
+      const SizeValueType candidateIndex = candidateIndices[p];
+      if (!m_CropToOverlap)
+      {
+        // this pair computes the forward FFTs which are not cached yet, see FFTClaims
+        std::lock_guard<std::mutex> lock(m_MemberProtector);
+        for (SizeValueType tile : { candidateIndex % m_LinearMontageSize, this->ReferenceLinearIndex(candidateIndex) })
+        {
+          m_FFTInFlight[tile] = !m_FFTCache[tile] && !m_HalfFFTCache[tile];
+        }
+      }
+      for (SizeValueType tile : { candidateIndex % m_LinearMontageSize, this->ReferenceLinearIndex(candidateIndex) })
+      {
+        if (m_TileCache && !m_Filenames[tile].empty() && !pinned[tile]) // until its last pair is finished
+        {
+          m_TileCache->Pin(m_Filenames[tile]);
+          pinned[tile] = true;
+        }
+        if (!prefetchPosition.empty() && prefetchPosition[tile] < m_LinearMontageSize) // keep PrefetchCount ahead
+        {
+          this->AdvancePrefetching(prefetchPosition[tile] + 1 + m_PrefetchCount);
+        }
+      }
+      futures[p] = pool->AddWork([this, p, candidateIndex, &queueMutex, &queueCondition, &finishedQueue]() {
+        std::exception_ptr error = nullptr;
+        try
+        {
+          TileIndexType movingIndex = this->LinearIndexTonDIndex(candidateIndex % m_LinearMontageSize);
+          TileIndexType fixedIndex = this->LinearIndexTonDIndex(this->ReferenceLinearIndex(candidateIndex));
+          this->RegisterPair(fixedIndex, movingIndex);
+          ++m_FinishedPairs;
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+        {
+          std::lock_guard<std::mutex> lock(queueMutex);
+          finishedQueue.push_back(p);
+        }
+        queueCondition.notify_one();
+        if (error)
+        {
+          std::rethrow_exception(error);
+        }
+      });
+    }
+
+    if (retired == submitted) // only after an error
+    {
+      continue;
+    }
+
+    SizeValueType p;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(lock, [&finishedQueue]() { return !finishedQueue.empty(); });
+      p = finishedQueue.front();
+      finishedQueue.pop_front();
+    }
+    ++retired;
+
+    try
+    {
+      futures[p].get(); // the pair has signalled completion, so this does not block for long
+    }
+    catch (...)
+    {
+      // stop submitting new pairs, but wait for those in flight before re-throwing
+      if (!firstError)
+      {
+        firstError = std::current_exception();
+      }
+      continue;
+    }
+
+    const SizeValueType candidateIndex = candidateIndices[p];
+    const SizeValueType movingTile = candidateIndex % m_LinearMontageSize;
+    const SizeValueType fixedTile = this->ReferenceLinearIndex(candidateIndex);
+    for (SizeValueType tile : { movingTile, fixedTile })
+    {
+      if (--pendingPairs[tile] == 0)
+      {
+        this->ReleaseMemory(tile);
+        if (pinned[tile])
+        {
+          m_TileCache->Unpin(m_Filenames[tile]);
+          pinned[tile] = false;
+        }
+      }
+    }
+    // all registrations finished = 95% of total progress
+    this->UpdateProgress(m_FinishedPairs * 0.95 / m_NumberOfPairs);
+  }
+
+  this->StopPrefetching();
+  for (SizeValueType tile = 0; tile < m_LinearMontageSize; tile++)
+  {
+    if (pinned[tile]) // the pairs which were not registered because of an error
+    {
+      m_TileCache->Unpin(m_Filenames[tile]);
+    }
+  }
+  if (firstError)
+  {
+    std::rethrow_exception(firstError);
+  }
+}
+
+template <typename TImageType, typename TCoordinate>
+std::vector<SizeValueType>
+TileMontage<TImageType, TCoordinate>::StartPrefetching(const std::vector<SizeValueType> & candidateIndices)
+{
+  m_PrefetchStalls = 0;
+  if (m_PrefetchCount == 0)
+  {
+    return {};
+  }
+
+  // the tiles given by filename, in the order of their first pair
+  std::vector<SizeValueType> position(m_LinearMontageSize, NumericTraits<SizeValueType>::max());
+  std::vector<SizeValueType> order;
+  for (SizeValueType candidateIndex : candidateIndices)
+  {
+    for (SizeValueType tile : { this->ReferenceLinearIndex(candidateIndex), candidateIndex % m_LinearMontageSize })
+    {
+      if (position[tile] == NumericTraits<SizeValueType>::max())
+      {
+        position[tile] = order.size();
+        order.push_back(tile);
+      }
+    }
+  }
+  order.erase(std::remove_if(order.begin(),
+                             order.end(),
+                             [this](SizeValueType tile) { return this->GetInput(tile) != m_Dummy.GetPointer(); }),
+              order.end());
+  if (order.empty())
+  {
+    return {};
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    m_PrefetchStates.assign(m_LinearMontageSize, PrefetchState::None);
+    m_PrefetchedTiles.assign(m_LinearMontageSize, nullptr);
+    position.assign(m_LinearMontageSize, NumericTraits<SizeValueType>::max()); // for tiles which are not prefetched
+    for (SizeValueType p = 0; p < order.size(); p++)
+    {
+      m_PrefetchStates[order[p]] = PrefetchState::Pending;
+      position[order[p]] = p;
+    }
+    m_PrefetchLimit = m_PrefetchCount;
+    m_PrefetchStop = false;
+  }
+  m_PrefetchThread = std::thread(&Self::PrefetchTiles, this, std::move(order));
+  return position;
+}
+
 template <typename TImageType, typename TCoordinate>
 void
-TileMontage<TImageType, TCoordinate>::RegisterPair(TileIndexType fixed, TileIndexType moving)
+TileMontage<TImageType, TCoordinate>::AdvancePrefetching(SizeValueType limit)
 {
-  SizeValueType lFixedInd = nDIndexToLinearIndex(fixed);
-  SizeValueType lMovingInd = nDIndexToLinearIndex(moving);
-
-  typename PCMType::Pointer          m_PCM = PCMType::New();
-  typename PCMOperatorType::Pointer  m_PCMOperator = PCMOperatorType::New();
-  typename PCMOptimizerType::Pointer m_PCMOptimizer = PCMOptimizerType::New();
-  m_PCM->SetPaddingMethod(m_PaddingMethod);
-  m_PCM->SetCropToOverlap(m_CropToOverlap);
-  m_PCM->SetOperator(m_PCMOperator);
-  m_PCM->SetOptimizer(m_PCMOptimizer);
-  m_PCM->SetObligatoryPadding(m_ObligatoryPadding);
-  m_PCM->SetReleaseDataFlag(this->GetReleaseDataFlag());
-  m_PCM->SetReleaseDataBeforeUpdateFlag(this->GetReleaseDataBeforeUpdateFlag());
-  m_PCMOptimizer->SetPixelDistanceTolerance(m_PositionTolerance);
-  m_PCMOptimizer->SetPeakInterpolationMethod(m_PeakInterpolationMethod);
-
-  auto mImage = this->GetImage(moving, false);
-  m_PCM->SetFixedImage(this->GetImage(fixed, false));
-  m_PCM->SetMovingImage(mImage);
-  // scoping the lock
   {
-    std::lock_guard<std::mutex> lock(m_MemberProtector);
-    m_PCM->SetFixedImageFFT(m_FFTCache[lFixedInd]);   // maybe null
-    m_PCM->SetMovingImageFFT(m_FFTCache[lMovingInd]); // maybe null
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    if (limit <= m_PrefetchLimit)
+    {
+      return;
+    }
+    m_PrefetchLimit = limit;
   }
-  // m_PCM->DebugOn();
-  m_PCM->Update();
+  m_PrefetchCondition.notify_all();
+}
 
-  if (!m_CropToOverlap)
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::StopPrefetching()
+{
   {
-    std::lock_guard<std::mutex> lock(m_MemberProtector);
-    m_FFTCache[lFixedInd] = m_PCM->GetFixedImageFFT();   // certainly not null
-    m_FFTCache[lMovingInd] = m_PCM->GetMovingImageFFT(); // certrainly not null
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    m_PrefetchStop = true;
   }
-
-  const typename PCMType::OffsetVector & offsets = m_PCM->GetOffsets();
-  SizeValueType                          regLinearIndex = lMovingInd;
-  for (unsigned d = 0; d < ImageDimension; d++)
+  m_PrefetchCondition.notify_all();
+  if (m_PrefetchThread.joinable())
   {
-    if (fixed[d] != moving[d]) // this is the different dimension
-    {
-      regLinearIndex += d * m_LinearMontageSize;
-      break;
-    }
+    m_PrefetchThread.join();
   }
 
-  m_CandidateConfidences[regLinearIndex] = m_PCM->GetConfidences();
-  m_TransformCandidates[regLinearIndex].resize(offsets.size());
-  for (unsigned i = 0; i < offsets.size(); i++)
+  std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+  m_PrefetchStates.clear();
+  m_PrefetchedTiles.clear();
+  if (m_Profiler)
   {
-    if (m_CandidateConfidences[regLinearIndex][i] == 0)
-    {
-      m_CandidateConfidences[regLinearIndex][i] = std::numeric_limits<TCoordinate>::epsilon();
-    }
+    m_Profiler->AddToCounter("PrefetchStalls", m_PrefetchStalls);
+  }
+}
 
-    for (unsigned d = 0; d < ImageDimension; d++)
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::PrefetchTiles(std::vector<SizeValueType> order)
+{
+  for (SizeValueType p = 0; p < order.size(); p++)
+  {
+    const SizeValueType tile = order[p];
     {
-      if (std::isfinite(offsets[i][d]))
+      std::unique_lock<std::mutex> lock(m_PrefetchMutex);
+      m_PrefetchCondition.wait(lock, [this, p]() { return m_PrefetchStop || p < m_PrefetchLimit; });
+      if (m_PrefetchStop)
       {
-        m_TransformCandidates[regLinearIndex][i][d] = offsets[i][d];
+        return;
       }
-      else
+      if (m_PrefetchStates[tile] != PrefetchState::Pending)
       {
-        m_TransformCandidates[regLinearIndex][i][d] = 0;
+        continue; // claimed by a registration which needed it before we got to it
       }
+      m_PrefetchStates[tile] = PrefetchState::Reading;
+    }
+
+    ImagePointer image;
+    try
+    {
+      RegionType                  reg0;
+      std::lock_guard<std::mutex> lockGuard(m_TileReadLocks[tile]);
+      image = this->template GetImageHelper<ImageType>(this->LinearIndexTonDIndex(tile), false, reg0);
+    }
+    catch (...)
+    {
+      image = nullptr; // the registration reads the tile itself, and reports the error
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+      m_PrefetchedTiles[tile] = image;
+      m_PrefetchStates[tile] = image ? PrefetchState::Ready : PrefetchState::None;
     }
+    m_PrefetchCondition.notify_all();
+  }
+}
+
+template <typename TImageType, typename TCoordinate>
+auto
+TileMontage<TImageType, TCoordinate>::GetPrefetchedTile(SizeValueType linearIndex) -> ImagePointer
+{
+  std::unique_lock<std::mutex> lock(m_PrefetchMutex);
+  if (m_PrefetchStates.empty() || m_PrefetchStates[linearIndex] == PrefetchState::None)
+  {
+    return nullptr;
+  }
+  if (m_PrefetchStates[linearIndex] == PrefetchState::Pending)
+  {
+    m_PrefetchStates[linearIndex] = PrefetchState::None; // read synchronously, instead of waiting for the others
+    ++m_PrefetchStalls;
+    return nullptr;
+  }
+  if (m_PrefetchStates[linearIndex] == PrefetchState::Reading)
+  {
+    ++m_PrefetchStalls;
+    MontageProfiler::Scope scope(m_Profiler, "PrefetchStall", "io");
+    m_PrefetchCondition.wait(lock, [this, linearIndex]() {
+      return m_PrefetchStates[linearIndex] != PrefetchState::Reading;
+    });
   }
+  return m_PrefetchedTiles[linearIndex]; // nullptr if reading failed
 }
 
 template <typename TImageType, typename TCoordinate>
 void
-TileMontage<TImageType, TCoordinate>::ReleaseMemory(TileIndexType finishedTile)
+TileMontage<TImageType, TCoordinate>::ReleaseMemory(SizeValueType linearIndex)
 {
-  TileIndexType oldIndex;
-  bool          releaseTile = true;
-  for (unsigned dim = 0; dim < ImageDimension; dim++)
   {
-    if (finishedTile[dim] > 0)
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    if (!m_PrefetchStates.empty())
     {
-      oldIndex[dim] = finishedTile[dim] - 1;
-    }
-    else
-    {
-      releaseTile = false;
+      m_PrefetchStates[linearIndex] = PrefetchState::None;
+      m_PrefetchedTiles[linearIndex] = nullptr;
     }
   }
-  if (releaseTile)
+  std::lock_guard<std::mutex> lock(m_MemberProtector);
+  m_FFTCache[linearIndex] = nullptr;
+  m_HalfFFTCache[linearIndex] = nullptr;
+  if (!m_Filenames[linearIndex].empty()) // release the input image too
   {
-    SizeValueType               linearIndex = this->nDIndexToLinearIndex(oldIndex);
-    std::lock_guard<std::mutex> lock(m_MemberProtector);
-    m_FFTCache[linearIndex] = nullptr;
-    if (!m_Filenames[linearIndex].empty()) // release the input image too
-    {
-      this->SetInputTile(oldIndex, m_Dummy);
-    }
-    if (m_Tiles[linearIndex])
-    {
-      RegionType reg0;
-      m_Tiles[linearIndex]->SetBufferedRegion(reg0);
-      m_Tiles[linearIndex]->Allocate(false);
-    }
+    this->SetInputTile(linearIndex, m_Dummy);
+  }
+  if (m_Tiles[linearIndex])
+  {
+    RegionType reg0;
+    m_Tiles[linearIndex]->SetBufferedRegion(reg0);
+    m_Tiles[linearIndex]->Allocate(false);
   }
 }
 
@@ -416,9 +1457,276 @@ TileMontage<TImageType, TCoordinate>::GenerateOutputInformation()
   }
 }
 
+template <typename TImageType, typename TCoordinate>
+std::string
+TileMontage<TImageType, TCoordinate>::RegistrationParameters() const
+{
+  std::ostringstream parameters;
+  parameters << m_MontageSize << '|' << m_OriginAdjustment << '|' << m_ForcedSpacing << '|' << m_PositionTolerance
+             << '|' << m_CropToOverlap << '|' << m_ObligatoryPadding << '|' << m_PaddingMethod << '|'
+             << m_PeakInterpolationMethod << '|' << m_PeakConfidenceRatio << '|' << m_PyramidWindowSize << '|'
+             << m_HalfPrecisionFFTCache << '|';
+  for (unsigned factor : m_PyramidShrinkFactors)
+  {
+    parameters << factor << ' ';
+  }
+  return parameters.str();
+}
+
+template <typename TImageType, typename TCoordinate>
+std::string
+TileMontage<TImageType, TCoordinate>::TileFileStamp(SizeValueType linearIndex) const
+{
+  const std::string & filename = m_Filenames[linearIndex];
+  if (filename.empty() || this->GetInput(linearIndex) != m_Dummy.GetPointer())
+  {
+    return std::string();
+  }
+  std::ostringstream stamp;
+  stamp << itksys::SystemTools::FileLength(filename) << '|' << itksys::SystemTools::ModifiedTime(filename);
+  return stamp.str();
+}
+
+template <typename TImageType, typename TCoordinate>
+bool
+TileMontage<TImageType, TCoordinate>::TileChanged(SizeValueType linearIndex) const
+{
+  const DataObject * input = this->GetInput(linearIndex);
+  return input != m_RegisteredInputs[linearIndex] || input->GetMTime() != m_RegisteredInputTimes[linearIndex] ||
+         m_Filenames[linearIndex] != m_RegisteredFilenames[linearIndex] ||
+         this->TileFileStamp(linearIndex) != m_RegisteredFileStamps[linearIndex];
+}
+
+template <typename TImageType, typename TCoordinate>
+bool
+TileMontage<TImageType, TCoordinate>::IsPairInShard(SizeValueType candidateIndex) const
+{
+  if (m_ShardCount <= 1)
+  {
+    return true;
+  }
+  constexpr unsigned  last = ImageDimension - 1;
+  const TileIndexType tileIndex = this->LinearIndexTonDIndex(candidateIndex % m_LinearMontageSize);
+  return tileIndex[last] * m_ShardCount / m_MontageSize[last] == m_ShardIndex;
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::WritePairCandidates(const std::string & fileName) const
+{
+  std::string data(PairCandidatesMagic, sizeof(PairCandidatesMagic));
+  auto        append = [&data](auto value) { data.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+  append(PairCandidatesByteOrderMark);
+  append(std::uint32_t(ImageDimension));
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    append(std::uint64_t(m_MontageSize[d]));
+  }
+  const std::string parameters = this->RegistrationParameters();
+  append(std::uint32_t(parameters.size()));
+  data += parameters;
+
+  append(std::uint64_t(std::count(m_DeterminedPairs.begin(), m_DeterminedPairs.end(), true)));
+  for (SizeValueType c = 0; c < m_DeterminedPairs.size(); c++)
+  {
+    if (m_DeterminedPairs[c])
+    {
+      append(std::uint64_t(c));
+      append(std::uint32_t(m_RegisteredCandidates[c].size()));
+      for (SizeValueType i = 0; i < m_RegisteredCandidates[c].size(); i++)
+      {
+        for (unsigned d = 0; d < ImageDimension; d++)
+        {
+          append(double(m_RegisteredCandidates[c][i][d]));
+        }
+        append(double(m_RegisteredConfidences[c][i]));
+      }
+    }
+  }
+
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file)
+  {
+    itkExceptionMacro("Could not open for writing: " << fileName);
+  }
+  file.write(data.data(), data.size());
+  if (!file)
+  {
+    itkExceptionMacro("Writing not successful to: " << fileName);
+  }
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::ReadPairCandidates(const std::string & fileName)
+{
+  std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+  if (!file)
+  {
+    itkExceptionMacro("Could not open for reading: " << fileName);
+  }
+  std::string contents(static_cast<size_t>(file.tellg()), '\0');
+  file.seekg(0);
+  file.read(&contents[0], contents.size());
+  if (!file)
+  {
+    itkExceptionMacro("Could not read: " << fileName);
+  }
+  if (contents.compare(0, sizeof(PairCandidatesMagic), PairCandidatesMagic, sizeof(PairCandidatesMagic)) != 0)
+  {
+    itkExceptionMacro(fileName << " is not a pair candidates file");
+  }
+
+  size_t position = sizeof(PairCandidatesMagic);
+  auto   require = [&](size_t size) {
+    if (position + size > contents.size())
+    {
+      itkExceptionMacro("Unexpected end of pair candidates file: " << fileName);
+    }
+  };
+  auto read = [&](auto & value) {
+    require(sizeof(value));
+    std::memcpy(&value, contents.data() + position, sizeof(value));
+    position += sizeof(value);
+  };
+
+  std::uint32_t byteOrderMark = 0;
+  std::uint32_t dimension = 0;
+  read(byteOrderMark);
+  if (byteOrderMark != PairCandidatesByteOrderMark)
+  {
+    itkExceptionMacro("Byte order of this machine does not match the one of: " << fileName);
+  }
+  read(dimension);
+  if (dimension != ImageDimension)
+  {
+    itkExceptionMacro("Expected dimension " << ImageDimension << ", but got " << dimension << " from: " << fileName);
+  }
+  SizeType montageSize;
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    std::uint64_t size = 0;
+    read(size);
+    montageSize[d] = size;
+  }
+  if (montageSize != m_MontageSize)
+  {
+    itkExceptionMacro("Montage size " << montageSize << " of " << fileName << " differs from " << m_MontageSize);
+  }
+  std::uint32_t length = 0;
+  read(length);
+  require(length);
+  if (contents.compare(position, length, this->RegistrationParameters()) != 0)
+  {
+    itkExceptionMacro("Parameters which affect registrations differ from those " << fileName << " was written with");
+  }
+  position += length;
+
+  // the whole file is parsed before any pair is taken over, so a malformed file changes nothing
+  std::uint64_t                pairCount = 0;
+  std::vector<SizeValueType>   indices;
+  std::vector<OffsetVector>    candidates;
+  std::vector<ConfidencesType> confidences;
+  read(pairCount);
+  for (std::uint64_t p = 0; p < pairCount; p++)
+  {
+    std::uint64_t candidateIndex = 0;
+    std::uint32_t count = 0;
+    read(candidateIndex);
+    read(count);
+    if (candidateIndex >= ImageDimension * m_LinearMontageSize ||
+        this->LinearIndexTonDIndex(candidateIndex % m_LinearMontageSize)[candidateIndex / m_LinearMontageSize] == 0)
+    {
+      itkExceptionMacro("Invalid pair " << candidateIndex << " in " << fileName);
+    }
+    require(size_t(count) * (ImageDimension + 1) * sizeof(double));
+    indices.push_back(candidateIndex);
+    candidates.emplace_back(count);
+    confidences.emplace_back(count);
+    for (std::uint32_t i = 0; i < count; i++)
+    {
+      double value = 0.0;
+      for (unsigned d = 0; d < ImageDimension; d++)
+      {
+        read(value);
+        candidates.back()[i][d] = value;
+      }
+      read(value);
+      confidences.back()[i] = value;
+    }
+  }
+
+  for (SizeValueType p = 0; p < indices.size(); p++)
+  {
+    m_ProvidedCandidates[indices[p]] = std::move(candidates[p]);
+    m_ProvidedConfidences[indices[p]] = std::move(confidences[p]);
+    m_ProvidedPairs[indices[p]] = true;
+  }
+  this->Modified();
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::SetPairCandidates(TileIndexType               tile,
+                                                        unsigned                    dimension,
+                                                        const PairOffsetsType &     offsets,
+                                                        const PairConfidencesType & confidences)
+{
+  for (unsigned d = 0; d < ImageDimension; d++)
+  {
+    if (tile[d] >= m_MontageSize[d]) // e.g. the montage size was not set yet
+    {
+      itkExceptionMacro("Tile " << tile << " is outside of the montage of size " << m_MontageSize);
+    }
+  }
+  if (dimension >= ImageDimension || tile[dimension] == 0)
+  {
+    itkExceptionMacro("Tile " << tile << " has no preceding tile along dimension " << dimension);
+  }
+  if (offsets.size() != confidences.size())
+  {
+    itkExceptionMacro("There are " << offsets.size() << " offsets, but " << confidences.size() << " confidences");
+  }
+  const SizeValueType candidateIndex = this->nDIndexToLinearIndex(tile) + dimension * m_LinearMontageSize;
+  m_ProvidedCandidates[candidateIndex] = offsets;
+  m_ProvidedConfidences[candidateIndex] = confidences;
+  m_ProvidedPairs[candidateIndex] = true;
+  this->Modified();
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::ClearPairCandidates()
+{
+  if (std::find(m_ProvidedPairs.begin(), m_ProvidedPairs.end(), true) != m_ProvidedPairs.end())
+  {
+    m_ProvidedPairs.assign(m_ProvidedPairs.size(), false);
+    m_ProvidedCandidates.assign(m_ProvidedCandidates.size(), OffsetVector());
+    m_ProvidedConfidences.assign(m_ProvidedConfidences.size(), ConfidencesType());
+    this->Modified();
+  }
+}
+
+template <typename TImageType, typename TCoordinate>
+void
+TileMontage<TImageType, TCoordinate>::StoreRegistrations()
+{
+  m_RegistrationParameters = this->RegistrationParameters();
+  m_RegisteredInputs.resize(m_LinearMontageSize);
+  m_RegisteredInputTimes.resize(m_LinearMontageSize);
+  m_RegisteredFileStamps.resize(m_LinearMontageSize);
+  for (SizeValueType i = 0; i < m_LinearMontageSize; i++)
+  {
+    m_RegisteredInputs[i] = this->GetInput(i);
+    m_RegisteredInputTimes[i] = m_RegisteredInputs[i]->GetMTime();
+    m_RegisteredFileStamps[i] = this->TileFileStamp(i);
+  }
+  m_RegisteredFilenames = m_Filenames;
+}
+
 template <typename TImageType, typename TCoordinate>
 void
-TileMontage<TImageType, TCoordinate>::OptimizeTiles()
+TileMontage<TImageType, TCoordinate>::OptimizeTiles(bool warmStart)
 {
   // formulate global optimization as an overdetermined linear system
   constexpr unsigned Dimension = ImageDimension;
@@ -465,6 +1773,13 @@ TileMontage<TImageType, TCoordinate>::OptimizeTiles()
   Eigen::LeastSquaresConjugateGradient<SparseMatrix> solver;
   bool                                               outlierExists = true;
   unsigned                                           iteration = 0;
+
+  // replacing an equation rarely changes the sparsity pattern of the normal equations,
+  // so the direct solver analyzes the pattern again only when it differs from the analyzed one
+  using NormalMatrix = Eigen::SparseMatrix<TCoordinate>;
+  using StorageIndex = typename NormalMatrix::StorageIndex;
+  Eigen::SimplicialLDLT<NormalMatrix> directSolver;
+  std::vector<StorageIndex>           analyzedPattern; // outer indices, followed by inner indices
   while (outlierExists)
   {
     if (this->GetDebug())
@@ -473,10 +1788,47 @@ TileMontage<TImageType, TCoordinate>::OptimizeTiles()
     }
     std::cout << "\nIteration " << ++iteration << "  ";
     regCoef.makeCompressed();
-    solver.compute(regCoef);
     TranslationsMatrix solutions(m_LinearMontageSize, Dimension);
     TranslationsMatrix residuals(m_NumberOfPairs + 1, Dimension);
-    solutions = solver.solve(translations);
+    if (m_UseDirectSolver) // solve the normal equations by sparse Cholesky factorization
+    {
+      NormalMatrix normal = regCoef.transpose() * regCoef;
+      normal.makeCompressed();
+      // e.g. an equation's coefficients cancel out in the product, while another one's do not any more
+      std::vector<StorageIndex> pattern(normal.outerIndexPtr(), normal.outerIndexPtr() + normal.outerSize() + 1);
+      pattern.insert(pattern.end(), normal.innerIndexPtr(), normal.innerIndexPtr() + normal.nonZeros());
+      if (pattern != analyzedPattern)
+      {
+        directSolver.analyzePattern(normal);
+        analyzedPattern = std::move(pattern);
+      }
+      directSolver.factorize(normal);
+      if (directSolver.info() != Eigen::Success)
+      {
+        itkExceptionMacro("Factorization of the normal equations failed. Are all the tiles connected?");
+      }
+      solutions = directSolver.solve(regCoef.transpose() * translations);
+    }
+    else // iterative solver, started from the previous solution if there is one
+    {
+      solver.compute(regCoef);
+      if (warmStart || iteration > 1)
+      {
+        TranslationsMatrix guess(m_LinearMontageSize, Dimension);
+        for (SizeValueType i = 0; i < m_LinearMontageSize; i++)
+        {
+          for (unsigned d = 0; d < ImageDimension; d++)
+          {
+            guess(i, d) = m_CurrentAdjustments[i][d];
+          }
+        }
+        solutions = solver.solveWithGuess(translations, guess);
+      }
+      else
+      {
+        solutions = solver.solve(translations);
+      }
+    }
     residuals = regCoef * solutions - translations;
 
     if (this->GetDebug())
@@ -529,8 +1881,9 @@ TileMontage<TImageType, TCoordinate>::OptimizeTiles()
       }
     }
 
-    TCoordinate   maxCost = 0;
-    SizeValueType maxIndex = 0;
+    TCoordinate              maxCost = 0;
+    SizeValueType            maxIndex = 0;
+    std::vector<TCoordinate> costs(m_NumberOfPairs);
     if (this->GetDebug())
     {
       std::cout << "\nresiduals:\n";
@@ -569,6 +1922,7 @@ TileMontage<TImageType, TCoordinate>::OptimizeTiles()
 
       // establish cost of this equation
       TCoordinate cost = residual * (1.0 + outlierScore[i]);
+      costs[i] = cost;
 
       if (this->GetDebug())
       {
@@ -653,59 +2007,98 @@ TileMontage<TImageType, TCoordinate>::OptimizeTiles()
     {
       outlierExists = false;
     }
-    else // eliminate the problematic equation
+    else // eliminate the problematic equations
     {
-      SizeValueType candidateIndex = equationToCandidate[maxIndex];
-      std::cout << "Outlier detected. Eq. " << maxIndex << ", Reg. " << candidateIndex;
-
-      // calculate indices of the involved tiles
-      SizeValueType linIndex = candidateIndex % m_LinearMontageSize;
-      TileIndexType currentIndex = this->LinearIndexTonDIndex(linIndex);
-      TileIndexType referenceIndex = currentIndex;
-      unsigned      dim = candidateIndex / m_LinearMontageSize;
-      referenceIndex[dim] = currentIndex[dim] - 1;
-      std::cout << ": " << currentIndex << "->" << referenceIndex << "  T: ";
-
-      if (!m_TransformCandidates[candidateIndex].empty())
+      // the worst equation, and then the other bad equations which do not share tiles with the chosen ones
+      std::vector<SizeValueType> outliers{ maxIndex };
+      if (m_MaximumOutliersPerIteration > 1)
       {
-        std::cout << m_TransformCandidates[candidateIndex][0];
-        m_TransformCandidates[candidateIndex].erase(m_TransformCandidates[candidateIndex].begin());
-        m_CandidateConfidences[candidateIndex].erase(m_CandidateConfidences[candidateIndex].begin());
-      }
-      else
-      {
-        std::cout << "zeroes";
+        std::vector<SizeValueType> order(m_NumberOfPairs);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&costs](SizeValueType a, SizeValueType b) {
+          return costs[a] > costs[b];
+        });
+        std::vector<bool> tileTaken(m_LinearMontageSize, false);
+        for (SizeValueType eqIndex : order)
+        {
+          if (outliers.size() >= m_MaximumOutliersPerIteration || costs[eqIndex] < m_AbsoluteThreshold * sqrtDim)
+          {
+            break;
+          }
+          const SizeValueType candidateIndex = equationToCandidate[eqIndex];
+          const SizeValueType linIndex = candidateIndex % m_LinearMontageSize;
+          const SizeValueType refLinearIndex = this->ReferenceLinearIndex(candidateIndex);
+          if (eqIndex != maxIndex && (tileTaken[linIndex] || tileTaken[refLinearIndex]))
+          {
+            continue; // replacing both could over-correct the positions of the shared tile
+          }
+          if (eqIndex != maxIndex)
+          {
+            outliers.push_back(eqIndex);
+          }
+          tileTaken[linIndex] = true;
+          tileTaken[refLinearIndex] = true;
+        }
       }
 
-      if (!m_TransformCandidates[candidateIndex].empty())
+      for (SizeValueType eqIndex : outliers)
       {
-        // get a new equation from m_TransformCandidates
-        const float &                        confidence = m_CandidateConfidences[candidateIndex][0];
-        typename SparseMatrix::InnerIterator it(regCoef, maxIndex);
-        regCoef.coeffRef(maxIndex, it.index()) = -confidence;
-        ++it;
-        regCoef.coeffRef(maxIndex, it.index()) = confidence;
-
-        const TranslationOffset & candidateOffset = m_TransformCandidates[candidateIndex][0];
-        for (unsigned d = 0; d < ImageDimension; d++)
+        if (eqIndex != maxIndex)
         {
-          translations(maxIndex, d) = confidence * candidateOffset[d];
+          std::cout << std::endl;
+        }
+        SizeValueType candidateIndex = equationToCandidate[eqIndex];
+        std::cout << "Outlier detected. Eq. " << eqIndex << ", Reg. " << candidateIndex;
+
+        // calculate indices of the involved tiles
+        SizeValueType linIndex = candidateIndex % m_LinearMontageSize;
+        TileIndexType currentIndex = this->LinearIndexTonDIndex(linIndex);
+        TileIndexType referenceIndex = currentIndex;
+        unsigned      dim = candidateIndex / m_LinearMontageSize;
+        referenceIndex[dim] = currentIndex[dim] - 1;
+        std::cout << ": " << currentIndex << "->" << referenceIndex << "  T: ";
+
+        if (!m_TransformCandidates[candidateIndex].empty())
+        {
+          std::cout << m_TransformCandidates[candidateIndex][0];
+          m_TransformCandidates[candidateIndex].erase(m_TransformCandidates[candidateIndex].begin());
+          m_CandidateConfidences[candidateIndex].erase(m_CandidateConfidences[candidateIndex].begin());
+        }
+        else
+        {
+          std::cout << "zeroes";
         }
-        std::cout << "  Replaced by T: " << candidateOffset;
-      }
-      else
-      {
-        // nudge this registration towards zero adjustment
-        typename SparseMatrix::InnerIterator it(regCoef, maxIndex);
-        regCoef.coeffRef(maxIndex, it.index()) = 0.01 * regCoef.coeffRef(maxIndex, it.index());
-        ++it;
-        regCoef.coeffRef(maxIndex, it.index()) = 0.01 * regCoef.coeffRef(maxIndex, it.index());
 
-        for (unsigned d = 0; d < ImageDimension; d++)
+        if (!m_TransformCandidates[candidateIndex].empty())
+        {
+          // get a new equation from m_TransformCandidates
+          const float &                        confidence = m_CandidateConfidences[candidateIndex][0];
+          typename SparseMatrix::InnerIterator it(regCoef, eqIndex);
+          regCoef.coeffRef(eqIndex, it.index()) = -confidence;
+          ++it;
+          regCoef.coeffRef(eqIndex, it.index()) = confidence;
+
+          const TranslationOffset & candidateOffset = m_TransformCandidates[candidateIndex][0];
+          for (unsigned d = 0; d < ImageDimension; d++)
+          {
+            translations(eqIndex, d) = confidence * candidateOffset[d];
+          }
+          std::cout << "  Replaced by T: " << candidateOffset;
+        }
+        else
         {
-          translations(maxIndex, d) = 0;
+          // nudge this registration towards zero adjustment
+          typename SparseMatrix::InnerIterator it(regCoef, eqIndex);
+          regCoef.coeffRef(eqIndex, it.index()) = 0.01 * regCoef.coeffRef(eqIndex, it.index());
+          ++it;
+          regCoef.coeffRef(eqIndex, it.index()) = 0.01 * regCoef.coeffRef(eqIndex, it.index());
+
+          for (unsigned d = 0; d < ImageDimension; d++)
+          {
+            translations(eqIndex, d) = 0;
+          }
+          std::cout << "  Replaced by zeroes.";
         }
-        std::cout << "  Replaced by zeroes.";
       }
     }
   }
@@ -715,6 +2108,11 @@ template <typename TImageType, typename TCoordinate>
 void
 TileMontage<TImageType, TCoordinate>::GenerateData()
 {
+  if (m_ShardIndex >= m_ShardCount)
+  {
+    itkExceptionMacro("ShardIndex " << m_ShardIndex << " must be less than ShardCount " << m_ShardCount);
+  }
+
   // initialize mosaic bounds
   auto           input0 = static_cast<const ImageType *>(this->GetInput(0));
   ImageIndexType ind = input0->GetLargestPossibleRegion().GetIndex();
@@ -730,64 +2128,96 @@ TileMontage<TImageType, TCoordinate>::GenerateData()
     m_NumberOfPairs += (m_LinearMontageSize / m_MontageSize[d]) * (m_MontageSize[d] - 1);
   }
 
-  TileIndexType ind0;
-  ind0.Fill(0);
   m_FinishedPairs = 0;
-  m_CurrentAdjustments[0].Fill(0.0); // 0 translation by default
 
-  typename ThreadPool::Pointer pool = ThreadPool::GetInstance();
-  ThreadIdType                 tpThreads = pool->GetMaximumNumberOfThreads();
-  ThreadIdType                 workUnits = this->GetNumberOfWorkUnits();
-  if (tpThreads <= workUnits)
+  this->ClearPCMPool(); // in case the previous run was interrupted by an exception
+  m_FFTDiskCache = nullptr;
+  if (!m_FFTCacheDirectory.empty())
   {
-    pool->AddThreads(workUnits - tpThreads + 1);
+    m_FFTDiskCache = FFTDiskCacheType::New();
+    m_FFTDiskCache->SetDirectory(m_FFTCacheDirectory);
   }
 
-  std::vector<std::future<void>> futures(m_LinearMontageSize);
-  SizeValueType                  waited = 0;
-  for (SizeValueType i = 0; i < m_LinearMontageSize; i++)
+  // registrations of the pairs of unchanged tiles can be re-used
+  const bool incremental = m_IncrementalUpdate && m_RegisteredInputs.size() == m_LinearMontageSize &&
+                           m_RegistrationParameters == this->RegistrationParameters();
+
+  std::vector<bool> tileChanged(m_LinearMontageSize, true);
+  if (incremental)
   {
-    // filling ThreadPool's queue with more top-level jobs
-    // than there are threads causes dead-lock, so let's be conservative
-    if (i - waited >= workUnits)
+    for (SizeValueType i = 0; i < m_LinearMontageSize; i++)
     {
-      TileIndexType currentIndex = this->LinearIndexTonDIndex(waited);
-      futures[waited].get(); // waits for the computation to finish
-      this->ReleaseMemory(currentIndex);
-      // all registrations finished = 95% of total progress
-      this->UpdateProgress(m_FinishedPairs * 0.95 / m_NumberOfPairs);
-      ++waited;
+      tileChanged[i] = this->TileChanged(i);
     }
+  }
 
+  // register each tile to adjacent tiles along all dimensions (lower index only)
+  std::vector<SizeValueType> candidateIndices;
+  candidateIndices.reserve(m_NumberOfPairs);
+  for (SizeValueType i = 0; i < m_LinearMontageSize; i++)
+  {
     TileIndexType currentIndex = this->LinearIndexTonDIndex(i);
-    futures[i] = pool->AddWork([this, currentIndex]() {
-      // register i-th tile to adjacent tiles along all dimensions (lower index only)
-      TileIndexType currentTile = currentIndex; // we cannot modify currentIndex
-      for (unsigned regDim = 0; regDim < ImageDimension; regDim++)
+    for (unsigned regDim = 0; regDim < ImageDimension; regDim++)
+    {
+      if (currentIndex[regDim] > 0) // we are not at the edge along this dimension
       {
-        if (currentTile[regDim] > 0) // we are not at the edge along this dimension
+        const SizeValueType candidateIndex = i + regDim * m_LinearMontageSize;
+        m_DeterminedPairs[candidateIndex] = m_ProvidedPairs[candidateIndex] || this->IsPairInShard(candidateIndex);
+        if (m_ProvidedPairs[candidateIndex])
+        {
+          // read by ReadPairCandidates, OptimizeTiles of a previous Update might have pruned the working copy
+          m_TransformCandidates[candidateIndex] = m_ProvidedCandidates[candidateIndex];
+          m_CandidateConfidences[candidateIndex] = m_ProvidedConfidences[candidateIndex];
+          ++m_FinishedPairs;
+        }
+        else if (!m_DeterminedPairs[candidateIndex])
+        {
+          m_TransformCandidates[candidateIndex].clear(); // registered by another shard
+          m_CandidateConfidences[candidateIndex].clear();
+        }
+        else if (tileChanged[i] || tileChanged[this->ReferenceLinearIndex(candidateIndex)])
         {
-          TileIndexType referenceIndex = currentTile;
-          referenceIndex[regDim] = currentTile[regDim] - 1;
-          this->RegisterPair(referenceIndex, currentTile);
+          candidateIndices.push_back(candidateIndex);
+        }
+        else
+        {
+          m_TransformCandidates[candidateIndex] = m_RegisteredCandidates[candidateIndex];
+          m_CandidateConfidences[candidateIndex] = m_RegisteredConfidences[candidateIndex];
           ++m_FinishedPairs;
         }
       }
-    });
-    // optimize positions later, now just set the expected position (no translation)
-    m_CurrentAdjustments[waited].Fill(0.0);
+    }
+    if (!incremental)
+    {
+      // optimize positions later, now just set the expected position (no translation)
+      m_CurrentAdjustments[i].Fill(0.0);
+    }
+  }
+  {
+    MontageProfiler::Scope scope(m_Profiler, "RegisterPairs", "registration");
+    this->RegisterPairs(candidateIndices);
   }
 
-  for (SizeValueType i = waited; i < m_LinearMontageSize; i++)
+  this->ClearPCMPool();
+  m_FFTDiskCache = nullptr;
+
+  // kept for WritePairCandidates() and incremental updates
+  m_RegisteredCandidates = m_TransformCandidates;
+  m_RegisteredConfidences = m_CandidateConfidences;
+  if (m_IncrementalUpdate)
   {
-    TileIndexType currentIndex = this->LinearIndexTonDIndex(i);
-    futures[i].get(); // waits for the computation to finish
-    this->ReleaseMemory(currentIndex);
-    // all registrations finished = 95% of total progress
-    this->UpdateProgress(m_FinishedPairs * 0.95 / m_NumberOfPairs);
+    this->StoreRegistrations();
+  }
+  else // free the memory
+  {
+    m_RegisteredInputs.clear();
   }
 
-  this->OptimizeTiles();
+  if (m_ShardCount <= 1) // otherwise the pairs of the other shards are missing
+  {
+    MontageProfiler::Scope scope(m_Profiler, "OptimizeTiles", "optimization");
+    this->OptimizeTiles(incremental);
+  }
 
   // clear rest of the cache after montaging is finished
   RegionType reg0;
@@ -796,6 +2226,7 @@ TileMontage<TImageType, TCoordinate>::GenerateData()
     TileIndexType tileIndex = this->LinearIndexTonDIndex(i);
     WriteOutTransform(tileIndex, m_CurrentAdjustments[i]);
     m_FFTCache[i] = nullptr;
+    m_HalfFFTCache[i] = nullptr;
     if (!m_Filenames[i].empty()) // release the input image too
     {
       this->SetInputTile(tileIndex, m_Dummy);
@@ -18,6 +18,7 @@ itk_module(Montage
     ITKTransform
     ITKIOImageBase
     ITKImageFrequency
+    ITKImageGrid
     ITKDoubleConversion
   TEST_DEPENDS
     ITKIOTransformInsightLegacy
@@ -0,0 +1,211 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkMontageProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+// escapes the string for inclusion in JSON
+std::string
+JSONEscape(const std::string & text)
+{
+  std::ostringstream escaped;
+  for (char c : text)
+  {
+    switch (c)
+    {
+      case '"':
+        escaped << "\\\"";
+        break;
+      case '\\':
+        escaped << "\\\\";
+        break;
+      case '\n':
+        escaped << "\\n";
+        break;
+      case '\t':
+        escaped << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        }
+        else
+        {
+          escaped << c;
+        }
+    }
+  }
+  return escaped.str();
+}
+} // namespace
+
+namespace itk
+{
+MontageProfiler::MontageProfiler()
+  : m_Epoch(ClockType::now())
+{}
+
+void
+MontageProfiler::AddEvent(const std::string & name,
+                          const std::string & category,
+                          TimePoint           start,
+                          TimePoint           end,
+                          const std::string & details)
+{
+  using Microseconds = std::chrono::duration<double, std::micro>;
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto                        thread = m_Threads.emplace(std::this_thread::get_id(), m_Threads.size()).first;
+  m_Events.push_back({ name,
+                       category,
+                       details,
+                       Microseconds(start - m_Epoch).count(),
+                       Microseconds(end - start).count(),
+                       thread->second });
+}
+
+void
+MontageProfiler::AddToCounter(const std::string & name, double value)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Counters[name] += value;
+}
+
+double
+MontageProfiler::GetCounter(const std::string & name) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto                        it = m_Counters.find(name);
+  return it == m_Counters.end() ? 0.0 : it->second;
+}
+
+double
+MontageProfiler::GetTotalTime(const std::string & name) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  double                      total = 0.0;
+  for (const Event & event : m_Events)
+  {
+    if (event.Name == name)
+    {
+      total += event.Duration;
+    }
+  }
+  return total * 1e-6;
+}
+
+SizeValueType
+MontageProfiler::GetEventCount(const std::string & name) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  SizeValueType               count = 0;
+  for (const Event & event : m_Events)
+  {
+    count += (event.Name == name);
+  }
+  return count;
+}
+
+MontageProfiler::EventsType
+MontageProfiler::GetEvents() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Events;
+}
+
+void
+MontageProfiler::WriteChromeTrace(const std::string & fileName) const
+{
+  std::ofstream trace(fileName);
+  if (!trace)
+  {
+    itkExceptionMacro("Could not open " << fileName << " for writing");
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  trace << std::fixed << std::setprecision(3);
+  trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  double end = 0.0;
+  bool   first = true;
+  for (const Event & event : m_Events)
+  {
+    trace << (first ? "\n" : ",\n");
+    first = false;
+    trace << "{\"name\":\"" << JSONEscape(event.Name) << "\",\"cat\":\"" << JSONEscape(event.Category)
+          << "\",\"ph\":\"X\",\"ts\":" << event.Start << ",\"dur\":" << event.Duration << ",\"pid\":1,\"tid\":"
+          << event.Thread;
+    if (!event.Details.empty())
+    {
+      trace << ",\"args\":{\"details\":\"" << JSONEscape(event.Details) << "\"}";
+    }
+    trace << '}';
+    end = std::max(end, event.Start + event.Duration);
+  }
+  for (const auto & counter : m_Counters) // final values of the counters, at the end of the trace
+  {
+    trace << (first ? "\n" : ",\n");
+    first = false;
+    trace << "{\"name\":\"" << JSONEscape(counter.first) << "\",\"ph\":\"C\",\"ts\":" << end
+          << ",\"pid\":1,\"args\":{\"value\":" << counter.second << "}}";
+  }
+  trace << "\n]}\n";
+}
+
+void
+MontageProfiler::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Events.clear();
+  m_Counters.clear();
+  m_Threads.clear();
+  m_Epoch = ClockType::now();
+}
+
+void
+MontageProfiler::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  // total time and count per stage
+  std::map<std::string, std::pair<double, SizeValueType>> stages;
+  for (const Event & event : m_Events)
+  {
+    auto & stage = stages[event.Name];
+    stage.first += event.Duration * 1e-6;
+    ++stage.second;
+  }
+  os << indent << "Events: " << m_Events.size() << std::endl;
+  for (const auto & stage : stages)
+  {
+    os << indent.GetNextIndent() << stage.first << ": " << stage.second.first << " s in " << stage.second.second
+       << " events" << std::endl;
+  }
+  os << indent << "Counters: " << m_Counters.size() << std::endl;
+  for (const auto & counter : m_Counters)
+  {
+    os << indent.GetNextIndent() << counter.first << ": " << counter.second << std::endl;
+  }
+}
+} // namespace itk
@@ -0,0 +1,215 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkRawPixelDataLocation.h"
+#include "itksys/SystemTools.hxx"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+constexpr std::size_t MaximumHeaderSize = 1 << 16; // real headers are much smaller
+
+std::string
+Trim(const std::string & text)
+{
+  const std::size_t first = text.find_first_not_of(" \t\r");
+  if (first == std::string::npos)
+  {
+    return std::string();
+  }
+  return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool
+ParseInteger(const std::string & text, std::int64_t & value)
+{
+  char * end = nullptr;
+  value = std::strtoll(text.c_str(), &end, 10);
+  return end != text.c_str() && *end == '\0';
+}
+
+// relative data file names are relative to the header's directory
+std::string
+DataFilePath(const std::string & headerFileName, const std::string & dataFileName)
+{
+  if (itksys::SystemTools::FileIsFullPath(dataFileName))
+  {
+    return dataFileName;
+  }
+  const std::string directory = itksys::SystemTools::GetFilenamePath(headerFileName);
+  return directory.empty() ? dataFileName : directory + '/' + dataFileName;
+}
+
+// http://teem.sourceforge.net/nrrd/format.html
+bool
+LocateNrrdData(const std::string & fileName, std::istream & header, itk::RawPixelDataLocation & location)
+{
+  std::string  line, encoding, dataFile;
+  std::int64_t byteSkip = 0;
+  std::int64_t lineSkip = 0;
+  bool         headerEnded = false;
+  while (std::getline(header, line))
+  {
+    line = Trim(line);
+    if (line.empty())
+    {
+      headerEnded = true; // attached data follow
+      break;
+    }
+    const std::size_t colon = line.find(": ");
+    if (line[0] == '#' || colon == std::string::npos)
+    {
+      continue; // comment, key/value pair or malformed line
+    }
+    const std::string field = line.substr(0, colon);
+    const std::string value = Trim(line.substr(colon + 2));
+    if (field == "encoding")
+    {
+      encoding = value;
+    }
+    else if (field == "data file" || field == "datafile")
+    {
+      dataFile = value;
+    }
+    else if ((field == "byte skip" || field == "byteskip") && !ParseInteger(value, byteSkip))
+    {
+      return false;
+    }
+    else if ((field == "line skip" || field == "lineskip") && !ParseInteger(value, lineSkip))
+    {
+      return false;
+    }
+  }
+  if (encoding != "raw" || lineSkip != 0 || byteSkip < -1)
+  {
+    return false;
+  }
+
+  if (dataFile.empty()) // attached
+  {
+    const std::streamoff headerSize = header.tellg();
+    if (!headerEnded || headerSize < 0)
+    {
+      return false;
+    }
+    location.DataFileName = fileName;
+    location.Offset = byteSkip < 0 ? -1 : headerSize + byteSkip;
+  }
+  else
+  {
+    if (dataFile.find(' ') != std::string::npos || dataFile == "LIST")
+    {
+      return false; // data split into multiple files
+    }
+    location.DataFileName = DataFilePath(fileName, dataFile);
+    location.Offset = byteSkip;
+  }
+  return true;
+}
+
+// https://itk.org/Wiki/ITK/MetaIO/Documentation
+bool
+LocateMetaImageData(const std::string & fileName, std::istream & header, itk::RawPixelDataLocation & location)
+{
+  std::string  line;
+  std::int64_t headerSize = 0;
+  bool         isImage = false;
+  bool         isBinary = false; // ASCII pixel data otherwise
+  while (std::getline(header, line))
+  {
+    const std::size_t equals = line.find('=');
+    if (equals == std::string::npos)
+    {
+      return false; // not a MetaImage header
+    }
+    const std::string key = Trim(line.substr(0, equals));
+    const std::string value = Trim(line.substr(equals + 1));
+    if (key == "ObjectType")
+    {
+      isImage = (value == "Image");
+    }
+    else if (key == "BinaryData")
+    {
+      isBinary = (value == "True");
+    }
+    else if (key == "CompressedData" && value == "True")
+    {
+      return false;
+    }
+    else if (key == "HeaderSize" && !ParseInteger(value, headerSize))
+    {
+      return false;
+    }
+    else if (key == "ElementDataFile") // always the last field
+    {
+      if (!isImage || !isBinary)
+      {
+        return false;
+      }
+      if (value == "LIST" || value.find(' ') != std::string::npos || value.find('%') != std::string::npos)
+      {
+        return false; // data split into multiple files
+      }
+      if (value == "LOCAL")
+      {
+        const std::streamoff dataStart = header.tellg();
+        if (dataStart < 0)
+        {
+          return false;
+        }
+        location.DataFileName = fileName;
+        location.Offset = headerSize < 0 ? -1 : dataStart; // the data follow the header
+      }
+      else
+      {
+        location.DataFileName = DataFilePath(fileName, value);
+        location.Offset = headerSize < 0 ? -1 : headerSize;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+} // namespace
+
+namespace itk
+{
+bool
+LocateRawPixelData(const std::string & fileName, RawPixelDataLocation & location)
+{
+  std::ifstream file(fileName, std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+  std::string buffer(MaximumHeaderSize, '\0');
+  file.read(&buffer[0], buffer.size());
+  buffer.resize(file.gcount());
+
+  std::istringstream header(buffer);
+  if (buffer.compare(0, 4, "NRRD") == 0)
+  {
+    std::string magic;
+    std::getline(header, magic);
+    return LocateNrrdData(fileName, header, location);
+  }
+  return LocateMetaImageData(fileName, header, location);
+}
+} // namespace itk
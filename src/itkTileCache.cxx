@@ -0,0 +1,186 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkTileCache.h"
+
+#include "itksys/SystemTools.hxx"
+
+namespace itk
+{
+void
+TileCache::SetMemoryBudget(SizeValueType bytes)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (m_MemoryBudget != bytes)
+  {
+    m_MemoryBudget = bytes;
+    this->EvictOverBudget();
+    this->Modified();
+  }
+}
+
+SizeValueType
+TileCache::GetMemoryBudget() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_MemoryBudget;
+}
+
+std::string
+TileCache::MakeKey(const std::string & fileName, const std::type_info & imageType)
+{
+  // a file overwritten under the same name gets a new entry
+  return fileName + '|' + std::to_string(itksys::SystemTools::FileLength(fileName)) + '|' +
+         std::to_string(itksys::SystemTools::ModifiedTime(fileName)) + '|' + imageType.name();
+}
+
+DataObject::Pointer
+TileCache::Find(const std::string & key)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto                        it = m_Index.find(key);
+  if (it == m_Index.end())
+  {
+    return nullptr;
+  }
+  m_Entries.splice(m_Entries.begin(), m_Entries, it->second); // iterators remain valid
+  return it->second->Image;
+}
+
+void
+TileCache::Insert(const std::string & key, const std::string & fileName, DataObject * image, SizeValueType bytes)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto                        it = m_Index.find(key);
+  if (it != m_Index.end())
+  {
+    this->RemoveBytes(fileName, it->second->Bytes);
+    m_Entries.erase(it->second);
+    m_Index.erase(it);
+  }
+  m_Entries.push_front({ key, fileName, image, bytes });
+  m_Index.emplace(key, m_Entries.begin());
+  m_Size += bytes;
+  m_FileBytes[fileName] += bytes;
+  if (m_Pins.find(fileName) != m_Pins.end())
+  {
+    m_PinnedSize += bytes;
+  }
+  this->EvictOverBudget();
+}
+
+void
+TileCache::RemoveBytes(const std::string & fileName, SizeValueType bytes)
+{
+  m_Size -= bytes;
+  auto it = m_FileBytes.find(fileName);
+  if ((it->second -= bytes) == 0)
+  {
+    m_FileBytes.erase(it);
+  }
+  if (m_Pins.find(fileName) != m_Pins.end())
+  {
+    m_PinnedSize -= bytes;
+  }
+}
+
+void
+TileCache::EvictOverBudget()
+{
+  // pinned tiles do not count towards the budget
+  for (auto it = m_Entries.end(); it != m_Entries.begin() && m_Size > m_MemoryBudget + m_PinnedSize;)
+  {
+    --it;
+    if (m_Pins.find(it->FileName) != m_Pins.end())
+    {
+      continue;
+    }
+    this->RemoveBytes(it->FileName, it->Bytes);
+    m_Index.erase(it->Key);
+    it = m_Entries.erase(it);
+  }
+}
+
+void
+TileCache::Pin(const std::string & fileName)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if (++m_Pins[fileName] == 1)
+  {
+    auto it = m_FileBytes.find(fileName);
+    m_PinnedSize += it == m_FileBytes.end() ? 0 : it->second;
+  }
+}
+
+void
+TileCache::Unpin(const std::string & fileName)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  auto                        it = m_Pins.find(fileName);
+  if (it == m_Pins.end())
+  {
+    itkExceptionMacro("Tile " << fileName << " is not pinned");
+  }
+  if (--it->second == 0)
+  {
+    m_Pins.erase(it);
+    auto bytes = m_FileBytes.find(fileName);
+    m_PinnedSize -= bytes == m_FileBytes.end() ? 0 : bytes->second;
+    this->EvictOverBudget();
+  }
+}
+
+void
+TileCache::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Entries.clear();
+  m_Index.clear();
+  m_FileBytes.clear();
+  m_Size = 0;
+  m_PinnedSize = 0;
+  m_Hits = 0;
+  m_Misses = 0;
+}
+
+SizeValueType
+TileCache::GetSize() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Size;
+}
+
+SizeValueType
+TileCache::GetNumberOfEntries() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Entries.size();
+}
+
+void
+TileCache::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  os << indent << "MemoryBudget: " << m_MemoryBudget << std::endl;
+  os << indent << "Size: " << m_Size << std::endl;
+  os << indent << "Entries: " << m_Entries.size() << std::endl;
+  os << indent << "PinnedFiles: " << m_Pins.size() << std::endl;
+  os << indent << "Hits: " << m_Hits << std::endl;
+  os << indent << "Misses: " << m_Misses << std::endl;
+}
+} // namespace itk
@@ -0,0 +1,513 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMontageProfiler.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkNMinimaMaximaImageCalculator.h"
+#include "itkRGBPixel.h"
+#include "itkTileMergeImageFilter.h"
+#include "itkTileMontage.h"
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using RGBImageType = itk::Image<itk::RGBPixel<unsigned char>, Dimension>;
+using MontageType = itk::TileMontage<ImageType>;
+using PCMType = MontageType::PCMType;
+using PeakInterpolationMethod = itk::PhaseCorrelationOptimizerEnums::PeakInterpolationMethod;
+
+// one entry of the report: the time per iteration, and derived throughputs
+struct BenchmarkResult
+{
+  std::string                                 Name;
+  double                                      Seconds;
+  unsigned                                    Iterations;
+  std::vector<std::pair<std::string, double>> Metrics;
+};
+
+// peak resident set size of this process, in bytes
+double
+PeakResidentSetSize()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+  {
+    return double(counters.PeakWorkingSetSize);
+  }
+  return 0.0;
+#else
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#  if defined(__APPLE__)
+  return double(usage.ru_maxrss); // bytes
+#  else
+  return double(usage.ru_maxrss) * 1024.0; // kilobytes
+#  endif
+#endif
+}
+
+// registers a pair of tiles overlapping by 25%, the moving one displaced by 2 pixels along Y
+PCMType::Pointer
+RegisterPair(unsigned tileSize, PeakInterpolationMethod method)
+{
+  const auto           step = itk::IndexValueType(tileSize - tileSize / 4);
+  ImageType::IndexType fixedPosition = { { 0, 0 } };
+  ImageType::IndexType movingPosition = { { step, 2 } };
+  ImageType::IndexType movingOrigin = { { step, 0 } };
+
+  PCMType::Pointer pcm = PCMType::New();
+  pcm->SetOperator(MontageType::PCMOperatorType::New());
+  MontageType::PCMOptimizerType::Pointer optimizer = MontageType::PCMOptimizerType::New();
+  optimizer->SetPeakInterpolationMethod(method);
+  pcm->SetOptimizer(optimizer);
+  PCMType::SizeType pad;
+  pad.Fill(8 * sizeof(PixelType));
+  pcm->SetObligatoryPadding(pad);
+  pcm->SetReleaseDataBeforeUpdateFlag(false);
+  pcm->SetFixedImage(MakeTextureTile<ImageType>(fixedPosition, fixedPosition, tileSize));
+  pcm->SetMovingImage(MakeTextureTile<ImageType>(movingPosition, movingOrigin, tileSize));
+  pcm->Update();
+  return pcm;
+}
+
+BenchmarkResult
+BenchmarkOperator(unsigned tileSize, unsigned iterations)
+{
+  using OperatorType = MontageType::PCMOperatorType;
+  PCMType::Pointer      pcm = RegisterPair(tileSize, PeakInterpolationMethod::Parabolic);
+  OperatorType::Pointer op = OperatorType::New();
+  op->SetFixedImage(const_cast<PCMType::ComplexImageType *>(pcm->GetFixedImageFFT()));
+  op->SetMovingImage(const_cast<PCMType::ComplexImageType *>(pcm->GetMovingImageFFT()));
+  op->Update(); // allocates the output
+
+  itk::TimeProbe probe;
+  for (unsigned i = 0; i < iterations; i++)
+  {
+    op->Modified();
+    probe.Start();
+    op->Update();
+    probe.Stop();
+  }
+  const double pixels = op->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+  return { "PhaseCorrelationOperator",
+           probe.GetTotal() / iterations,
+           iterations,
+           { { "megapixels_per_second", pixels * iterations / probe.GetTotal() / 1e6 } } };
+}
+
+BenchmarkResult
+BenchmarkNMinimaMaxima(unsigned tileSize, unsigned iterations)
+{
+  using RealImageType = itk::Image<float, Dimension>;
+  using CalculatorType = itk::NMinimaMaximaImageCalculator<RealImageType>;
+  RealImageType::Pointer    image = RealImageType::New();
+  RealImageType::RegionType region;
+  region.SetSize(RealImageType::SizeType::Filled(2 * tileSize)); // like a padded correlation surface
+  image->SetRegions(region);
+  image->Allocate();
+  std::mt19937                                     rng(17);
+  std::uniform_real_distribution<float>            uniform(-1.0f, 1.0f);
+  itk::ImageRegionIteratorWithIndex<RealImageType> it(image, region);
+  for (; !it.IsAtEnd(); ++it)
+  {
+    it.Set(uniform(rng));
+  }
+
+  CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetImage(image);
+  calculator->SetN(16);
+  itk::TimeProbe probe;
+  for (unsigned i = 0; i < iterations; i++)
+  {
+    probe.Start();
+    calculator->Compute();
+    probe.Stop();
+  }
+  const double pixels = region.GetNumberOfPixels();
+  return { "NMinimaMaximaImageCalculator",
+           probe.GetTotal() / iterations,
+           iterations,
+           { { "megapixels_per_second", pixels * iterations / probe.GetTotal() / 1e6 } } };
+}
+
+// only the peak search and interpolation, on the correlation surface of a registered pair
+BenchmarkResult
+BenchmarkOptimizer(unsigned tileSize, unsigned iterations, PeakInterpolationMethod method)
+{
+  PCMType::Pointer                       pcm = RegisterPair(tileSize, method);
+  MontageType::PCMOptimizerType::Pointer optimizer = pcm->GetModifiableOptimizer();
+  itk::TimeProbe                         probe;
+  for (unsigned i = 0; i < iterations; i++)
+  {
+    optimizer->Modified();
+    probe.Start();
+    optimizer->Update();
+    probe.Stop();
+  }
+  std::ostringstream methodName;
+  methodName << method;
+  const std::string name = methodName.str();
+  return {
+    "PhaseCorrelationOptimizer/" + name.substr(name.rfind(':') + 1), probe.GetTotal() / iterations, iterations, {}
+  };
+}
+
+// global optimization of a gridSize x gridSize montage, from synthetic registrations
+// of which about 1% are outliers, with the correct translation as the second candidate
+BenchmarkResult
+BenchmarkOptimizeTiles(unsigned gridSize, bool useDirectSolver)
+{
+  constexpr unsigned    tileSize = 8; // the tiles are not registered
+  MontageType::Pointer  montage = MontageType::New();
+  MontageType::SizeType montageSize;
+  montageSize.Fill(gridSize);
+  montage->SetMontageSize(montageSize);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      ImageType::Pointer    tile = ImageType::New();
+      ImageType::RegionType region;
+      region.SetSize(ImageType::SizeType::Filled(tileSize));
+      tile->SetRegions(region);
+      tile->Allocate(true);
+      ImageType::PointType origin;
+      origin[0] = x * tileSize;
+      origin[1] = y * tileSize;
+      tile->SetOrigin(origin);
+      montage->SetInputTile({ { x, y } }, tile);
+    }
+  }
+
+  std::mt19937                           rng(gridSize);
+  std::normal_distribution<double>       noise(0.0, 0.05);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  unsigned                               outliers = 0;
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        const MontageType::TileIndexType tileIndex = { { x, y } };
+        if (tileIndex[d] == 0)
+        {
+          continue;
+        }
+        MontageType::PairOffsetsType::value_type translation; // a consistent drift, with noise
+        translation[0] = 1.0 + noise(rng);
+        translation[1] = -0.5 + noise(rng);
+        if (uniform(rng) < 0.01)
+        {
+          MontageType::PairOffsetsType::value_type outlier = translation;
+          outlier[d] += 10.0;
+          montage->SetPairCandidates(tileIndex, d, { outlier, translation }, { 1.0f, 0.5f });
+          ++outliers;
+        }
+        else
+        {
+          montage->SetPairCandidates(tileIndex, d, { translation }, { 1.0f });
+        }
+      }
+    }
+  }
+  montage->SetMaximumOutliersPerIteration(std::max(1u, outliers / 4));
+  montage->SetUseDirectSolver(useDirectSolver);
+  itk::MontageProfiler::Pointer profiler = itk::MontageProfiler::New();
+  montage->SetProfiler(profiler);
+  montage->Update();
+
+  const double tiles = double(gridSize) * gridSize;
+  const double seconds = profiler->GetTotalTime("OptimizeTiles");
+  return { "OptimizeTiles/" + std::to_string(gridSize * gridSize) + (useDirectSolver ? "/direct" : "/iterative"),
+           seconds,
+           1,
+           { { "tiles", tiles }, { "outliers", double(outliers) }, { "tiles_per_second", tiles / seconds } } };
+}
+
+// merges a gridSize x gridSize montage, at integer positions or at sub-pixel ones which need interpolation
+template <typename TImage, typename TAccumulate>
+BenchmarkResult
+BenchmarkMerge(const std::string & name, unsigned gridSize, unsigned tileSize, bool interpolated)
+{
+  using MergerType = itk::TileMergeImageFilter<TImage, TAccumulate>;
+  typename MergerType::Pointer  merger = MergerType::New();
+  typename MergerType::SizeType montageSize;
+  montageSize.Fill(gridSize);
+  merger->SetMontageSize(montageSize);
+  const unsigned step = tileSize - tileSize / 4;
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      ImageType::IndexType position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      const typename MergerType::TileIndexType tileIndex = { { x, y } };
+      merger->SetInputTile(tileIndex, MakeTextureTile<TImage>(position, position, tileSize));
+      typename MergerType::TransformType::Pointer          transform = MergerType::TransformType::New();
+      typename MergerType::TransformType::OutputVectorType offset;
+      offset[0] = interpolated ? 0.5 * ((x + y) % 2) : 0.0;
+      offset[1] = interpolated ? 0.25 * (y % 2) : 0.0;
+      transform->SetOffset(offset);
+      merger->SetTileTransform(tileIndex, transform);
+    }
+  }
+
+  itk::TimeProbe probe;
+  probe.Start();
+  merger->Update();
+  probe.Stop();
+  const double bytes =
+    double(merger->GetOutput()->GetBufferedRegion().GetNumberOfPixels()) * sizeof(typename TImage::PixelType);
+  return { name + (interpolated ? "/interpolated" : "/integer"),
+           probe.GetTotal(),
+           1,
+           { { "megabytes_per_second", bytes / probe.GetTotal() / 1e6 } } };
+}
+
+// registers and merges a gridSize x gridSize mosaic, the tiles displaced by up to 2 pixels
+std::vector<BenchmarkResult>
+BenchmarkEndToEnd(unsigned gridSize, unsigned tileSize)
+{
+  MontageType::Pointer  montage = MontageType::New();
+  MontageType::SizeType montageSize;
+  montageSize.Fill(gridSize);
+  montage->SetMontageSize(montageSize);
+  const unsigned                                     step = tileSize - tileSize / 4;
+  std::mt19937                                       rng(gridSize);
+  std::uniform_int_distribution<itk::IndexValueType> jitter(0, 2);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      ImageType::IndexType origin = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      ImageType::IndexType texturePosition = { { origin[0] + jitter(rng), origin[1] + jitter(rng) } };
+      montage->SetInputTile({ { x, y } }, MakeTextureTile<ImageType>(texturePosition, origin, tileSize));
+    }
+  }
+  itk::TimeProbe registrationProbe;
+  registrationProbe.Start();
+  montage->Update();
+  registrationProbe.Stop();
+
+  using MergerType = itk::TileMergeImageFilter<ImageType>;
+  MergerType::Pointer merger = MergerType::New();
+  merger->SetMontage(montage);
+  itk::TimeProbe mergeProbe;
+  mergeProbe.Start();
+  merger->Update();
+  mergeProbe.Stop();
+
+  const double tiles = double(gridSize) * gridSize;
+  const double pairs = 2.0 * gridSize * (gridSize - 1);
+  const double inputBytes = tiles * tileSize * tileSize * sizeof(PixelType);
+  const double outputBytes = double(merger->GetOutput()->GetBufferedRegion().GetNumberOfPixels()) * sizeof(PixelType);
+  const double registrationSeconds = registrationProbe.GetTotal();
+  const double mergeSeconds = mergeProbe.GetTotal();
+  const double totalSeconds = registrationSeconds + mergeSeconds;
+  const std::string size = std::to_string(gridSize) + "x" + std::to_string(gridSize) + "x" + std::to_string(tileSize);
+  return { { "EndToEnd/" + size + "/Registration",
+             registrationSeconds,
+             1,
+             { { "tiles_per_second", tiles / registrationSeconds },
+               { "pairs_per_second", pairs / registrationSeconds },
+               { "megabytes_per_second", inputBytes / registrationSeconds / 1e6 } } },
+           { "EndToEnd/" + size + "/Merge",
+             mergeSeconds,
+             1,
+             { { "tiles_per_second", tiles / mergeSeconds },
+               { "megabytes_per_second", outputBytes / mergeSeconds / 1e6 } } },
+           { "EndToEnd/" + size,
+             totalSeconds,
+             1,
+             { { "tiles_per_second", tiles / totalSeconds },
+               { "pairs_per_second", pairs / totalSeconds },
+               { "megabytes_per_second", inputBytes / totalSeconds / 1e6 },
+               { "peak_rss_bytes", PeakResidentSetSize() } } } };
+}
+
+// one benchmark per line, so the report can be compared with a baseline without a JSON parser
+void
+WriteReport(std::ostream & out, const std::vector<BenchmarkResult> & results)
+{
+  out << "{\n  \"peak_rss_bytes\": " << PeakResidentSetSize() << ",\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    out << "    {\"name\": \"" << results[i].Name << "\", \"seconds\": " << results[i].Seconds
+        << ", \"iterations\": " << results[i].Iterations;
+    for (const auto & metric : results[i].Metrics)
+    {
+      out << ", \"" << metric.first << "\": " << metric.second;
+    }
+    out << (i + 1 < results.size() ? "},\n" : "}\n");
+  }
+  out << "  ]\n}\n";
+}
+
+// reads the seconds of each benchmark from a report written by WriteReport(), returns false if it cannot be opened
+bool
+ReadReport(const std::string & fileName, std::map<std::string, double> & seconds)
+{
+  std::ifstream     in(fileName);
+  std::string       line;
+  const std::string nameKey = "\"name\": \"";
+  const std::string secondsKey = "\"seconds\": ";
+  if (!in)
+  {
+    return false;
+  }
+  while (std::getline(in, line))
+  {
+    const size_t namePos = line.find(nameKey);
+    const size_t secondsPos = line.find(secondsKey);
+    if (namePos != std::string::npos && secondsPos != std::string::npos)
+    {
+      const size_t nameStart = namePos + nameKey.size();
+      seconds[line.substr(nameStart, line.find('"', nameStart) - nameStart)] =
+        std::stod(line.substr(secondsPos + secondsKey.size()));
+    }
+  }
+  return true;
+}
+} // namespace
+
+// Runs microbenchmarks of the montage's hot paths, and end-to-end registration and merging
+// of a synthetic mosaic, writing the timings and throughputs to a JSON report.
+// If a baseline report is given, fails when a benchmark is slower than maxSlowdown times its baseline,
+// and when the baseline cannot be read or has none of the benchmarks of this run.
+int
+itkMontageBenchmarks(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0]
+              << " <report.json> [gridSize=4] [tileSize=128] [baseline.json [maxSlowdown=1.5]]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string reportFileName = argv[1];
+  unsigned          gridSize = 4;
+  unsigned          tileSize = 128;
+  double            maxSlowdown = 1.5;
+  if (argc > 2)
+  {
+    gridSize = std::stoul(argv[2]);
+  }
+  if (argc > 3)
+  {
+    tileSize = std::stoul(argv[3]);
+  }
+  if (argc > 5)
+  {
+    maxSlowdown = std::stod(argv[5]);
+  }
+
+  constexpr unsigned           iterations = 20;
+  std::vector<BenchmarkResult> results;
+  results.push_back(BenchmarkOperator(tileSize, iterations));
+  results.push_back(BenchmarkNMinimaMaxima(tileSize, iterations));
+  for (PeakInterpolationMethod method : itk::PhaseCorrelationOptimizerEnums::AllPeakInterpolationMethods())
+  {
+    results.push_back(BenchmarkOptimizer(tileSize, iterations, method));
+  }
+  for (unsigned optimizationGridSize : { 10, 32, 100 }) // 100, 1k and 10k tiles
+  {
+    for (bool useDirectSolver : { false, true })
+    {
+      results.push_back(BenchmarkOptimizeTiles(optimizationGridSize, useDirectSolver));
+    }
+  }
+  for (bool interpolated : { false, true })
+  {
+    using RGBAccumulateType = itk::RGBPixel<double>;
+    results.push_back(
+      BenchmarkMerge<ImageType, double>("TileMergeImageFilter/Scalar", gridSize, tileSize, interpolated));
+    results.push_back(
+      BenchmarkMerge<RGBImageType, RGBAccumulateType>("TileMergeImageFilter/RGB", gridSize, tileSize, interpolated));
+  }
+  for (BenchmarkResult & result : BenchmarkEndToEnd(gridSize, tileSize))
+  {
+    results.push_back(std::move(result));
+  }
+
+  WriteReport(std::cout, results);
+  std::ofstream report(reportFileName);
+  WriteReport(report, results);
+  if (!report)
+  {
+    std::cerr << "Could not write " << reportFileName << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int result = EXIT_SUCCESS;
+  if (argc > 4)
+  {
+    std::map<std::string, double> baseline;
+    if (!ReadReport(argv[4], baseline))
+    {
+      std::cerr << "Could not read the baseline " << argv[4] << std::endl;
+      return EXIT_FAILURE;
+    }
+    unsigned compared = 0;
+    for (const BenchmarkResult & current : results)
+    {
+      auto it = baseline.find(current.Name);
+      if (it == baseline.end())
+      {
+        continue;
+      }
+      ++compared;
+      if (current.Seconds > maxSlowdown * it->second)
+      {
+        std::cerr << current.Name << " took " << current.Seconds << " s, baseline " << it->second << " s" << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+    if (compared == 0) // e.g. a report of other sizes, or not a report at all
+    {
+      std::cerr << "None of the benchmarks of the baseline " << argv[4] << " match those of this run" << std::endl;
+      result = EXIT_FAILURE;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,150 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageFileWriter.h"
+#include "itkMontageProfiler.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkTestingMacros.h"
+#include "itkTileMontage.h"
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MontageType = itk::TileMontage<ImageType>;
+
+// the number of FFTs stored in the cache directory
+unsigned
+CountCachedFFTs(const std::string & directory)
+{
+  itksys::Directory dir;
+  unsigned          count = 0;
+  if (dir.Load(directory))
+  {
+    for (unsigned long f = 0; f < dir.GetNumberOfFiles(); f++)
+    {
+      count += itksys::SystemTools::GetFilenameLastExtension(dir.GetFile(f)) == ".fft";
+    }
+  }
+  return count;
+}
+} // namespace
+
+// Registers a montage of tiles read from files three times, each with a new montage
+// sharing an FFT cache directory: the first time all the FFTs are computed and written,
+// the second time all of them are read from the cache and the registrations are the same,
+// and the third time, after a tile file was overwritten, only the FFTs of that tile are computed.
+int
+itkMontageFFTDiskCacheTest(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << itkNameOfTestExecutableMacro(argv) << " <directoryForTilesAndCache>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string directory = argv[1];
+  const std::string cacheDirectory = directory + "/fftDiskCache";
+  itksys::SystemTools::RemoveADirectory(cacheDirectory); // left over from a previous run
+
+  constexpr unsigned            tileSize = 64;
+  constexpr unsigned            step = tileSize - tileSize / 4; // 25% overlap
+  const MontageType::SizeType   montageSize = { { 3, 3 } };
+  const itk::SizeValueType      tileCount = montageSize[0] * montageSize[1];
+  const itk::SizeValueType      pairCount = 2 * 3 * 2; // along each of the 2 dimensions, 3 rows of 2 pairs
+  std::vector<std::string>      filenames;
+  itk::MontageProfiler::Pointer profiler = itk::MontageProfiler::New();
+  for (unsigned y = 0; y < montageSize[1]; y++)
+  {
+    for (unsigned x = 0; x < montageSize[0]; x++)
+    {
+      ImageType::IndexType position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      filenames.push_back(directory + "/fftDiskCache_" + std::to_string(x) + "_" + std::to_string(y) + ".mha");
+      ITK_TRY_EXPECT_NO_EXCEPTION(itk::WriteImage(MakeTextureTile<ImageType>(position, tileSize), filenames.back()));
+    }
+  }
+
+  std::vector<MontageType::TransformConstPointer> transforms[3];
+  double                                          hits[3];
+  double                                          misses[3];
+  unsigned                                        cachedFFTs[3];
+  for (unsigned run = 0; run < 3; run++)
+  {
+    if (run == 2) // overwrite the first tile with the same pixels, only its modification time changes
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1100)); // the resolution may be a second
+      ITK_TRY_EXPECT_NO_EXCEPTION(itk::WriteImage(MakeTextureTile<ImageType>({ { 0, 0 } }, tileSize), filenames[0]));
+    }
+
+    profiler->Clear();
+    MontageType::Pointer montage = MontageType::New();
+    montage->SetMontageSize(montageSize);
+    montage->SetProfiler(profiler);
+    montage->SetFFTCacheDirectory(cacheDirectory);
+    for (itk::SizeValueType t = 0; t < tileCount; t++)
+    {
+      montage->SetInputTile(t, filenames[t]);
+    }
+    ITK_TRY_EXPECT_NO_EXCEPTION(montage->Update());
+    for (unsigned y = 0; y < montageSize[1]; y++)
+    {
+      for (unsigned x = 0; x < montageSize[0]; x++)
+      {
+        transforms[run].push_back(montage->GetOutputTransform({ { x, y } }));
+      }
+    }
+    hits[run] = profiler->GetCounter("FFTCacheHits");
+    misses[run] = profiler->GetCounter("FFTCacheMisses");
+    cachedFFTs[run] = CountCachedFFTs(cacheDirectory);
+    std::cout << "Run " << run << ": " << hits[run] << " FFT cache hits, " << misses[run] << " misses" << std::endl;
+  }
+
+  // each pair has its own overlap regions, so the FFTs of a run are not shared by its pairs
+  int result = EXIT_SUCCESS;
+  ITK_TEST_EXPECT_EQUAL(hits[0], 0);
+  ITK_TEST_EXPECT_EQUAL(misses[0], 2 * pairCount);
+  ITK_TEST_EXPECT_EQUAL(cachedFFTs[0], 2 * pairCount);
+  ITK_TEST_EXPECT_EQUAL(hits[1], 2 * pairCount);
+  ITK_TEST_EXPECT_EQUAL(misses[1], 0);
+  ITK_TEST_EXPECT_EQUAL(cachedFFTs[1], 2 * pairCount);
+  // the overwritten tile has a new key, in its two pairs, and its stale entries remain
+  ITK_TEST_EXPECT_EQUAL(hits[2], 2 * pairCount - 2);
+  ITK_TEST_EXPECT_EQUAL(misses[2], 2);
+  ITK_TEST_EXPECT_EQUAL(cachedFFTs[2], 2 * pairCount + 2);
+  for (unsigned run = 1; run < 3; run++)
+  {
+    for (itk::SizeValueType t = 0; t < tileCount; t++)
+    {
+      if (transforms[run][t]->GetOffset() != transforms[0][t]->GetOffset())
+      {
+        std::cerr << "Run " << run << ": tile " << t << " offset is " << transforms[run][t]->GetOffset()
+                  << ", instead of " << transforms[0][t]->GetOffset() << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
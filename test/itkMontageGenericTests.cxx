@@ -16,13 +16,19 @@
  *
  *=========================================================================*/
 
+#include "itkHalfPrecision.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkNMinimaMaximaImageCalculator.h"
 #include "itkPhaseCorrelationOptimizer.h"
 #include "itkPhaseCorrelationImageRegistrationMethod.h"
 #include "itkPhaseCorrelationOperator.h"
 #include "itkTestingMacros.h"
 #include "itkTileMergeImageFilter.h"
 #include "itkTileMontage.h"
+#include <algorithm>
 #include <iostream>
+#include <random>
 
 int
 itkMontageGenericTests(int, char ** const)
@@ -73,6 +79,110 @@ itkMontageGenericTests(int, char ** const)
   mtF->SetTileTransform(ind1, nullptr);
   mtF->SetTileTransform(ind2, nullptr);
   ITK_TEST_SET_GET_BOOLEAN(mtF, CropToFill, true);
+  tmF->SetFFTCacheDirectory("fftCache");
+  ITK_TEST_EXPECT_EQUAL(std::string(tmF->GetFFTCacheDirectory()), std::string("fftCache"));
+  ITK_TEST_SET_GET_BOOLEAN(tmF, UseDirectSolver, true);
+  ITK_TEST_SET_GET_BOOLEAN(tmF, HalfPrecisionFFTCache, true);
+  tmF->SetMaximumOutliersPerIteration(0); // clamped
+  ITK_TEST_SET_GET_VALUE(1u, tmF->GetMaximumOutliersPerIteration());
+  tmF->SetPeakConfidenceRatio(-1.0); // clamped
+  ITK_TEST_SET_GET_VALUE(0.0, tmF->GetPeakConfidenceRatio());
+  pcmOptimizer->SetPeakConfidenceRatio(2.5);
+  ITK_TEST_SET_GET_VALUE(2.5, pcmOptimizer->GetPeakConfidenceRatio());
+  tmF->SetSmallFFTSize(4096);
+  ITK_TEST_SET_GET_VALUE(4096, tmF->GetSmallFFTSize());
+  tmF->SetPrefetchCount(3);
+  ITK_TEST_SET_GET_VALUE(3, tmF->GetPrefetchCount());
+  tmF->SetPyramidWindowSize(128);
+  ITK_TEST_SET_GET_VALUE(128, tmF->GetPyramidWindowSize());
+  ITK_TRY_EXPECT_EXCEPTION(tmF->SetPyramidShrinkFactors({ 4, 0 })); // zero factor
+
+  // half precision conversions round to the nearest, ties to even
+  ITK_TEST_EXPECT_EQUAL(itk::FloatToHalf(1.0f), 0x3C00u);
+  ITK_TEST_EXPECT_EQUAL(itk::FloatToHalf(-2.0f), 0xC000u);
+  ITK_TEST_EXPECT_EQUAL(itk::FloatToHalf(1.0f + 1.5f / 1024), 0x3C02u); // tie rounded to even
+  ITK_TEST_EXPECT_EQUAL(itk::FloatToHalf(65504.0f), 0x7BFFu);           // the largest half
+  ITK_TEST_EXPECT_EQUAL(itk::FloatToHalf(65520.0f), 0x7C00u);           // infinity
+  ITK_TEST_EXPECT_EQUAL(itk::FloatToHalf(1e-9f), 0u);
+  for (unsigned half = 0; half < 0x7C00u; half++) // all finite non-negative halves, including subnormals
+  {
+    if (itk::FloatToHalf(itk::HalfToFloat(half)) != half)
+    {
+      std::cerr << "Half precision value " << half << " does not survive conversion to float and back" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // compare N maxima and minima to sorted pixel values
+  using SliceType = itk::Image<float, 2>;
+  SliceType::Pointer    slice = SliceType::New();
+  SliceType::RegionType sliceRegion({ 3, -2 }, { 37, 23 });
+  slice->SetRegions(sliceRegion);
+  slice->Allocate();
+  std::vector<float>                           sliceValues;
+  std::mt19937                                 rng(42);
+  itk::ImageRegionIteratorWithIndex<SliceType> sIt(slice, sliceRegion);
+  for (; !sIt.IsAtEnd(); ++sIt)
+  {
+    sIt.Set(rng() % 500); // with repeated values
+    sliceValues.push_back(sIt.Get());
+  }
+  using CalculatorType = itk::NMinimaMaximaImageCalculator<SliceType>;
+  CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetImage(slice);
+  calculator->SetN(9);
+  calculator->Compute();
+  std::sort(sliceValues.begin(), sliceValues.end());
+  for (unsigned i = 0; i < 9; i++)
+  {
+    ITK_TEST_EXPECT_EQUAL(calculator->GetMinima()[i], sliceValues[i]);
+    ITK_TEST_EXPECT_EQUAL(calculator->GetMaxima()[i], sliceValues[sliceValues.size() - 1 - i]);
+    ITK_TEST_EXPECT_EQUAL(slice->GetPixel(calculator->GetIndicesOfMaxima()[i]), calculator->GetMaxima()[i]);
+  }
+
+  // registering the pairs of small FFTs in parallel, and grouping the pairs by FFT size,
+  // gives the same transforms as registering the pairs in order
+  using TileImageType = itk::Image<unsigned short, 2>;
+  using TileMontageType = itk::TileMontage<TileImageType>;
+  constexpr unsigned               tileSize = 64;
+  constexpr unsigned               step = tileSize - tileSize / 4; // 25% overlap
+  const TileMontageType::SizeType  gridSize = { { 4, 3 } };
+  TileMontageType::PairOffsetsType inOrder;
+  for (itk::SizeValueType smallFFTSize : { 0u, 65536u, 1u }) // in order, all small, grouped but none small
+  {
+    TileMontageType::Pointer montage = TileMontageType::New();
+    montage->SetMontageSize(gridSize);
+    montage->SetSmallFFTSize(smallFFTSize);
+    for (unsigned y = 0; y < gridSize[1]; y++)
+    {
+      for (unsigned x = 0; x < gridSize[0]; x++)
+      {
+        const TileImageType::IndexType nominal = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+        TileImageType::IndexType       actual = nominal;
+        actual[0] += (x + y) % 3; // so the pairs have different offsets
+        actual[1] += (x * y) % 2;
+        montage->SetInputTile({ { x, y } }, MakeTextureTile<TileImageType>(actual, nominal, tileSize));
+      }
+    }
+    ITK_TRY_EXPECT_NO_EXCEPTION(montage->Update());
+    for (unsigned y = 0; y < gridSize[1]; y++)
+    {
+      for (unsigned x = 0; x < gridSize[0]; x++)
+      {
+        const auto offset = montage->GetOutputTransform({ { x, y } })->GetOffset();
+        if (smallFFTSize == 0)
+        {
+          inOrder.push_back(offset);
+        }
+        else if ((offset - inOrder[y * gridSize[0] + x]).GetNorm() > 1e-3)
+        {
+          std::cerr << "With SmallFFTSize " << smallFFTSize << ", the offset of tile " << x << ", " << y << " is "
+                    << offset << " instead of " << inOrder[y * gridSize[0] + x] << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,165 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageFileWriter.h"
+#include "itkMontageProfiler.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkTestingMacros.h"
+#include "itkTileMontage.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MontageType = itk::TileMontage<ImageType>;
+
+// compares the transforms of two montages, returns whether they match within the tolerance
+bool
+CompareTransforms(MontageType * a, MontageType * b, unsigned gridSize, double tolerance)
+{
+  bool match = true;
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      MontageType::TileIndexType tileIndex = { { x, y } };
+      auto                       aOffset = a->GetOutputTransform(tileIndex)->GetOffset();
+      auto                       bOffset = b->GetOutputTransform(tileIndex)->GetOffset();
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        if (std::abs(aOffset[d] - bOffset[d]) > tolerance)
+        {
+          std::cerr << "Tile " << tileIndex << ": offset " << aOffset << " differs from " << bOffset << std::endl;
+          match = false;
+          break;
+        }
+      }
+    }
+  }
+  return match;
+}
+} // namespace
+
+// Replaces a tile of a montage, in memory and by overwriting its file,
+// and compares the incremental updates to montaging all the tiles again.
+int
+itkMontageIncrementalTest(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << itkNameOfTestExecutableMacro(argv) << " <directoryForTiles>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string directory = argv[1];
+
+  constexpr unsigned tileSize = 64;
+  constexpr unsigned gridSize = 4;
+  constexpr unsigned step = tileSize - tileSize / 4; // 25% overlap
+
+  // only the pairs of the replaced tile with its 4 neighbors are registered again
+  constexpr itk::SizeValueType replacedPairs = 4;
+
+  itk::MontageProfiler::Pointer profiler = itk::MontageProfiler::New();
+  itk::TileCache::Pointer       tileCache = itk::TileCache::New();
+  MontageType::Pointer          incremental = MontageType::New();
+  MontageType::Pointer          fromFiles = MontageType::New();
+  MontageType::Pointer          full = MontageType::New();
+  MontageType::SizeType         montageSize;
+  montageSize.Fill(gridSize);
+  for (MontageType * montage : { incremental.GetPointer(), fromFiles.GetPointer(), full.GetPointer() })
+  {
+    montage->SetMontageSize(montageSize);
+    for (unsigned y = 0; y < gridSize; y++)
+    {
+      for (unsigned x = 0; x < gridSize; x++)
+      {
+        ImageType::IndexType       position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+        MontageType::TileIndexType tileIndex = { { x, y } };
+        if (montage == fromFiles.GetPointer())
+        {
+          const std::string filename =
+            directory + "/incremental_" + std::to_string(x) + "_" + std::to_string(y) + ".mha";
+          ITK_TRY_EXPECT_NO_EXCEPTION(itk::WriteImage(MakeTextureTile<ImageType>(position, tileSize), filename));
+          montage->SetInputTile(tileIndex, filename);
+        }
+        else
+        {
+          montage->SetInputTile(tileIndex, MakeTextureTile<ImageType>(position, tileSize));
+        }
+      }
+    }
+  }
+  ITK_TEST_SET_GET_BOOLEAN(incremental, IncrementalUpdate, true);
+  ITK_TEST_SET_GET_BOOLEAN(fromFiles, IncrementalUpdate, true);
+  incremental->SetProfiler(profiler);
+  fromFiles->SetProfiler(profiler);
+  fromFiles->SetTileCache(tileCache);
+  ITK_TRY_EXPECT_NO_EXCEPTION(incremental->Update());
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromFiles->Update());
+  ITK_TRY_EXPECT_NO_EXCEPTION(full->Update());
+
+  int result = EXIT_SUCCESS;
+  if (!CompareTransforms(incremental, full, gridSize, 1e-3) || !CompareTransforms(fromFiles, full, gridSize, 1e-3))
+  {
+    std::cerr << "Initial montages differ" << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // re-acquire one tile, which was displaced by the stage
+  MontageType::TileIndexType replaced = { { 2, 1 } };
+  ImageType::IndexType       nominal = { { itk::IndexValueType(2 * step), itk::IndexValueType(step) } };
+  ImageType::IndexType       displaced = { { nominal[0] + 3, nominal[1] - 2 } };
+  incremental->SetInputTile(replaced, MakeTextureTile<ImageType>(displaced, nominal, tileSize));
+  full->SetInputTile(replaced, MakeTextureTile<ImageType>(displaced, nominal, tileSize));
+  profiler->Clear();
+  ITK_TRY_EXPECT_NO_EXCEPTION(incremental->Update());
+  ITK_TEST_EXPECT_EQUAL(profiler->GetEventCount("RegisterPair"), replacedPairs);
+  ITK_TRY_EXPECT_NO_EXCEPTION(full->Update());
+
+  // warm start of the global optimization may converge to a marginally different solution
+  if (!CompareTransforms(incremental, full, gridSize, 1e-2))
+  {
+    std::cerr << "Incremental update differs from montaging all the tiles again" << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // overwrite the tile's file in place, with the same size, so only its modification time differs.
+  // Modification times may have a resolution of a second.
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  const std::string replacedFilename = directory + "/incremental_2_1.mha";
+  ITK_TRY_EXPECT_NO_EXCEPTION(
+    itk::WriteImage(MakeTextureTile<ImageType>(displaced, nominal, tileSize), replacedFilename));
+  fromFiles->SetInputTile(replaced, replacedFilename);
+  profiler->Clear();
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromFiles->Update());
+  ITK_TEST_EXPECT_EQUAL(profiler->GetEventCount("RegisterPair"), replacedPairs);
+  if (!CompareTransforms(fromFiles, full, gridSize, 1e-2))
+  {
+    std::cerr << "Incremental update after overwriting a tile's file differs from montaging all the tiles again"
+              << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
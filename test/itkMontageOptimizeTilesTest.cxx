@@ -0,0 +1,156 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkTestingMacros.h"
+#include "itkTileMontage.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MontageType = itk::TileMontage<ImageType>;
+
+constexpr unsigned gridSize = 8;
+constexpr unsigned tileSize = 8; // the tiles are not registered
+
+// a montage whose pairs' candidates are a consistent drift with noise, except for the outliers
+// of the pairs which are three tiles apart, whose second candidate is the drift
+MontageType::Pointer
+MakeMontage(bool useDirectSolver, unsigned maximumOutliersPerIteration, float absoluteThreshold)
+{
+  MontageType::Pointer  montage = MontageType::New();
+  MontageType::SizeType montageSize;
+  montageSize.Fill(gridSize);
+  montage->SetMontageSize(montageSize);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      ImageType::Pointer    tile = ImageType::New();
+      ImageType::RegionType region;
+      region.SetSize(ImageType::SizeType::Filled(tileSize));
+      tile->SetRegions(region);
+      tile->Allocate(true);
+      ImageType::PointType origin;
+      origin[0] = x * tileSize;
+      origin[1] = y * tileSize;
+      tile->SetOrigin(origin);
+      montage->SetInputTile({ { x, y } }, tile);
+    }
+  }
+
+  std::mt19937                     rng(gridSize);
+  std::normal_distribution<double> noise(0.0, 0.05);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        const MontageType::TileIndexType tileIndex = { { x, y } };
+        if (tileIndex[d] == 0)
+        {
+          continue;
+        }
+        MontageType::PairOffsetsType::value_type translation;
+        translation[0] = 1.0 + noise(rng);
+        translation[1] = -0.5 + noise(rng);
+        if (d == 0 && x % 3 == 1 && y % 3 == 1) // these pairs do not share tiles
+        {
+          MontageType::PairOffsetsType::value_type outlier = translation;
+          outlier[d] += 4.0;
+          montage->SetPairCandidates(tileIndex, d, { outlier, translation }, { 1.0f, 0.5f });
+        }
+        else
+        {
+          montage->SetPairCandidates(tileIndex, d, { translation }, { 1.0f });
+        }
+      }
+    }
+  }
+  montage->SetUseDirectSolver(useDirectSolver);
+  montage->SetMaximumOutliersPerIteration(maximumOutliersPerIteration);
+  montage->SetAbsoluteThreshold(absoluteThreshold);
+  return montage;
+}
+
+// the largest difference between the offsets of the montages' transforms
+double
+MaximumDifference(MontageType * a, MontageType * b)
+{
+  double maximum = 0.0;
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      const MontageType::TileIndexType tileIndex = { { x, y } };
+      const auto                       aOffset = a->GetOutputTransform(tileIndex)->GetOffset();
+      const auto                       bOffset = b->GetOutputTransform(tileIndex)->GetOffset();
+      maximum = std::max<double>(maximum, (aOffset - bOffset).GetNorm());
+    }
+  }
+  return maximum;
+}
+} // namespace
+
+// Optimizes the tile positions of a grid with synthetic outliers by the iterative and the direct solver,
+// replacing one or several outliers per iteration. Checks that the outliers are rejected,
+// and that all of them give the same positions.
+int
+itkMontageOptimizeTilesTest(int, char *[])
+{
+  MontageType::Pointer reference = MakeMontage(false, 1, 1.0f);
+  ITK_TRY_EXPECT_NO_EXCEPTION(reference->Update());
+  MontageType::Pointer kept = MakeMontage(false, 1, 1e6f); // no outliers are rejected
+  ITK_TRY_EXPECT_NO_EXCEPTION(kept->Update());
+
+  int result = EXIT_SUCCESS;
+  if (MaximumDifference(reference, kept) < 0.5)
+  {
+    std::cerr << "The outliers did not change the positions, or were not rejected" << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  const struct
+  {
+    bool     UseDirectSolver;
+    unsigned MaximumOutliersPerIteration;
+  } variants[] = { { true, 1 }, { false, 4 }, { true, 4 } };
+  for (const auto & variant : variants)
+  {
+    MontageType::Pointer montage = MakeMontage(variant.UseDirectSolver, variant.MaximumOutliersPerIteration, 1.0f);
+    ITK_TRY_EXPECT_NO_EXCEPTION(montage->Update());
+    const double difference = MaximumDifference(reference, montage);
+    std::cout << (variant.UseDirectSolver ? "Direct" : "Iterative") << " solver, "
+              << variant.MaximumOutliersPerIteration << " outliers per iteration: offsets differ by up to "
+              << difference << std::endl;
+    if (difference > 0.01)
+    {
+      std::cerr << "The offsets differ from those of the iterative solver replacing one outlier per iteration"
+                << std::endl;
+      result = EXIT_FAILURE;
+    }
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
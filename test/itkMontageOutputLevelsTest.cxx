@@ -0,0 +1,199 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageAlgorithm.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkTestingMacros.h"
+#include "itkTileMergeImageFilter.h"
+
+#include <cmath>
+#include <iostream>
+#include <mutex>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MergerType = itk::TileMergeImageFilter<ImageType>;
+
+// checks that each pixel of the level within its buffered region
+// is the rounded mean of the corresponding block of the previous level
+bool
+CheckLevel(const ImageType * fine, const ImageType * coarse)
+{
+  const ImageType::RegionType                       fineLargest = fine->GetLargestPossibleRegion();
+  itk::ImageRegionConstIteratorWithIndex<ImageType> it(coarse, coarse->GetBufferedRegion());
+  for (; !it.IsAtEnd(); ++it)
+  {
+    double   sum = 0.0;
+    unsigned count = 0;
+    for (unsigned y = 0; y < 2; y++)
+    {
+      for (unsigned x = 0; x < 2; x++)
+      {
+        ImageType::IndexType ind = fineLargest.GetIndex();
+        ind[0] += 2 * it.GetIndex()[0] + x;
+        ind[1] += 2 * it.GetIndex()[1] + y;
+        if (fineLargest.IsInside(ind))
+        {
+          sum += fine->GetPixel(ind);
+          ++count;
+        }
+      }
+    }
+    if (it.Get() != PixelType(std::round(sum / count)))
+    {
+      std::cerr << "Pixel " << it.GetIndex() << " is " << it.Get() << ", instead of " << std::round(sum / count)
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+// Merges a montage into three resolution levels at once, and checks the levels
+// against the full-resolution output, for the whole output, for a stripe,
+// and when the levels are passed chunk by chunk to a callback.
+int
+itkMontageOutputLevelsTest(int, char *[])
+{
+  constexpr unsigned         tileSize = 67; // odd sizes exercise the partial blocks
+  constexpr unsigned         step = tileSize - tileSize / 4;
+  constexpr unsigned         levels = 3;
+  const MergerType::SizeType montageSize = { { 3, 2 } };
+  MergerType::Pointer        merger = MergerType::New();
+  merger->SetMontageSize(montageSize);
+  ITK_TEST_EXPECT_EQUAL(merger->GetNumberOfOutputLevels(), 1u);
+  merger->SetNumberOfOutputLevels(levels);
+  ITK_TEST_SET_GET_VALUE(levels, merger->GetNumberOfOutputLevels());
+  for (unsigned y = 0; y < montageSize[1]; y++)
+  {
+    for (unsigned x = 0; x < montageSize[0]; x++)
+    {
+      ImageType::IndexType position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      merger->SetInputTile({ { x, y } }, MakeTextureTile<ImageType>(position, tileSize));
+      merger->SetTileTransform({ { x, y } }, MergerType::TransformType::New());
+    }
+  }
+  ITK_TRY_EXPECT_NO_EXCEPTION(merger->Update());
+
+  int                result = EXIT_SUCCESS;
+  ImageType::Pointer full[levels];
+  for (unsigned level = 0; level < levels; level++)
+  {
+    full[level] = merger->GetOutput(level);
+    ImageType::RegionType largest = full[level]->GetLargestPossibleRegion();
+    std::cout << "Level " << level << ": " << largest.GetSize() << ", spacing " << full[level]->GetSpacing()
+              << ", origin " << full[level]->GetOrigin() << std::endl;
+    ITK_TEST_EXPECT_EQUAL(full[level]->GetBufferedRegion(), largest);
+    ITK_TEST_EXPECT_EQUAL(full[level]->GetSpacing()[0], double(1u << level));
+    if (level > 0)
+    {
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        ITK_TEST_EXPECT_EQUAL(largest.GetSize(d), (full[level - 1]->GetLargestPossibleRegion().GetSize(d) + 1) / 2);
+      }
+      if (!CheckLevel(full[level - 1], full[level]))
+      {
+        result = EXIT_FAILURE;
+      }
+    }
+    full[level]->DisconnectPipeline();
+  }
+
+  // a stripe of the coarsest level is generated together with the corresponding stripes of the others
+  merger->UpdateOutputInformation(); // of the new outputs
+  ImageType::RegionType stripe = merger->GetOutput(levels - 1)->GetLargestPossibleRegion();
+  stripe.SetIndex(1, 5);
+  stripe.SetSize(1, 7);
+  merger->GetOutput(levels - 1)->SetRequestedRegion(stripe);
+  ITK_TRY_EXPECT_NO_EXCEPTION(merger->GetOutput(levels - 1)->Update());
+  for (unsigned level = 0; level < levels; level++)
+  {
+    const ImageType *           part = merger->GetOutput(level);
+    const ImageType::RegionType buffered = part->GetBufferedRegion();
+    const itk::IndexValueType   start = full[level]->GetLargestPossibleRegion().GetIndex(1);
+    ITK_TEST_EXPECT_EQUAL(buffered.GetIndex(1), start + itk::IndexValueType(5u << (levels - 1 - level)));
+    ITK_TEST_EXPECT_EQUAL(buffered.GetSize(1), 7u << (levels - 1 - level));
+    itk::ImageRegionConstIterator<ImageType> itPart(part, buffered);
+    itk::ImageRegionConstIterator<ImageType> itFull(full[level], buffered);
+    for (; !itPart.IsAtEnd(); ++itPart, ++itFull)
+    {
+      if (itPart.Get() != itFull.Get())
+      {
+        std::cerr << "Level " << level << " of the stripe differs from the whole level" << std::endl;
+        result = EXIT_FAILURE;
+        break;
+      }
+    }
+  }
+
+  // the levels passed chunk by chunk to a callback, which assembles them
+  constexpr unsigned chunkSize = 16;
+  ImageType::Pointer assembled[levels];
+  for (unsigned level = 0; level < levels; level++)
+  {
+    assembled[level] = ImageType::New();
+    assembled[level]->CopyInformation(full[level]);
+    assembled[level]->SetRegions(full[level]->GetLargestPossibleRegion());
+    assembled[level]->Allocate(true);
+  }
+  std::mutex         chunkMutex;
+  itk::SizeValueType chunkCount = 0;
+  bool               aligned = true;
+  merger->SetChunkSize(MergerType::SizeType::Filled(chunkSize));
+  ITK_TEST_SET_GET_VALUE(MergerType::SizeType::Filled(chunkSize), merger->GetChunkSize());
+  merger->SetChunkCallback([&](unsigned level, const ImageType * chunk) {
+    const ImageType::RegionType region = chunk->GetBufferedRegion();
+    const ImageType::RegionType largest = chunk->GetLargestPossibleRegion();
+    std::lock_guard<std::mutex> lock(chunkMutex);
+    ++chunkCount;
+    for (unsigned d = 0; d < Dimension; d++)
+    {
+      const itk::IndexValueType start = region.GetIndex(d) - largest.GetIndex(d);
+      const itk::IndexValueType end = start + itk::IndexValueType(region.GetSize(d));
+      const bool                atEdge = (end == itk::IndexValueType(largest.GetSize(d)));
+      const bool                complete = (region.GetSize(d) == chunkSize || atEdge);
+      aligned = aligned && start % itk::IndexValueType(chunkSize) == 0 && complete;
+    }
+    itk::ImageAlgorithm::Copy(chunk, assembled[level].GetPointer(), region, region);
+  });
+  ITK_TRY_EXPECT_NO_EXCEPTION(merger->UpdateLargestPossibleRegion());
+  std::cout << chunkCount << " chunks" << std::endl;
+  ITK_TEST_EXPECT_TRUE(aligned);
+  for (unsigned level = 0; level < levels; level++)
+  {
+    itk::ImageRegionConstIterator<ImageType> itAssembled(assembled[level], full[level]->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator<ImageType> itFull(full[level], full[level]->GetLargestPossibleRegion());
+    for (; !itAssembled.IsAtEnd(); ++itAssembled, ++itFull)
+    {
+      if (itAssembled.Get() != itFull.Get())
+      {
+        std::cerr << "Level " << level << " assembled from chunks differs from the whole level" << std::endl;
+        result = EXIT_FAILURE;
+        break;
+      }
+    }
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
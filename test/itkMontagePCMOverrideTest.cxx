@@ -0,0 +1,156 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkTestingMacros.h"
+#include "itkTileMontage.h"
+#include "itkVersion.h"
+
+#include <atomic>
+#include <iostream>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MontageType = itk::TileMontage<ImageType>;
+using PCMType = MontageType::PCMType;
+
+// stands in for an engine which keeps the FFTs on another device, and only returns the offsets
+class DeviceLikePCM : public PCMType
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(DeviceLikePCM);
+
+  using Self = DeviceLikePCM;
+  using Superclass = PCMType;
+  using Pointer = itk::SmartPointer<Self>;
+
+  itkNewMacro(Self);
+  itkTypeMacro(DeviceLikePCM, PhaseCorrelationImageRegistrationMethod);
+
+  static std::atomic<unsigned> Registrations;
+
+protected:
+  DeviceLikePCM() = default;
+
+  void
+  StartOptimization() override
+  {
+    Superclass::StartOptimization();
+    ++Registrations;
+    this->SetFixedImageFFT(nullptr);
+    this->SetMovingImageFFT(nullptr);
+  }
+};
+
+std::atomic<unsigned> DeviceLikePCM::Registrations{ 0 };
+
+class DeviceLikePCMFactory : public itk::ObjectFactoryBase
+{
+public:
+  ITK_DISALLOW_COPY_AND_MOVE(DeviceLikePCMFactory);
+
+  using Self = DeviceLikePCMFactory;
+  using Superclass = itk::ObjectFactoryBase;
+  using Pointer = itk::SmartPointer<Self>;
+
+  const char *
+  GetITKSourceVersion() const override
+  {
+    return ITK_SOURCE_VERSION;
+  }
+  const char *
+  GetDescription() const override
+  {
+    return "Phase correlation without forward FFTs on the host";
+  }
+
+  itkFactorylessNewMacro(Self);
+  itkTypeMacro(DeviceLikePCMFactory, ObjectFactoryBase);
+
+protected:
+  DeviceLikePCMFactory()
+  {
+    this->RegisterOverride(typeid(PCMType).name(),
+                           typeid(DeviceLikePCM).name(),
+                           "Phase correlation without forward FFTs on the host",
+                           true,
+                           itk::CreateObjectFunction<DeviceLikePCM>::New());
+  }
+};
+} // namespace
+
+// Overrides the phase correlation method through the object factory, with one
+// which does not provide the forward FFTs, and checks that TileMontage uses it
+// for every pair, copes with the missing FFTs and produces the same transforms.
+int
+itkMontagePCMOverrideTest(int, char *[])
+{
+  constexpr unsigned          tileSize = 64;
+  constexpr unsigned          step = tileSize - tileSize / 4; // 25% overlap
+  const MontageType::SizeType montageSize = { { 4, 3 } };
+  const unsigned              pairCount = 3 * 3 + 4 * 2;
+
+  MontageType::Pointer montages[2];
+  for (unsigned m = 0; m < 2; m++)
+  {
+    itk::ObjectFactoryBase::Pointer factory = DeviceLikePCMFactory::New();
+    if (m == 1)
+    {
+      itk::ObjectFactoryBase::RegisterFactory(factory);
+    }
+    montages[m] = MontageType::New();
+    montages[m]->SetMontageSize(montageSize);
+    montages[m]->SetCropToOverlap(false); // FFTs would be cached in memory
+    for (unsigned y = 0; y < montageSize[1]; y++)
+    {
+      for (unsigned x = 0; x < montageSize[0]; x++)
+      {
+        ImageType::IndexType       position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+        MontageType::TileIndexType tileIndex = { { x, y } };
+        montages[m]->SetInputTile(tileIndex, MakeTextureTile<ImageType>(position, tileSize));
+      }
+    }
+    ITK_TRY_EXPECT_NO_EXCEPTION(montages[m]->Update());
+    if (m == 1)
+    {
+      itk::ObjectFactoryBase::UnRegisterFactory(factory);
+    }
+  }
+  ITK_TEST_EXPECT_EQUAL(DeviceLikePCM::Registrations.load(), pairCount);
+
+  int result = EXIT_SUCCESS;
+  for (unsigned y = 0; y < montageSize[1]; y++)
+  {
+    for (unsigned x = 0; x < montageSize[0]; x++)
+    {
+      MontageType::TileIndexType tileIndex = { { x, y } };
+      auto                       expected = montages[0]->GetOutputTransform(tileIndex)->GetOffset();
+      auto                       actual = montages[1]->GetOutputTransform(tileIndex)->GetOffset();
+      if ((expected - actual).GetNorm() > 1e-3)
+      {
+        std::cerr << "Tile " << tileIndex << ": offset " << actual << " differs from " << expected << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
@@ -0,0 +1,193 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkMontageProfiler.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkPhaseCorrelationImageRegistrationMethod.h"
+#include "itkTileMontage.h"
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+} // namespace
+
+// Measures the per-pair overhead of registering small tiles, where construction
+// of the registration pipeline and allocation of its buffers dominate the run time.
+// Compares a new pipeline per pair to a single pipeline re-used for all the pairs,
+// and reports the per-pair time of TileMontage which re-uses its pipelines.
+int
+itkMontagePairOverheadBenchmark(int argc, char * argv[])
+{
+  unsigned tileSize = 32;
+  unsigned pairCount = 200;
+  unsigned gridSize = 8;
+  if (argc > 1)
+  {
+    tileSize = std::stoul(argv[1]);
+  }
+  if (argc > 2)
+  {
+    pairCount = std::stoul(argv[2]);
+  }
+  if (argc > 3)
+  {
+    gridSize = std::stoul(argv[3]);
+  }
+
+  using PCMType = itk::PhaseCorrelationImageRegistrationMethod<ImageType, ImageType>;
+  using RealType = PCMType::InternalPixelType;
+  using OperatorType = itk::PhaseCorrelationOperator<RealType, Dimension>;
+  using OptimizerType = itk::PhaseCorrelationOptimizer<RealType, Dimension>;
+  using FFTPointer = PCMType::ComplexImageType::Pointer;
+
+  const unsigned       step = tileSize - tileSize / 4; // 25% overlap
+  ImageType::IndexType fixedPosition = { { 0, 0 } };
+  ImageType::IndexType movingPosition = { { itk::IndexValueType(step), 2 } };
+  ImageType::Pointer   fixedImage = MakeTextureTile<ImageType>(fixedPosition, fixedPosition, tileSize, 17);
+  ImageType::Pointer   movingImage = MakeTextureTile<ImageType>(movingPosition, movingPosition, tileSize, 17);
+  ImageType::PointType expectedOrigin = fixedImage->GetOrigin();
+  expectedOrigin[0] += step;
+  movingImage->SetOrigin(expectedOrigin); // so a translation of 2 pixels along Y needs to be found
+
+  PCMType::SizeType pad;
+  pad.Fill(8 * sizeof(PixelType));
+
+  PCMType::OffsetVector freshOffsets;
+  itk::TimeProbe        freshProbe;
+  freshProbe.Start();
+  for (unsigned i = 0; i < pairCount; i++)
+  {
+    PCMType::Pointer pcm = PCMType::New();
+    pcm->SetOperator(OperatorType::New());
+    pcm->SetOptimizer(OptimizerType::New());
+    pcm->SetObligatoryPadding(pad);
+    pcm->SetFixedImage(fixedImage);
+    pcm->SetMovingImage(movingImage);
+    pcm->Update();
+    freshOffsets = pcm->GetOffsets();
+  }
+  freshProbe.Stop();
+
+  PCMType::Pointer pcm = PCMType::New();
+  pcm->SetOperator(OperatorType::New());
+  pcm->SetOptimizer(OptimizerType::New());
+  pcm->SetObligatoryPadding(pad);
+  pcm->SetReleaseDataBeforeUpdateFlag(false);
+  FFTPointer            fixedBuffer, movingBuffer;
+  PCMType::OffsetVector reusedOffsets;
+  itk::TimeProbe        reusedProbe;
+  reusedProbe.Start();
+  for (unsigned i = 0; i < pairCount; i++)
+  {
+    pcm->SetFixedImage(fixedImage);
+    pcm->SetMovingImage(movingImage);
+    pcm->SetFFTBuffers(fixedBuffer, movingBuffer);
+    pcm->Update();
+    reusedOffsets = pcm->GetOffsets();
+    fixedBuffer = const_cast<PCMType::ComplexImageType *>(pcm->GetFixedImageFFT());
+    movingBuffer = const_cast<PCMType::ComplexImageType *>(pcm->GetMovingImageFFT());
+    pcm->ReleaseInputs();
+  }
+  reusedProbe.Stop();
+
+  int result = EXIT_SUCCESS;
+  if (freshOffsets.size() != reusedOffsets.size())
+  {
+    std::cerr << "Re-used pipeline found " << reusedOffsets.size() << " peaks, while a new pipeline found "
+              << freshOffsets.size() << std::endl;
+    result = EXIT_FAILURE;
+  }
+  for (unsigned i = 0; i < std::min(freshOffsets.size(), reusedOffsets.size()); i++)
+  {
+    for (unsigned d = 0; d < Dimension; d++)
+    {
+      if (std::abs(freshOffsets[i][d] - reusedOffsets[i][d]) > 1e-3)
+      {
+        std::cerr << "Re-used pipeline's offset " << i << " is " << reusedOffsets[i]
+                  << ", while a new pipeline's offset is " << freshOffsets[i] << std::endl;
+        result = EXIT_FAILURE;
+        break;
+      }
+    }
+  }
+
+  // a montage of small tiles, registered by pooled pipelines
+  using MontageType = itk::TileMontage<ImageType>;
+  MontageType::Pointer  montage = MontageType::New();
+  MontageType::SizeType montageSize;
+  montageSize.Fill(gridSize);
+  montage->SetMontageSize(montageSize);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      ImageType::IndexType       position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      ImageType::Pointer         tile = MakeTextureTile<ImageType>(position, position, tileSize, 17);
+      MontageType::TileIndexType tileIndex = { { x, y } };
+      montage->SetInputTile(tileIndex, tile);
+    }
+  }
+  itk::TimeProbe montageProbe;
+  montageProbe.Start();
+  montage->Update();
+  montageProbe.Stop();
+  const unsigned montagePairs = 2 * gridSize * (gridSize - 1);
+
+  // the same montage again, with per-stage profiling
+  itk::MontageProfiler::Pointer profiler = itk::MontageProfiler::New();
+  montage->SetProfiler(profiler);
+  montage->Modified();
+  montage->Update();
+  if (profiler->GetEventCount("RegisterPair") != montagePairs || profiler->GetEventCount("PeakSearch") != montagePairs)
+  {
+    std::cerr << "Profiler recorded " << profiler->GetEventCount("RegisterPair") << " pair registrations and "
+              << profiler->GetEventCount("PeakSearch") << " peak searches, expected " << montagePairs << std::endl;
+    result = EXIT_FAILURE;
+  }
+  if (argc > 4)
+  {
+    profiler->WriteChromeTrace(argv[4]);
+  }
+  std::cout << "Stage totals for " << montagePairs << " pairs:" << std::endl;
+  for (const char * stage :
+       { "ReadTile", "Pad", "ForwardFFT", "Operator", "InverseFFT", "PeakSearch", "OptimizeTiles" })
+  {
+    std::cout << "  " << std::setw(13) << std::left << stage << std::right << std::setprecision(6)
+              << profiler->GetTotalTime(stage) << " s" << std::endl;
+  }
+
+  const double freshPerPair = freshProbe.GetTotal() * 1e6 / pairCount;
+  const double reusedPerPair = reusedProbe.GetTotal() * 1e6 / pairCount;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Tile size " << tileSize << ", " << pairCount << " pairs" << std::endl;
+  std::cout << "New pipeline per pair:    " << freshPerPair << " us per pair" << std::endl;
+  std::cout << "Re-used pipeline:         " << reusedPerPair << " us per pair" << std::endl;
+  std::cout << "Speedup: " << std::setprecision(2) << freshPerPair / reusedPerPair << std::endl;
+  std::cout << std::setprecision(1) << "TileMontage " << gridSize << "x" << gridSize << ": "
+            << montageProbe.GetTotal() * 1e6 / montagePairs << " us per pair (" << montagePairs << " pairs, "
+            << montage->GetNumberOfWorkUnits() << " work units)" << std::endl;
+
+  return result;
+}
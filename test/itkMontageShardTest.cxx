@@ -0,0 +1,223 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkMontageProfiler.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkTestingMacros.h"
+#include "itkTileMontage.h"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+using MontageType = itk::TileMontage<ImageType>;
+
+constexpr unsigned tileSize = 64;
+constexpr unsigned gridSize = 4;
+constexpr unsigned step = tileSize - tileSize / 4; // 25% overlap
+
+MontageType::Pointer
+MakeMontage(itk::MontageProfiler * profiler)
+{
+  MontageType::Pointer  montage = MontageType::New();
+  MontageType::SizeType montageSize;
+  montageSize.Fill(gridSize);
+  montage->SetMontageSize(montageSize);
+  montage->SetProfiler(profiler);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      ImageType::IndexType       position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      MontageType::TileIndexType tileIndex = { { x, y } };
+      montage->SetInputTile(tileIndex, MakeTextureTile<ImageType>(position, tileSize));
+    }
+  }
+  return montage;
+}
+} // namespace
+
+// Registers the pairs of a montage in two shards, each writing its registrations
+// to a file, and optimizes the tile positions from the registrations read from both.
+// Checks that this registers each pair once and gives the same transforms
+// as montaging in one go, and that mismatched files are rejected. Also checks that
+// the registrations written after optimization, which rejected an outlier, give
+// the same transforms when read back, also when updated again after changing the threshold.
+int
+itkMontageShardTest(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << itkNameOfTestExecutableMacro(argv) << " <directoryForPairCandidates>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string directory = argv[1];
+
+  itk::MontageProfiler::Pointer profiler = itk::MontageProfiler::New();
+  MontageType::Pointer          reference = MakeMontage(nullptr);
+  ITK_TRY_EXPECT_NO_EXCEPTION(reference->Update());
+
+  // rows 0 and 1 form the first shard, rows 2 and 3 the second one
+  const itk::SizeValueType shardPairs[2] = { 2 * (gridSize - 1) + gridSize, 2 * (gridSize - 1) + 2 * gridSize };
+  std::string              filenames[2];
+  int                      result = EXIT_SUCCESS;
+  for (unsigned shard = 0; shard < 2; shard++)
+  {
+    profiler->Clear();
+    MontageType::Pointer montage = MakeMontage(profiler);
+    montage->SetShardCount(2);
+    ITK_TEST_SET_GET_VALUE(2, montage->GetShardCount());
+    montage->SetShardIndex(shard);
+    ITK_TEST_SET_GET_VALUE(shard, montage->GetShardIndex());
+    ITK_TRY_EXPECT_NO_EXCEPTION(montage->Update());
+    ITK_TEST_EXPECT_EQUAL(profiler->GetEventCount("RegisterPair"), shardPairs[shard]);
+    filenames[shard] = directory + "/itkMontageShard" + std::to_string(shard) + ".bin";
+    ITK_TRY_EXPECT_NO_EXCEPTION(montage->WritePairCandidates(filenames[shard]));
+  }
+
+  profiler->Clear();
+  MontageType::Pointer gathered = MakeMontage(profiler);
+  for (const std::string & filename : filenames)
+  {
+    ITK_TRY_EXPECT_NO_EXCEPTION(gathered->ReadPairCandidates(filename));
+  }
+  ITK_TRY_EXPECT_NO_EXCEPTION(gathered->Update());
+  ITK_TEST_EXPECT_EQUAL(profiler->GetEventCount("RegisterPair"), 0);
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      MontageType::TileIndexType tileIndex = { { x, y } };
+      auto                       expected = reference->GetOutputTransform(tileIndex)->GetOffset();
+      auto                       actual = gathered->GetOutputTransform(tileIndex)->GetOffset();
+      if ((expected - actual).GetNorm() > 1e-6)
+      {
+        std::cerr << "Tile " << tileIndex << ": offset " << actual << " differs from " << expected << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  // the file has the registrations, not the candidates left after rejection of an outlier
+  MontageType::Pointer                     optimized = MakeMontage(nullptr);
+  MontageType::PairOffsetsType::value_type outlier, truth;
+  truth.Fill(0.0);
+  outlier = truth;
+  outlier[0] = 12.0;
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        MontageType::TileIndexType tileIndex = { { x, y } };
+        if (tileIndex[d] > 0 && x == 1 && y == 1 && d == 0)
+        {
+          optimized->SetPairCandidates(tileIndex, d, { outlier, truth }, { 1.0f, 1.0f });
+        }
+        else if (tileIndex[d] > 0)
+        {
+          optimized->SetPairCandidates(tileIndex, d, { truth }, { 1.0f });
+        }
+      }
+    }
+  }
+  ITK_TRY_EXPECT_NO_EXCEPTION(optimized->Update());
+  const std::string optimizedFilename = directory + "/itkMontageShardOptimized.bin";
+  ITK_TRY_EXPECT_NO_EXCEPTION(optimized->WritePairCandidates(optimizedFilename));
+  MontageType::Pointer reread = MakeMontage(nullptr);
+  ITK_TRY_EXPECT_NO_EXCEPTION(reread->ReadPairCandidates(optimizedFilename));
+  ITK_TRY_EXPECT_NO_EXCEPTION(reread->Update());
+  MontageType::Pointer kept = MakeMontage(nullptr);
+  kept->SetAbsoluteThreshold(1e6); // no outliers are rejected
+  ITK_TRY_EXPECT_NO_EXCEPTION(kept->ReadPairCandidates(optimizedFilename));
+  ITK_TRY_EXPECT_NO_EXCEPTION(kept->Update());
+  for (unsigned y = 0; y < gridSize; y++)
+  {
+    for (unsigned x = 0; x < gridSize; x++)
+    {
+      MontageType::TileIndexType tileIndex = { { x, y } };
+      auto                       expected = optimized->GetOutputTransform(tileIndex)->GetOffset();
+      auto                       actual = reread->GetOutputTransform(tileIndex)->GetOffset();
+      if ((expected - actual).GetNorm() > 1e-6)
+      {
+        std::cerr << "Re-read tile " << tileIndex << ": offset " << actual << " differs from " << expected
+                  << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+  const auto withOutlier = kept->GetOutputTransform({ { 1, 1 } })->GetOffset();
+  const auto withoutOutlier = optimized->GetOutputTransform({ { 1, 1 } })->GetOffset();
+  if ((withOutlier - withoutOutlier).GetNorm() < 1.0)
+  {
+    std::cerr << "The outlier is missing from " << optimizedFilename << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // the second Update starts again from the read candidates, not from those left by the first one
+  reread->SetAbsoluteThreshold(1e6);
+  ITK_TRY_EXPECT_NO_EXCEPTION(reread->Update());
+  const auto updatedAgain = reread->GetOutputTransform({ { 1, 1 } })->GetOffset();
+  if ((updatedAgain - withOutlier).GetNorm() > 1e-6)
+  {
+    std::cerr << "Updated again, tile [1, 1]: offset " << updatedAgain << " differs from " << withOutlier << std::endl;
+    result = EXIT_FAILURE;
+  }
+  const std::string rewrittenFilename = directory + "/itkMontageShardRewritten.bin";
+  ITK_TRY_EXPECT_NO_EXCEPTION(reread->WritePairCandidates(rewrittenFilename));
+  MontageType::Pointer rewritten = MakeMontage(nullptr);
+  rewritten->SetAbsoluteThreshold(1e6);
+  ITK_TRY_EXPECT_NO_EXCEPTION(rewritten->ReadPairCandidates(rewrittenFilename));
+  ITK_TRY_EXPECT_NO_EXCEPTION(rewritten->Update());
+  if ((rewritten->GetOutputTransform({ { 1, 1 } })->GetOffset() - withOutlier).GetNorm() > 1e-6)
+  {
+    std::cerr << "The outlier is missing from " << rewrittenFilename << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // pairs of the cleared candidates are registered again
+  gathered->ClearPairCandidates();
+  profiler->Clear();
+  ITK_TRY_EXPECT_NO_EXCEPTION(gathered->Update());
+  ITK_TEST_EXPECT_EQUAL(profiler->GetEventCount("RegisterPair"), 2 * gridSize * (gridSize - 1));
+
+  MontageType::Pointer invalid = MakeMontage(nullptr);
+  invalid->SetShardCount(2);
+  invalid->SetShardIndex(2);
+  ITK_TRY_EXPECT_EXCEPTION(invalid->Update());
+  invalid->SetPositionTolerance(5); // registrations would differ
+  ITK_TRY_EXPECT_EXCEPTION(invalid->ReadPairCandidates(filenames[0]));
+  ITK_TRY_EXPECT_EXCEPTION(invalid->ReadPairCandidates(directory + "/itkMontageShardMissing.bin"));
+  MontageType::SizeType smallerSize = { { gridSize, gridSize - 1 } };
+  invalid->SetPositionTolerance(0);
+  invalid->SetMontageSize(smallerSize);
+  ITK_TRY_EXPECT_EXCEPTION(invalid->ReadPairCandidates(filenames[0]));
+  ITK_TRY_EXPECT_EXCEPTION(invalid->SetPairCandidates({ { 1, gridSize - 1 } }, 0, { truth }, { 1.0f }));
+  ITK_TRY_EXPECT_EXCEPTION(invalid->SetPairCandidates({ { 0, 1 } }, 0, { truth }, { 1.0f }));
+  ITK_TRY_EXPECT_EXCEPTION(invalid->SetPairCandidates({ { 1, 1 } }, 1, { truth, outlier }, { 1.0f }));
+  MontageType::Pointer unsized = MontageType::New(); // of the default size, before SetMontageSize
+  ITK_TRY_EXPECT_EXCEPTION(unsized->SetPairCandidates({ { 1, 1 } }, 1, { truth }, { 1.0f }));
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
@@ -75,6 +75,11 @@ itkMontageTestHelper2(int                               argc,
   {
     writeImage = std::stoi(argv[12]);
   }
+  unsigned pyramidShrinkFactor = 1;
+  if (argc > 13)
+  {
+    pyramidShrinkFactor = std::stoul(argv[13]);
+  }
 
   int r1, r2 = EXIT_SUCCESS;
   r1 = montageTest<PixelType, AccumulatePixelType>(stageTiles,
@@ -88,7 +93,8 @@ itkMontageTestHelper2(int                               argc,
                                                    writeTransforms,
                                                    allowDrift,
                                                    positionTolerance,
-                                                   writeImage);
+                                                   writeImage,
+                                                   pyramidShrinkFactor);
   if (doPairs)
   {
     r2 = pairwiseTests<typename itk::NumericTraits<PixelType>::ValueType>(
@@ -109,7 +109,8 @@ montageTest(const itk::TileConfiguration<Dimension> & stageTiles,
             bool                                      writeTransformFiles,
             bool                                      allowDrift,
             unsigned                                  positionTolerance,
-            bool                                      writeImage)
+            bool                                      writeImage,
+            unsigned                                  pyramidShrinkFactor = 1)
 {
   int result = EXIT_SUCCESS;
   using ScalarPixelType = typename itk::NumericTraits<PixelType>::ValueType;
@@ -212,6 +213,10 @@ montageTest(const itk::TileConfiguration<Dimension> & stageTiles,
     typename MontageType::Pointer montage = MontageType::New();
     montage->SetPaddingMethod(paddingMethod);
     montage->SetPositionTolerance(positionTolerance);
+    if (pyramidShrinkFactor > 1)
+    {
+      montage->SetPyramidShrinkFactors({ pyramidShrinkFactor });
+    }
     montage->SetMontageSize(stageTiles.AxisSizes);
     if (!loadIntoMemory)
     {
@@ -0,0 +1,85 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef itkMontageTextureTileHelper_hxx
+#define itkMontageTextureTileHelper_hxx
+
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkRGBPixel.h"
+
+#include <random>
+
+// sets a pixel of the random texture from its random value
+template <typename TPixel>
+void
+SetTextureValue(TPixel & pixel, unsigned value)
+{
+  pixel = static_cast<TPixel>(value);
+}
+
+template <typename TComponent>
+void
+SetTextureValue(itk::RGBPixel<TComponent> & pixel, unsigned value)
+{
+  pixel.Set(value & 255, (value >> 4) & 255, (value >> 2) & 255);
+}
+
+// cuts a tile at texturePosition out of a random texture, and places it at origin.
+// The texture value depends only on the pixel's position within the texture (and the seed),
+// so the tiles cut out of the same texture overlap consistently.
+template <typename TImage>
+typename TImage::Pointer
+MakeTextureTile(const typename TImage::IndexType & texturePosition,
+                const typename TImage::IndexType & origin,
+                unsigned                           tileSize,
+                unsigned                           textureSeed = 0)
+{
+  static_assert(TImage::ImageDimension == 2, "the random texture is two-dimensional");
+  typename TImage::Pointer    tile = TImage::New();
+  typename TImage::RegionType region;
+  region.SetSize(TImage::SizeType::Filled(tileSize));
+  tile->SetRegions(region);
+  tile->Allocate();
+  typename TImage::PointType physicalOrigin;
+  for (unsigned d = 0; d < TImage::ImageDimension; d++)
+  {
+    physicalOrigin[d] = origin[d];
+  }
+  tile->SetOrigin(physicalOrigin);
+
+  itk::ImageRegionIteratorWithIndex<TImage> it(tile, region);
+  for (; !it.IsAtEnd(); ++it)
+  {
+    typename TImage::IndexType ind = it.GetIndex();
+    std::minstd_rand rng(textureSeed + 7919u * (ind[0] + texturePosition[0]) + 104729u * (ind[1] + texturePosition[1]));
+    rng.discard(3);
+    SetTextureValue(it.Value(), rng() % 4096);
+  }
+  return tile;
+}
+
+// cuts a tile out of a random texture, placing it at its position within the texture
+template <typename TImage>
+typename TImage::Pointer
+MakeTextureTile(const typename TImage::IndexType & position, unsigned tileSize)
+{
+  return MakeTextureTile<TImage>(position, position, tileSize);
+}
+
+#endif // itkMontageTextureTileHelper_hxx
@@ -0,0 +1,233 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkMontageProfiler.h"
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkRawPixelDataLocation.h"
+#include "itkTestingMacros.h"
+#include "itkTileCache.h"
+#include "itkTileMergeImageFilter.h"
+#include "itkTileMontage.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+} // namespace
+
+// Registers and merges a montage of tiles read from files, without and with
+// a shared tile cache, with prefetching and with memory-mapped tiles. Checks that
+// the results are the same, that the cache reads each tile only once,
+// and that mapped tiles are not read at all. Also checks that registering whole tiles
+// with the in-memory FFT cache in half precision hardly changes the registrations.
+int
+itkMontageTileCacheTest(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << itkNameOfTestExecutableMacro(argv) << " <directoryForTiles>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string directory = argv[1];
+
+  using MontageType = itk::TileMontage<ImageType, float>;
+  using MergerType = itk::TileMergeImageFilter<ImageType>;
+  constexpr unsigned            tileSize = 64;
+  constexpr unsigned            step = tileSize - tileSize / 4; // 25% overlap
+  const MontageType::SizeType   montageSize = { { 4, 3 } };
+  const itk::SizeValueType      tileCount = montageSize[0] * montageSize[1];
+  const double                  tileBytes = double(tileSize) * tileSize * sizeof(PixelType);
+  std::vector<std::string>      filenames;
+  itk::TileCache::Pointer       cache = itk::TileCache::New();
+  itk::MontageProfiler::Pointer profiler = itk::MontageProfiler::New();
+  ITK_EXERCISE_BASIC_OBJECT_METHODS(cache, TileCache, Object);
+  for (unsigned y = 0; y < montageSize[1]; y++)
+  {
+    for (unsigned x = 0; x < montageSize[0]; x++)
+    {
+      ImageType::IndexType position = { { itk::IndexValueType(x * step), itk::IndexValueType(y * step) } };
+      filenames.push_back(directory + "/tile_" + std::to_string(x) + "_" + std::to_string(y) + ".mhd");
+      ITK_TRY_EXPECT_NO_EXCEPTION(itk::WriteImage(MakeTextureTile<ImageType>(position, tileSize), filenames.back()));
+    }
+  }
+
+  enum Variant
+  {
+    Plain,
+    Cached,
+    Prefetched,
+    Mapped,
+    Uncropped,
+    HalfPrecision
+  };
+  const char * variantNames[] = { "Plain", "Cached", "Prefetched", "Mapped", "Uncropped", "HalfPrecision" };
+
+  ImageType::Pointer                              merged[6];
+  std::vector<MontageType::TransformConstPointer> transforms[6];
+  double                                          bytesRead[6];
+  double                                          fftMisses[6];
+  for (Variant variant : { Plain, Cached, Prefetched, Mapped, Uncropped, HalfPrecision })
+  {
+    profiler->Clear();
+    MontageType::Pointer montage = MontageType::New();
+    montage->SetMontageSize(montageSize);
+    montage->SetProfiler(profiler);
+    if (variant == Cached)
+    {
+      montage->SetTileCache(cache);
+    }
+    if (variant == Prefetched)
+    {
+      montage->SetPrefetchCount(3);
+    }
+    montage->SetMemoryMapTiles(variant == Mapped);
+    montage->SetCropToOverlap(variant != Uncropped && variant != HalfPrecision);
+    montage->SetHalfPrecisionFFTCache(variant == HalfPrecision);
+    for (itk::SizeValueType t = 0; t < tileCount; t++)
+    {
+      montage->SetInputTile(t, filenames[t]);
+    }
+    ITK_TRY_EXPECT_NO_EXCEPTION(montage->Update());
+
+    MergerType::Pointer merger = MergerType::New();
+    merger->SetMontage(montage); // also takes over the tile cache and memory mapping
+    merger->SetProfiler(profiler);
+    ITK_TRY_EXPECT_NO_EXCEPTION(merger->Update());
+    merged[variant] = merger->GetOutput();
+    for (unsigned y = 0; y < montageSize[1]; y++)
+    {
+      for (unsigned x = 0; x < montageSize[0]; x++)
+      {
+        transforms[variant].push_back(montage->GetOutputTransform({ { x, y } }));
+      }
+    }
+
+    bytesRead[variant] = profiler->GetCounter("BytesRead");
+    fftMisses[variant] = profiler->GetCounter("FFTCacheMisses");
+    std::cout << variantNames[variant] << ": " << bytesRead[variant] / tileBytes << " tiles read, "
+              << montage->GetPrefetchStalls() << " prefetch stalls" << std::endl;
+  }
+
+  int result = EXIT_SUCCESS;
+  if (bytesRead[Cached] != tileCount * tileBytes)
+  {
+    std::cerr << "With the tile cache " << bytesRead[Cached] << " bytes were read, expected " << tileCount * tileBytes
+              << std::endl;
+    result = EXIT_FAILURE;
+  }
+  if (bytesRead[Mapped] != 0) // uncompressed MetaImage files with the image's pixel type
+  {
+    std::cerr << "With memory mapping " << bytesRead[Mapped] << " bytes were read" << std::endl;
+    result = EXIT_FAILURE;
+  }
+  for (Variant variant : { Uncropped, HalfPrecision }) // tiles' FFTs are shared by their pairs
+  {
+    if (fftMisses[variant] != tileCount)
+    {
+      std::cerr << variantNames[variant] << ": " << fftMisses[variant] << " forward FFTs were computed, expected "
+                << tileCount << std::endl;
+      result = EXIT_FAILURE;
+    }
+  }
+  ITK_TEST_EXPECT_EQUAL(cache->GetNumberOfEntries(), tileCount);
+  itk::RawPixelDataLocation location;
+  ITK_TEST_EXPECT_TRUE(itk::LocateRawPixelData(filenames[0], location));
+  ITK_TEST_EXPECT_EQUAL(location.DataFileName, filenames[0].substr(0, filenames[0].size() - 3) + "raw");
+  ITK_TEST_EXPECT_EQUAL(location.Offset, 0);
+  const std::string asciiFileName = directory + "/tile_ascii.mha"; // pixels stored as text
+  {
+    std::ofstream ascii(asciiFileName);
+    ascii << "ObjectType = Image\nNDims = 2\nBinaryData = False\nDimSize = 2 2\n"
+          << "ElementType = MET_USHORT\nElementDataFile = LOCAL\n1 2\n3 4\n";
+  }
+  ITK_TEST_EXPECT_TRUE(!itk::LocateRawPixelData(asciiFileName, location));
+  for (Variant variant : { Cached, Prefetched, Mapped })
+  {
+    for (itk::SizeValueType t = 0; t < tileCount; t++)
+    {
+      if (transforms[Plain][t]->GetOffset() != transforms[variant][t]->GetOffset())
+      {
+        std::cerr << variantNames[variant] << ": tile " << t << " offset is " << transforms[variant][t]->GetOffset()
+                  << ", instead of " << transforms[Plain][t]->GetOffset() << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+    ITK_TEST_EXPECT_EQUAL(merged[Plain]->GetLargestPossibleRegion(), merged[variant]->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator<ImageType> it0(merged[Plain], merged[Plain]->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator<ImageType> it1(merged[variant], merged[Plain]->GetLargestPossibleRegion());
+    for (; !it0.IsAtEnd(); ++it0, ++it1)
+    {
+      if (it0.Get() != it1.Get())
+      {
+        std::cerr << variantNames[variant] << ": merged images differ" << std::endl;
+        result = EXIT_FAILURE;
+        break;
+      }
+    }
+  }
+
+  for (itk::SizeValueType t = 0; t < tileCount; t++)
+  {
+    const MontageType::TransformType::OutputVectorType difference =
+      transforms[HalfPrecision][t]->GetOffset() - transforms[Uncropped][t]->GetOffset();
+    if (difference.GetNorm() > 0.1)
+    {
+      std::cerr << "HalfPrecision: tile " << t << " offset is " << transforms[HalfPrecision][t]->GetOffset()
+                << ", instead of " << transforms[Uncropped][t]->GetOffset() << std::endl;
+      result = EXIT_FAILURE;
+    }
+  }
+
+  // least recently used unpinned tiles are evicted to meet the budget
+  cache->SetMemoryBudget(itk::SizeValueType(2.5 * tileBytes));
+  ITK_TEST_EXPECT_EQUAL(cache->GetNumberOfEntries(), 2u);
+  cache->Clear();
+  ImageType::Pointer tile = MakeTextureTile<ImageType>({ { 0, 0 } }, tileSize);
+  cache->Pin(filenames[0]);
+  for (itk::SizeValueType t = 0; t < 4; t++)
+  {
+    cache->AddImage(filenames[t], tile.GetPointer());
+  }
+  ITK_TEST_EXPECT_EQUAL(cache->GetNumberOfEntries(), 3u); // filenames[0] is pinned and does not count
+  ITK_TEST_EXPECT_TRUE(cache->GetImage<ImageType>(filenames[0], tile->GetBufferedRegion()).IsNotNull());
+  ITK_TEST_EXPECT_TRUE(cache->GetImage<ImageType>(filenames[1], ImageType::RegionType()).IsNull());
+  ITK_TEST_EXPECT_TRUE(cache->GetImage<itk::Image<float, 2>>(filenames[3], ImageType::RegionType()).IsNull());
+  cache->Unpin(filenames[0]);
+  ITK_TEST_EXPECT_EQUAL(cache->GetNumberOfEntries(), 2u);
+  ITK_TRY_EXPECT_EXCEPTION(cache->Unpin(filenames[0]));
+
+  // pins outlive Clear(), so the filters which pinned a tile can still unpin it
+  cache->Pin(filenames[0]);
+  cache->Clear();
+  for (itk::SizeValueType t = 0; t < 4; t++)
+  {
+    cache->AddImage(filenames[t], tile.GetPointer());
+  }
+  ITK_TEST_EXPECT_EQUAL(cache->GetNumberOfEntries(), 3u);
+  ITK_TRY_EXPECT_NO_EXCEPTION(cache->Unpin(filenames[0]));
+  ITK_TEST_EXPECT_EQUAL(cache->GetNumberOfEntries(), 2u);
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}
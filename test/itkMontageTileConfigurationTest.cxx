@@ -0,0 +1,131 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkTestingMacros.h"
+#include "itkTileConfiguration.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+namespace
+{
+template <unsigned Dimension>
+bool
+SameConfiguration(const itk::TileConfiguration<Dimension> & a, const itk::TileConfiguration<Dimension> & b)
+{
+  if (a.AxisSizes != b.AxisSizes || a.Tiles.size() != b.Tiles.size())
+  {
+    return false;
+  }
+  for (size_t t = 0; t < a.Tiles.size(); t++)
+  {
+    if (a.Tiles[t].FileName != b.Tiles[t].FileName || a.Tiles[t].Position != b.Tiles[t].Position)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string
+ReadText(const std::string & fileName)
+{
+  std::ifstream in(fileName, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+} // namespace
+
+// Writes a tile configuration in the text and the binary format,
+// and checks that both read back exactly what was written.
+int
+itkMontageTileConfigurationTest(int argc, char * argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << itkNameOfTestExecutableMacro(argv) << " <directoryForOutput>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string directory = argv[1];
+  const std::string textName = directory + "/itkMontageTileConfigurationTest.txt";
+  const std::string binaryName = directory + "/itkMontageTileConfigurationTest.tcb";
+  const std::string crlfName = directory + "/itkMontageTileConfigurationTestCRLF.txt";
+
+  constexpr unsigned Dimension = 3;
+  using ConfigurationType = itk::TileConfiguration<Dimension>;
+  ConfigurationType                original;
+  std::mt19937                     rng(1234);
+  std::uniform_real_distribution<> jitter(-3.0, 3.0);
+  original.AxisSizes = { { 4, 3, 2 } };
+  original.Tiles.resize(original.LinearSize());
+  for (size_t t = 0; t < original.Tiles.size(); t++)
+  {
+    ConfigurationType::TileIndexType ind = original.LinearIndexToNDIndex(t);
+    for (unsigned d = 0; d < Dimension; d++)
+    {
+      original.Tiles[t].Position[d] = ind[d] * 100.0 + jitter(rng) / 3.0; // not exactly representable in decimal
+    }
+    original.Tiles[t].FileName = "tile " + std::to_string(t) + ".tif";
+  }
+
+  unsigned dimension = 0;
+  ITK_TRY_EXPECT_NO_EXCEPTION(original.Write(textName));
+  ITK_TEST_EXPECT_EQUAL(ConfigurationType::TryParse(textName, dimension), original.Tiles[0].FileName);
+  ITK_TEST_EXPECT_EQUAL(dimension, Dimension);
+  ConfigurationType fromText;
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromText.Parse(textName));
+  ITK_TEST_EXPECT_TRUE(SameConfiguration(original, fromText));
+
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromText.WriteBinary(binaryName));
+  dimension = 0;
+  ITK_TEST_EXPECT_EQUAL(ConfigurationType::TryParse(binaryName, dimension), original.Tiles[0].FileName);
+  ITK_TEST_EXPECT_EQUAL(dimension, Dimension);
+  ConfigurationType fromBinary;
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromBinary.Parse(binaryName));
+  ITK_TEST_EXPECT_TRUE(SameConfiguration(original, fromBinary));
+
+  // the text written from the binary format is the same as the original text
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromBinary.Write(crlfName));
+  const std::string text = ReadText(textName);
+  ITK_TEST_EXPECT_EQUAL(ReadText(crlfName), text);
+
+  // comments and Windows line endings are accepted
+  {
+    std::ofstream crlf(crlfName, std::ios::binary);
+    crlf << "# a comment\r\n";
+    for (char c : text)
+    {
+      crlf << (c == '\n' ? "\r\n" : std::string(1, c));
+    }
+  }
+  ConfigurationType fromCRLF;
+  ITK_TRY_EXPECT_NO_EXCEPTION(fromCRLF.Parse(crlfName));
+  ITK_TEST_EXPECT_TRUE(SameConfiguration(original, fromCRLF));
+
+  itk::TileConfiguration<2> wrongDimension;
+  ITK_TRY_EXPECT_EXCEPTION(wrongDimension.Parse(textName));
+  ITK_TRY_EXPECT_EXCEPTION(wrongDimension.Parse(binaryName));
+  {
+    std::ofstream truncated(binaryName, std::ios::binary);
+    truncated << "ITKTCFG1";
+  }
+  ITK_TRY_EXPECT_EXCEPTION(fromBinary.Parse(binaryName));
+
+  std::cout << "Test finished." << std::endl;
+  return EXIT_SUCCESS;
+}
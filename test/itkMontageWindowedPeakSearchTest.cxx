@@ -0,0 +1,129 @@
+/*=========================================================================
+ *
+ *  Copyright NumFOCUS
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         https://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkMontageTextureTileHelper.hxx"
+#include "itkPhaseCorrelationImageRegistrationMethod.h"
+#include "itkTestingMacros.h"
+
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+constexpr unsigned Dimension = 2;
+using PixelType = unsigned short;
+using ImageType = itk::Image<PixelType, Dimension>;
+} // namespace
+
+// Compares the peaks found by searching only the neighborhoods of the expected
+// solution to the peaks found by searching the whole correlation image.
+// Also checks that only a dominant peak is kept with PeakConfidenceRatio.
+int
+itkMontageWindowedPeakSearchTest(int, char *[])
+{
+  using PCMType = itk::PhaseCorrelationImageRegistrationMethod<ImageType, ImageType>;
+  using RealType = PCMType::InternalPixelType;
+  using OperatorType = itk::PhaseCorrelationOperator<RealType, Dimension>;
+  using OptimizerType = itk::PhaseCorrelationOptimizer<RealType, Dimension>;
+  using PeakInterpolationMethod = itk::PhaseCorrelationOptimizerEnums::PeakInterpolationMethod;
+
+  constexpr unsigned   tileSize = 96;
+  constexpr unsigned   step = tileSize - tileSize / 4; // 25% overlap
+  ImageType::IndexType fixedPosition = { { 0, 0 } };
+  ImageType::IndexType movingNominal = { { itk::IndexValueType(step), 0 } };
+  ImageType::IndexType movingActual = { { itk::IndexValueType(step) - 3, 2 } };
+  ImageType::Pointer   fixedImage = MakeTextureTile<ImageType>(fixedPosition, fixedPosition, tileSize);
+  ImageType::Pointer   movingImage = MakeTextureTile<ImageType>(movingActual, movingNominal, tileSize);
+
+  int result = EXIT_SUCCESS;
+  for (PeakInterpolationMethod method : { PeakInterpolationMethod::None,
+                                          PeakInterpolationMethod::Parabolic,
+                                          PeakInterpolationMethod::Cosine })
+  {
+    PCMType::OffsetVector      offsets[2];
+    PCMType::ConfidencesVector confidences[2];
+    for (bool windowed : { false, true })
+    {
+      OptimizerType::Pointer optimizer = OptimizerType::New();
+      optimizer->SetPeakInterpolationMethod(method);
+      optimizer->SetPixelDistanceTolerance(2);
+      ITK_TEST_SET_GET_BOOLEAN(optimizer, WindowedPeakSearch, windowed);
+
+      PCMType::Pointer pcm = PCMType::New();
+      pcm->SetOperator(OperatorType::New());
+      pcm->SetOptimizer(optimizer);
+      pcm->SetFixedImage(fixedImage);
+      pcm->SetMovingImage(movingImage);
+      ITK_TRY_EXPECT_NO_EXCEPTION(pcm->Update());
+      offsets[windowed] = pcm->GetOffsets();
+      confidences[windowed] = pcm->GetConfidences();
+    }
+
+    if (offsets[0].size() != offsets[1].size() || offsets[1].empty())
+    {
+      std::cerr << method << ": windowed search found " << offsets[1].size() << " peaks, full search found "
+                << offsets[0].size() << std::endl;
+      result = EXIT_FAILURE;
+      continue;
+    }
+    for (unsigned i = 0; i < offsets[0].size(); i++)
+    {
+      bool match = std::abs(confidences[0][i] - confidences[1][i]) <= 1e-6 * std::abs(confidences[0][i]);
+      for (unsigned d = 0; d < Dimension; d++)
+      {
+        match = match && std::abs(offsets[0][i][d] - offsets[1][i][d]) <= 1e-6;
+      }
+      if (!match)
+      {
+        std::cerr << method << ": windowed peak " << i << " is " << offsets[1][i] << " with confidence "
+                  << confidences[1][i] << ", full search peak is " << offsets[0][i] << " with confidence "
+                  << confidences[0][i] << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  // the highest peak is kept alone only if its confidence ratio to the next one reaches the threshold
+  auto registerPair = [&](double peakConfidenceRatio) {
+    OptimizerType::Pointer optimizer = OptimizerType::New();
+    optimizer->SetPixelDistanceTolerance(2);
+    optimizer->SetPeakConfidenceRatio(peakConfidenceRatio);
+    PCMType::Pointer pcm = PCMType::New();
+    pcm->SetOperator(OperatorType::New());
+    pcm->SetOptimizer(optimizer);
+    pcm->SetFixedImage(fixedImage);
+    pcm->SetMovingImage(movingImage);
+    pcm->Update();
+    return std::make_pair(pcm->GetOffsets(), pcm->GetConfidences());
+  };
+  const auto allPeaks = registerPair(0.0);
+  if (allPeaks.first.size() < 2)
+  {
+    std::cerr << "Expected several peaks, found " << allPeaks.first.size() << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double ratio = allPeaks.second[0] / allPeaks.second[1];
+  const auto   dominant = registerPair(0.99 * ratio);
+  const auto   ambiguous = registerPair(1.01 * ratio);
+  ITK_TEST_EXPECT_EQUAL(dominant.first.size(), 1u);
+  ITK_TEST_EXPECT_EQUAL(dominant.first[0], allPeaks.first[0]);
+  ITK_TEST_EXPECT_EQUAL(ambiguous.first.size(), allPeaks.first.size());
+
+  std::cout << "Test finished." << std::endl;
+  return result;
+}